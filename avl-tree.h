@@ -1,55 +1,96 @@
 #pragma once
 
+#include <bit>
+#include <cstdint>
+#include <functional>
 #include <stack>
 #include <iostream>
+#include <iterator>
 #include <memory>
+#include <string>
+#include <type_traits>
+#include <span>
+#include <vector>
 
 #include "binary-tree.h"
 
 namespace nodes {
 
-template <typename T>
-class AVLNode : public DefaultNode<T> {
+template <typename T, typename Augment = augments::none>
+class AVLNode : public DefaultNode<T, Augment, AVLNode<T, Augment>> {
 public:
-    size_t height = 1;
+    // An AVL tree of height h holds at least Fib(h + 2) - 1 nodes, so even a
+    // full 64-bit address space stays far below 255
+    std::uint8_t height = 1;
 
-    using base_type = DefaultNode<T>;
+    using base_type = DefaultNode<T, Augment, AVLNode<T, Augment>>;
     using base_type::base_type;
 
-    AVLNode(AVLNode<T>* left, AVLNode<T>* right, 
-            AVLNode<T>* parent, const T& value)
-            : base_type(left, right, parent, value)
-    {}
-
-    AVLNode(AVLNode<T>* left, AVLNode<T>* right,
-            AVLNode<T>* parent, T&& value)
-            : base_type(left, right, parent, std::move(value))
+    template <typename... Args>
+    AVLNode(AVLNode* left, AVLNode* right,
+            AVLNode* parent, Args&&... args)
+            : base_type(left, right, parent, std::forward<Args>(args)...)
     {}
 };
 
 } // namespace nodes
 
-template <typename T>
-class AVLTree : public BinaryTree<T, nodes::AVLNode<T>, std::allocator<T>> {
+template <
+    typename T,
+    typename Allocator = std::allocator<T>,
+    typename Augment = augments::none,
+    typename Instrument = instruments::none,
+    typename Compare = std::less<T>
+> class AVLTree : public BinaryTree<T, nodes::AVLNode<T, Augment>, Allocator,
+                                   Instrument, Compare> {
 public:
-    using base_type = BinaryTree<T, nodes::AVLNode<T>, std::allocator<T>>;
+    using base_type = BinaryTree<T, nodes::AVLNode<T, Augment>, Allocator,
+                                 Instrument, Compare>;
     using base_type::base_type;
+
+    AVLTree() = default;
+
+    template <std::input_iterator InputIt>
+    AVLTree(InputIt first, InputIt last) {
+        assign(first, last);
+    }
     
     // Basic functions
     using base_type::find;
+    using base_type::lower_bound;
+    using base_type::upper_bound;
+    using base_type::equal_range;
+    using base_type::find_many;
+    using base_type::find_from;
+    using base_type::key_comp;
+    using base_type::clear;
+
+    // Order statistics, available with augments::subtree_size
+    using base_type::size;
+    using base_type::nth;
+    using base_type::rank;
+
+    // Range aggregates, available with any augment
+    using base_type::aggregate;
 
     // Helpers
     using base_type::print_by_layer;
+    using base_type::freeze;
+    using base_type::instrumentation;
 
     // Iterators
     using typename base_type::iterator;
     using typename base_type::const_iterator;
 
+    // Node handles, see NodeHandle
+    using typename base_type::node_type;
+    using typename base_type::insert_return_type;
+
     using base_type::begin;
     using base_type::end;
 
     // Fake node connects first, last and root
-    using BaseNode = nodes::BaseNode<nodes::AVLNode<T>>;
+    using BaseNode = nodes::BaseNode<nodes::AVLNode<T, Augment>>;
 
     // Modified functions
     template <typename... Args>
@@ -57,28 +98,208 @@ public:
         auto [ptr, is_successful] =
             base_type::emplace_helper(std::forward<Args>(args)...);
         if (is_successful) {
-            rebalance(ptr);
+            update_height(ptr);
+            rebalance(ptr->parent);
         } else {
-            return std::make_pair(iterator(ptr), false);
+            return std::make_pair(iterator(ptr, *this), false);
+        }
+        return std::make_pair(iterator(ptr, *this), true);
+    }
+
+    // Searches from hint, see BinaryTree::find_from. Appending with end()
+    // as hint is amortized O(1) without augments: the new leaf is found
+    // after one comparison and rebalancing stops where heights stop changing.
+    template <typename... Args>
+    iterator emplace_hint(const_iterator hint, Args&&... args) {
+        auto [ptr, is_successful] = base_type::emplace_hint_helper(
+            hint, std::forward<Args>(args)...);
+        if (is_successful) {
+            update_height(ptr);
+            rebalance(ptr->parent);
+        }
+        return iterator(ptr, *this);
+    }
+
+    // Searches first and builds the T only if key is missing, see
+    // BinaryTree::try_emplace
+    template <LookupKey<T, Compare> Key = T, typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args) {
+        auto [ptr, is_successful] =
+            base_type::try_emplace_helper(key, std::forward<Args>(args)...);
+        if (is_successful) {
+            update_height(ptr);
+            rebalance(ptr->parent);
+        }
+        return std::make_pair(iterator(ptr, *this), is_successful);
+    }
+
+    template <LookupKey<T, Compare> Key = T>
+    bool erase(const Key& key) {
+        auto [ptr, is_self] = base_type::find_helper(key);
+        if (!is_self) {
+            return false;
         }
-        return std::make_pair(iterator(ptr), true);
+
+        detach_node(ptr);
+        base_type::destroy_node(ptr->as_derived());
+        return true;
     }
 
     std::pair<iterator, bool> insert(const T& value) {
-        return emplace(value);
+        return try_emplace(value);
     }
 
     std::pair<iterator, bool> insert(T&& value) {
-        return emplace(std::forward<T>(value));
+        return try_emplace(value, std::move(value));
+    }
+
+    template <LookupKey<T, Compare> Key = T>
+            requires (!base_type::template is_position<Key>)
+    node_type extract(const Key& key) {
+        auto [ptr, is_self] = base_type::find_helper(key);
+        return extract(const_iterator(is_self ? ptr : &this->sentinel_node, *this));
+    }
+
+    node_type extract(const_iterator position) {
+        return base_type::extract_handle(position, [this](BaseNode* node) {
+            detach_node(node);
+        });
+    }
+
+    insert_return_type insert(node_type&& handle) {
+        return base_type::insert_handle(std::move(handle), [this](auto* node) {
+            return attach_node(node);
+        });
+    }
+
+    void merge(AVLTree& other) {
+        base_type::merge_from(*this, other);
+    }
+
+    template <std::input_iterator InputIt>
+    void assign(InputIt first, InputIt last) {
+        base_type::assign_sorted(base_type::sorted_unique(first, last),
+                                 set_balanced_height);
+    }
+
+    // Rebuilds a tree saved with save() in O(n), heights included
+    void assign(const MappedTree<T, Compare>& image) {
+        base_type::assign_image(image, images::Kind::avl,
+            [](BaseNode* node, std::uint64_t height) {
+                node->as_derived()->height = static_cast<std::uint8_t>(height);
+            });
+    }
+
+    // Snapshots, see mapped-tree.h. load_mmap serves lookups from the
+    // mapped file as is; assign(image) turns it back into a mutable tree.
+    void save(const std::string& path) const
+            requires std::is_trivially_copyable_v<T> {
+        base_type::save_image(path, images::Kind::avl,
+            [](const nodes::AVLNode<T, Augment>* node) {
+                return node->height;
+            });
+    }
+
+    static MappedTree<T, Compare> load_mmap(const std::string& path) {
+        return MappedTree<T, Compare>(path, images::Kind::avl);
+    }
+
+    // Batches are sorted first. Small ones then go in one by one, each key
+    // searched from the previous one's node, so the walk is shared across
+    // neighbouring keys. Once the k rebalancing walks would cost more than
+    // relinking every node, the tree is rebuilt around the merged sequence
+    // in O(n + k) instead. Both return how many values were actually
+    // inserted or erased.
+    size_t insert_batch(std::span<const T> values) {
+        std::vector<T> sorted =
+            base_type::sorted_unique(values.begin(), values.end());
+        if (prefers_rebuild(sorted.size())) {
+            return base_type::rebuild_with(std::move(sorted),
+                                           set_balanced_height);
+        }
+
+        size_t inserted = 0;
+        const_iterator finger = end();
+        for (T& value : sorted) {
+            auto [ptr, is_successful] = base_type::try_emplace_hint_helper(
+                finger, value, std::move(value));
+            if (is_successful) {
+                update_height(ptr);
+                rebalance(ptr->parent);
+                ++inserted;
+            }
+            finger = const_iterator(ptr, *this);
+        }
+        return inserted;
+    }
+
+    size_t erase_batch(std::span<const T> values) {
+        std::vector<T> sorted =
+            base_type::sorted_unique(values.begin(), values.end());
+        if (prefers_rebuild(sorted.size())) {
+            return base_type::rebuild_without(sorted, set_balanced_height);
+        }
+
+        size_t erased = 0;
+        const_iterator finger = end();
+        for (const T& value : sorted) {
+            auto [ptr, order] = base_type::find_slot_from(finger, value);
+            finger = const_iterator(ptr, *this);
+            if (ptr != &this->sentinel_node && order == 0) {
+                // Nodes are relinked rather than moved, so the successor
+                // survives the erase and the next search starts there
+                ++finger;
+                detach_node(ptr);
+                base_type::destroy_node(ptr->as_derived());
+                ++erased;
+            }
+        }
+        return erased;
     }
 
 private:
+    // The successor taking a two-child node's place takes its height too
+    void detach_node(BaseNode* node) noexcept {
+        auto [child, child_parent] = base_type::unlink_node(node,
+            [node](BaseNode* successor) {
+                successor->as_derived()->height = node->as_derived()->height;
+            });
+        rebalance(child_parent);
+    }
+
+    std::pair<BaseNode*, bool> attach_node(nodes::AVLNode<T, Augment>* node) {
+        node->height = 1;
+        auto result = base_type::link_leaf(node);
+        if (result.second) {
+            update_height(node);
+            rebalance(node->parent);
+        }
+        return result;
+    }
+
+    // A balanced build of m nodes is exactly bit_width(m) high, so the
+    // heights are set directly instead of going through rebalance
+    static void set_balanced_height(BaseNode* node, size_t subtree_size) {
+        node->as_derived()->height =
+            static_cast<std::uint8_t>(std::bit_width(subtree_size));
+    }
+
+    // Compares k rebalancing walks against relinking the n < 2^height nodes
+    bool prefers_rebuild(size_t batch_size) const noexcept {
+        size_t height = (this->sentinel_node.parent != &this->sentinel_node)
+            ? this->sentinel_node.parent->as_derived()->height : 0;
+        return height < 64
+            && batch_size * (height + 1) >= (size_t{1} << height);
+    }
+
     void update_height(BaseNode* node) {
         int left_height = (node->left != &this->sentinel_node) 
             ? node->left->as_derived()->height : 0;
         int right_height = (node->right != &this->sentinel_node) 
             ? node->right->as_derived()->height : 0;
-        node->as_derived()->height = 1 + std::max(left_height, right_height);
+        node->as_derived()->height =
+            static_cast<std::uint8_t>(1 + std::max(left_height, right_height));
+        this->update_augment(node);
     }
 
     int get_balance(BaseNode* node) {
@@ -89,31 +310,39 @@ private:
         return left_height - right_height;
     }
 
+    // Walks up from node restoring balance. Once a subtree comes out as high
+    // as it was before, nothing above it can change height, so the rest of
+    // the walk only has augments left to refresh.
     void rebalance(BaseNode* node) {
         while (node != &this->sentinel_node) {
+            int old_height = node->as_derived()->height;
             update_height(node);
             int balance = get_balance(node);
 
             if (balance > 1) {
-                if (get_balance(node->left) >= 0) {
-                    rotate_right(node);
-                } else {
+                if (get_balance(node->left) < 0) {
                     rotate_left(node->left);
-                    rotate_right(node);
                 }
+                rotate_right(node);
+                node = node->parent;
             } else if (balance < -1) {
-                if (get_balance(node->right) <= 0) {
-                    rotate_left(node);
-                } else {
+                if (get_balance(node->right) > 0) {
                     rotate_right(node->right);
-                    rotate_left(node);
                 }
+                rotate_left(node);
+                node = node->parent;
+            }
+
+            if (node->as_derived()->height == old_height) {
+                this->update_augment_upward(node->parent);
+                return;
             }
             node = node->parent;
         }
     }
 
     void rotate_left(BaseNode* x) {
+        this->instrument.on_rotation();
         BaseNode* y = x->right;
         x->right = y->left;
         
@@ -139,6 +368,7 @@ private:
     }
 
     void rotate_right(BaseNode* y) {
+        this->instrument.on_rotation();
         BaseNode* x = y->left;
         y->left = x->right;
         
@@ -1,18 +1,314 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <compare>
+#include <concepts>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string>
 #include <vector>
 #include <queue>
 #include <iostream>
 #include <memory>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+#include "frozen-tree.h"
+#include "mapped-tree.h"
+
+// Per-node summaries of the subtree a node roots. An augmentation combines
+// the summaries of the left subtree, the node's own value and the right
+// subtree; trees recompute them whenever the shape below a node changes.
+namespace augments {
+
+struct none {
+    struct value_type {};
+
+    template <typename T>
+    static value_type lift(const T&) noexcept {
+        return {};
+    }
+
+    static value_type combine(value_type, value_type) noexcept {
+        return {};
+    }
+
+    static value_type identity() noexcept {
+        return {};
+    }
+};
+
+// Enables size(), nth(), rank() and iterator arithmetic in O(log n)
+struct subtree_size {
+    using value_type = size_t;
+
+    template <typename T>
+    static size_t lift(const T&) noexcept {
+        return 1;
+    }
+
+    static size_t combine(size_t lhs, size_t rhs) noexcept {
+        return lhs + rhs;
+    }
+
+    static size_t identity() noexcept {
+        return 0;
+    }
+
+    static size_t count(size_t size) noexcept {
+        return size;
+    }
+};
+
+template <typename Augment>
+concept Counting = requires(const typename Augment::value_type& summary) {
+    { Augment::count(summary) } -> std::convertible_to<size_t>;
+};
+
+// Monoids over the values themselves, for aggregate(lo, hi). Value is the
+// type summaries are kept in, e.g. a wider one to keep sums from overflowing.
+template <typename Value>
+struct sum {
+    using value_type = Value;
+
+    template <typename T>
+    static Value lift(const T& value) {
+        return static_cast<Value>(value);
+    }
+
+    static Value combine(const Value& lhs, const Value& rhs) {
+        return lhs + rhs;
+    }
+
+    static Value identity() {
+        return Value{};
+    }
+};
+
+template <typename Value>
+struct min {
+    using value_type = Value;
+
+    template <typename T>
+    static Value lift(const T& value) {
+        return static_cast<Value>(value);
+    }
+
+    static Value combine(const Value& lhs, const Value& rhs) {
+        return rhs < lhs ? rhs : lhs;
+    }
+
+    static Value identity() {
+        return std::numeric_limits<Value>::max();
+    }
+};
+
+template <typename Value>
+struct max {
+    using value_type = Value;
+
+    template <typename T>
+    static Value lift(const T& value) {
+        return static_cast<Value>(value);
+    }
+
+    static Value combine(const Value& lhs, const Value& rhs) {
+        return lhs < rhs ? rhs : lhs;
+    }
+
+    static Value identity() {
+        return std::numeric_limits<Value>::lowest();
+    }
+};
+
+// Keeps two summaries side by side, e.g. subtree_size with sum for averages
+// or order statistics next to a range aggregate. Counts come from First.
+template <typename First, typename Second>
+struct both {
+    using value_type = std::pair<typename First::value_type,
+                                 typename Second::value_type>;
+
+    template <typename T>
+    static value_type lift(const T& value) {
+        return value_type(First::lift(value), Second::lift(value));
+    }
+
+    static value_type combine(const value_type& lhs, const value_type& rhs) {
+        return value_type(First::combine(lhs.first, rhs.first),
+                          Second::combine(lhs.second, rhs.second));
+    }
+
+    static value_type identity() {
+        return value_type(First::identity(), Second::identity());
+    }
+
+    static size_t count(const value_type& summary) noexcept
+            requires Counting<First> {
+        return First::count(summary.first);
+    }
+};
+
+} // namespace augments
+
+// Hooks trees call from their internals. The tree stores its policy as an
+// empty-by-default member, so with instruments::none every hook is an empty
+// inline call and no state is kept.
+namespace instruments {
+
+struct none {
+    // Held for the duration of one split or merge call
+    struct recursion_guard {};
+
+    void on_compare() noexcept {}
+    void on_search(size_t) noexcept {}
+    void on_rotation() noexcept {}
+    void on_allocate() noexcept {}
+    void on_deallocate() noexcept {}
+    void on_release() noexcept {}
+
+    recursion_guard enter_recursion() noexcept {
+        return {};
+    }
+};
+
+// Plain counters, read through the tree's instrumentation()
+struct counters {
+    // Searches reaching depth >= max_depth all land in the last bucket
+    static constexpr size_t max_depth = 64;
+
+    size_t comparisons = 0;
+    size_t rotations = 0;
+    size_t allocations = 0;
+    size_t deallocations = 0;
+    size_t bulk_releases = 0;
+    size_t recursion_calls = 0;
+    size_t max_recursion_depth = 0;
+    // Number of find_helper searches ending at each depth, the root being 0
+    std::array<size_t, max_depth> search_depths{};
+
+    class recursion_guard {
+        size_t* depth;
+
+    public:
+        explicit recursion_guard(size_t* depth) noexcept : depth(depth) {}
+        recursion_guard(const recursion_guard&) = delete;
+        recursion_guard& operator=(const recursion_guard&) = delete;
+
+        ~recursion_guard() {
+            --*depth;
+        }
+    };
+
+    void on_compare() noexcept {
+        ++comparisons;
+    }
+
+    void on_search(size_t depth) noexcept {
+        ++search_depths[std::min(depth, max_depth - 1)];
+    }
+
+    void on_rotation() noexcept {
+        ++rotations;
+    }
+
+    void on_allocate() noexcept {
+        ++allocations;
+    }
+
+    void on_deallocate() noexcept {
+        ++deallocations;
+    }
+
+    void on_release() noexcept {
+        ++bulk_releases;
+    }
+
+    recursion_guard enter_recursion() noexcept {
+        ++recursion_calls;
+        max_recursion_depth = std::max(max_recursion_depth, ++recursion_depth);
+        return recursion_guard(&recursion_depth);
+    }
+
+    void reset() noexcept {
+        *this = counters{};
+    }
+
+private:
+    size_t recursion_depth = 0;
+};
+
+} // namespace instruments
 
 namespace nodes {
 
+// Node types that keep a flag of their own in the low bit of their parent
+// link, e.g. RBNode's colour. Specialize before the node type is defined.
+template <typename DerivedNode>
+inline constexpr bool tags_parent = false;
+
+// Parent link with a flag in its low bit, which node alignment leaves
+// free. It reads as a plain pointer; storing a new parent keeps the flag,
+// while copying a whole node copies the flag with it.
+template <typename Node>
+class TaggedLink {
+    static constexpr std::uintptr_t flag_bit = 1;
+
+    std::uintptr_t bits = 0;
+
+public:
+    TaggedLink() = default;
+    TaggedLink(const TaggedLink&) = default;
+
+    explicit TaggedLink(Node* node) noexcept
+            : bits(reinterpret_cast<std::uintptr_t>(node))
+    {}
+
+    TaggedLink& operator=(const TaggedLink& other) noexcept {
+        return *this = other.get();
+    }
+
+    TaggedLink& operator=(Node* node) noexcept {
+        bits = reinterpret_cast<std::uintptr_t>(node) | (bits & flag_bit);
+        return *this;
+    }
+
+    Node* get() const noexcept {
+        return reinterpret_cast<Node*>(bits & ~flag_bit);
+    }
+
+    operator Node*() const noexcept {
+        return get();
+    }
+
+    Node* operator->() const noexcept {
+        return get();
+    }
+
+    bool flag() const noexcept {
+        return (bits & flag_bit) != 0;
+    }
+
+    void set_flag(bool value) noexcept {
+        bits = (bits & ~flag_bit) | static_cast<std::uintptr_t>(value);
+    }
+};
+
 template <typename DerivedNode>
 class BaseNode {
 public:
+    using parent_link = std::conditional_t<tags_parent<DerivedNode>,
+                                           TaggedLink<BaseNode>, BaseNode*>;
+
     BaseNode* left;
     BaseNode* right;
-    BaseNode* parent;
+    parent_link parent;
 
     DerivedNode* as_derived() noexcept {
         return static_cast<DerivedNode*>(this);
@@ -31,12 +327,22 @@ public:
     {}
 };
 
-template <typename T>
-class DefaultNode : public BaseNode<DefaultNode<T>> {
-    using base_type = BaseNode<DefaultNode<T>>;
+// DerivedNode lets node types extending DefaultNode (e.g. AVLNode) share
+// the BaseNode instantiation the owning tree links them through
+template <
+    typename T,
+    typename Augment = augments::none,
+    typename DerivedNode = void
+> class DefaultNode : public BaseNode<std::conditional_t<
+        std::is_void_v<DerivedNode>, DefaultNode<T, Augment>, DerivedNode>> {
+    using base_type = BaseNode<std::conditional_t<
+        std::is_void_v<DerivedNode>, DefaultNode<T, Augment>, DerivedNode>>;
 
 public:
+    using augment_type = Augment;
+
     T value;
+    [[no_unique_address]] typename Augment::value_type augment{};
 
     template <typename... Args>
     DefaultNode(base_type* left, base_type* right,
@@ -48,10 +354,102 @@ public:
 
 } // namespace nodes
 
+// Allocators that can drop all of their memory at once, e.g. PoolAllocator
+template <typename Allocator>
+concept BulkReleasable = requires(Allocator& alloc, const Allocator& calloc) {
+    { calloc.exclusive() } -> std::convertible_to<bool>;
+    alloc.release();
+};
+
+// Owns one node taken out of a tree, like std::set::node_type. The value
+// may be changed while the node is out; inserting the handle links the
+// node back in, into the same tree or another of its type, so neither the
+// value nor the node is copied. The allocator travels with the node.
+template <typename T, typename NodeType, typename NodeAllocator>
+class NodeHandle {
+    using node_traits = std::allocator_traits<NodeAllocator>;
+
+    template <typename, typename, typename, typename, typename>
+    friend class BinaryTree;
+
+public:
+    using value_type = T;
+
+    NodeHandle() = default;
+
+    NodeHandle(NodeHandle&& other) noexcept
+            : node(std::exchange(other.node, nullptr))
+            , alloc(std::move(other.alloc))
+    {
+        other.alloc.reset();
+    }
+
+    NodeHandle& operator=(NodeHandle&& other) noexcept {
+        if (this != &other) {
+            reset();
+            node = std::exchange(other.node, nullptr);
+            alloc = std::move(other.alloc);
+            other.alloc.reset();
+        }
+        return *this;
+    }
+
+    ~NodeHandle() {
+        reset();
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        return node == nullptr;
+    }
+
+    explicit operator bool() const noexcept {
+        return node != nullptr;
+    }
+
+    // The handle must not be empty
+    T& value() const noexcept {
+        return node->value;
+    }
+
+private:
+    NodeType* node = nullptr;
+    // Empty along with the handle; a default-constructed allocator may
+    // well be a different one, e.g. a fresh pool
+    std::optional<NodeAllocator> alloc;
+
+    NodeHandle(NodeType* node, const NodeAllocator& alloc)
+            : node(node), alloc(alloc)
+    {}
+
+    NodeType* release() noexcept {
+        alloc.reset();
+        return std::exchange(node, nullptr);
+    }
+
+    void reset() noexcept {
+        if (node != nullptr) {
+            node_traits::destroy(*alloc, node);
+            node_traits::deallocate(*alloc, node, 1);
+            node = nullptr;
+        }
+        alloc.reset();
+    }
+};
+
+// Keys lookups take: anything a transparent Compare orders against T, or
+// else anything a T can be made from
+template <typename Key, typename T, typename Compare>
+concept LookupKey = requires { typename Compare::is_transparent; }
+    || std::constructible_from<T, const Key&>;
+
+// Compare is a strict weak order, as for std::set. A transparent one, e.g.
+// std::less<>, lets lookups take other key types without building a T.
 template <
     typename T,
     typename NodeType,
-    typename Allocator
+    typename Allocator,
+    typename Instrument = instruments::none,
+    typename Compare = std::less<T>
 > class BinaryTree {
     template <bool>
     friend class BaseIterator;
@@ -61,11 +459,20 @@ protected:
     using Node = NodeType;
     using node_allocator = typename
         std::allocator_traits<Allocator>::template rebind_alloc<NodeType>;
+    using Augment = typename NodeType::augment_type;
+
+    static constexpr bool is_augmented =
+        !std::is_same_v<Augment, augments::none>;
+
+    static constexpr bool is_transparent =
+        requires { typename Compare::is_transparent; };
 
 private:
     template <bool IsConst>
     class BaseIterator {
     public:
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type = std::ptrdiff_t;
         using value_type = T;
         using pointer = std::conditional_t<IsConst, const T*, T*>;
         using reference = std::conditional_t<IsConst, const T&, T&>;
@@ -75,9 +482,13 @@ private:
         BaseIterator& operator=(const BaseIterator&) = default;
 
         BaseIterator(BaseNode* node, const BinaryTree& tree) 
-                : current(node), tree(tree)
+                : tree(&tree), current(node)
         {}
 
+        operator BaseIterator<true>() const noexcept requires (!IsConst) {
+            return BaseIterator<true>(current, *tree);
+        }
+
         bool operator==(const BaseIterator& other) const noexcept {
             return current == other.current;
         }
@@ -93,10 +504,22 @@ private:
         }
 
         BaseIterator& operator++() {
-            current = tree.find_next(current);
+            current = tree->find_next(current);
+            return *this;
+        }
+
+        BaseIterator& operator+=(difference_type offset)
+                requires augments::Counting<Augment> {
+            current = tree->find_nth(tree->rank_of(current) + offset);
             return *this;
         }
 
+        BaseIterator operator+(difference_type offset) const
+                requires augments::Counting<Augment> {
+            auto temp = *this;
+            return temp += offset;
+        }
+
         reference operator*() const {
             return current->as_derived()->value;
         }
@@ -106,42 +529,75 @@ private:
         }
 
     private:
-        const BinaryTree& tree;
-        BaseNode* current;
+        friend class BinaryTree;
+
+        const BinaryTree* tree = nullptr;
+        BaseNode* current = nullptr;
     };
 
 public:
     using iterator = BaseIterator<false>;
     using const_iterator = BaseIterator<true>;
 
+    using node_type = NodeHandle<T, NodeType, node_allocator>;
+
+    struct insert_return_type {
+        iterator position;
+        bool inserted;
+        node_type node;
+    };
+
+protected:
+    // Iterators go to extract's other overload even with a transparent
+    // Compare, which would take them as keys
+    template <typename Key>
+    static constexpr bool is_position =
+        std::is_convertible_v<const Key&, const_iterator>;
+
+    // Whether searching for a Key first builds a T, which may throw
+    template <typename Key>
+    static constexpr bool converts_key =
+        !is_transparent && !std::is_same_v<Key, T>;
+
+public:
+
     BinaryTree()
             : sentinel_node()
     {}
 
+    explicit BinaryTree(const Compare& comp)
+            : sentinel_node(), comp(comp)
+    {}
+
     ~BinaryTree() {
         clear();
     }
 
-    BinaryTree(const BinaryTree& other) 
+    template <std::input_iterator InputIt>
+    BinaryTree(InputIt first, InputIt last)
             : BinaryTree()
     {
-        for (const auto& val : other) {
-            insert(val);
-        }
+        assign(first, last);
+    }
+
+    BinaryTree(const BinaryTree& other) 
+            : BinaryTree(other.comp)
+    {
+        clone_from(other);
     }
 
+    // Moves take the nodes over without copying them, but every leaf link
+    // points at the tree's own sentinel and has to be redirected: O(n)
     BinaryTree(BinaryTree&& other) noexcept
-            : sentinel_node{other.sentinel_node}
+            : BinaryTree(other.comp)
     {
-        other.reset_sentinel();
+        steal(other);
     }
 
     BinaryTree& operator=(const BinaryTree& other) {
         if (this != &other) {
             clear();
-            for (const auto& val : other) {
-                insert(val);
-            }
+            clone_from(other);
         }
         return *this;
     }
@@ -149,8 +605,7 @@ public:
     BinaryTree& operator=(BinaryTree&& other) noexcept {
         if (this != &other) {
             clear();
-            sentinel_node = other.sentinel_node;
-            other.reset_sentinel();
+            steal(other);
         }
         return *this;
     }
@@ -175,121 +630,555 @@ public:
         return sentinel_node.parent == &sentinel_node;
     }
 
-    iterator find(const T& value) {
-        auto [ptr, is_self] = find_helper(value);
+    Compare key_comp() const {
+        return comp;
+    }
+
+    // Lookups take a T or, with a transparent Compare, any key it orders
+    // against T. Key defaults to T, so braced initializers still work.
+    template <LookupKey<T, Compare> Key = T>
+    iterator find(const Key& key) {
+        auto [ptr, is_self] = find_helper(key);
 
         if (is_self) {
-            return iterator(ptr, &sentinel_node);
+            return iterator(ptr, *this);
         } else {
             return end();
         }
     }
 
+    // Finger search: starts at finger and climbs only as far as needed, so
+    // keys near the finger, as in nearly sorted streams, are found without
+    // descending from the root. finger may be end().
+    template <LookupKey<T, Compare> Key = T>
+    iterator find_from(const_iterator finger, const Key& key) {
+        Slot slot = find_slot_from(finger, key);
+        if (slot.node != &sentinel_node && slot.order == 0) {
+            return iterator(slot.node, *this);
+        }
+        return end();
+    }
+
+    // First element not less than key
+    template <LookupKey<T, Compare> Key = T>
+    iterator lower_bound(const Key& key) noexcept(!converts_key<Key>) {
+        return iterator(lower_bound_node(lookup_key(key)), *this);
+    }
+
+    template <LookupKey<T, Compare> Key = T>
+    const_iterator lower_bound(const Key& key) const
+            noexcept(!converts_key<Key>) {
+        return const_iterator(lower_bound_node(lookup_key(key)), *this);
+    }
+
+    // First element greater than key
+    template <LookupKey<T, Compare> Key = T>
+    iterator upper_bound(const Key& key) noexcept(!converts_key<Key>) {
+        return iterator(upper_bound_node(lookup_key(key)), *this);
+    }
+
+    template <LookupKey<T, Compare> Key = T>
+    const_iterator upper_bound(const Key& key) const
+            noexcept(!converts_key<Key>) {
+        return const_iterator(upper_bound_node(lookup_key(key)), *this);
+    }
+
+    // Keys are unique, so the range is empty or holds the one equal element
+    template <LookupKey<T, Compare> Key = T>
+    std::pair<iterator, iterator> equal_range(const Key& key)
+            noexcept(!converts_key<Key>) {
+        auto [first, last] = equal_range_nodes(lookup_key(key));
+        return std::make_pair(iterator(first, *this), iterator(last, *this));
+    }
+
+    template <LookupKey<T, Compare> Key = T>
+    std::pair<const_iterator, const_iterator>
+    equal_range(const Key& key) const noexcept(!converts_key<Key>) {
+        auto [first, last] = equal_range_nodes(lookup_key(key));
+        return std::make_pair(const_iterator(first, *this),
+                              const_iterator(last, *this));
+    }
+
+    // Finds every key of keys, storing the result in the matching slot of
+    // out, which must be at least as long; a shorter out throws
+    // std::invalid_argument before anything is searched. Up to batch_lanes
+    // searches run interleaved, each taking one step per round and
+    // prefetching the node it moves to, so their cache misses overlap
+    // instead of queueing up.
+    void find_many(std::span<const T> keys, std::span<iterator> out) {
+        if (out.size() < keys.size()) {
+            throw std::invalid_argument("find_many: out is shorter than keys");
+        }
+
+        struct Lane {
+            BaseNode* node;
+            size_t index;
+            size_t depth;
+        };
+
+        BaseNode* root = sentinel_node.parent;
+        std::array<Lane, batch_lanes> lanes;
+        size_t active = 0;
+        size_t next = 0;
+        while (active < batch_lanes && next < keys.size()) {
+            lanes[active++] = Lane{root, next++, 0};
+        }
+
+        while (active > 0) {
+            for (size_t i = 0; i < active;) {
+                Lane& lane = lanes[i];
+                BaseNode* current = lane.node;
+                const T& key = keys[lane.index];
+
+                if (current != &sentinel_node) {
+                    auto order = compare(key, current->as_derived()->value);
+                    if (order > 0) {
+                        lane.node = current->right;
+                    } else {
+                        lane.node = order < 0 ? current->left : nullptr;
+                    }
+
+                    if (lane.node != nullptr) {
+                        prefetch(lane.node);
+                        ++lane.depth;
+                        ++i;
+                        continue;
+                    }
+                }
+
+                instrument.on_search(lane.depth);
+                out[lane.index] = lane.node == nullptr
+                    ? iterator(current, *this) : end();
+
+                // Refill the lane, or retire it by moving the last one in
+                if (next < keys.size()) {
+                    lane = Lane{root, next++, 0};
+                    ++i;
+                } else {
+                    lane = lanes[--active];
+                }
+            }
+        }
+    }
+
     template <typename... Args>
     std::pair<iterator, bool> emplace(Args&&... args) {
         auto [ptr, is_successful] = emplace_helper(std::forward<Args>(args)...);
         if (is_successful) {
+            update_augment_upward(ptr);
             return std::make_pair(iterator(ptr, *this), true);
         } else {
             return std::make_pair(end(), false);
         }
     }
 
+    // Like emplace, but searches from hint rather than from the root, see
+    // find_from. Returns the new element, or the equal one already there.
+    template <typename... Args>
+    iterator emplace_hint(const_iterator hint, Args&&... args) {
+        auto [ptr, is_successful] =
+            emplace_hint_helper(hint, std::forward<Args>(args)...);
+        if (is_successful) {
+            update_augment_upward(ptr);
+        }
+        return iterator(ptr, *this);
+    }
+
+    // Searches for key before allocating: only if no element is equivalent
+    // is a T made from args, or from key alone without args, and linked
+    // where the search ended. That T must be equivalent to key.
+    template <LookupKey<T, Compare> Key = T, typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args) {
+        auto [ptr, is_successful] =
+            try_emplace_helper(key, std::forward<Args>(args)...);
+        if (is_successful) {
+            update_augment_upward(ptr);
+        }
+        return std::make_pair(iterator(ptr, *this), is_successful);
+    }
+
     std::pair<iterator, bool> insert(const T& value) {
-        return emplace(value);
+        return try_emplace(value);
     }
 
     std::pair<iterator, bool> insert(T&& value) {
-        return emplace(std::forward<T>(value));
+        return try_emplace(value, std::move(value));
+    }
+
+    // Replaces the contents with [first, last) in O(n) for sorted input,
+    // O(n log n) otherwise; duplicates are dropped
+    template <std::input_iterator InputIt>
+    void assign(InputIt first, InputIt last) {
+        assign_sorted(sorted_unique(first, last), [](BaseNode*, size_t) {});
     }
 
-    bool erase(const T& value) {
-        auto [ptr, is_self] = find_helper(value);
+    // A node with two children is swapped for its successor node, so no
+    // value is moved and iterators to other elements stay valid
+    template <LookupKey<T, Compare> Key = T>
+    bool erase(const Key& key) {
+        auto [ptr, is_self] = find_helper(key);
         if (!is_self) {
             return false;
         }
 
-        if (ptr->left == &sentinel_node 
-                && ptr->right == &sentinel_node) {
-            if (ptr->parent == &sentinel_node) {
-                reset_sentinel();
-            } else if (ptr->parent->right == ptr) {
-                ptr->parent->right = &sentinel_node;
-                if (sentinel_node.right == ptr) {
-                    sentinel_node.right = ptr->parent;
-                }
-            } else {
-                ptr->parent->left = &sentinel_node;
-                if (sentinel_node.left == ptr) {
-                    sentinel_node.left = ptr->parent;
-                }
-            }
-            destroy_node(ptr->as_derived());
-        } else if (ptr->left == &sentinel_node
-                || ptr->right == &sentinel_node) {
-            BaseNode* child = (ptr->left != &sentinel_node) ? ptr->left : ptr->right;
-            child->parent = ptr->parent;
+        detach_node(ptr);
+        destroy_node(ptr->as_derived());
+        return true;
+    }
 
-            if (ptr->parent == &sentinel_node) {
-                sentinel_node.parent = child;
-            } else if (ptr->parent->left == ptr) {
-                ptr->parent->left = child;
-            } else {
-                ptr->parent->right = child;
-            }
-            destroy_node(ptr->as_derived());        
-        } else {
-            BaseNode* successor = find_next(ptr);
-            T successor_value = std::move(successor->as_derived()->value);
-            erase(successor_value);
-            ptr->as_derived()->value = std::move(successor_value);
-        }
+    // Node handles. extract takes an element's node out of the tree, or
+    // returns an empty handle if there is no such element.
+    template <LookupKey<T, Compare> Key = T>
+            requires (!is_position<Key>)
+    node_type extract(const Key& key) {
+        auto [ptr, is_self] = find_helper(key);
+        return extract(const_iterator(is_self ? ptr : &sentinel_node, *this));
+    }
 
-        return true;
+    node_type extract(const_iterator position) {
+        return extract_handle(position, [this](BaseNode* node) {
+            detach_node(node);
+        });
     }
 
-    void print_by_layer() const noexcept {
-        std::queue<BaseNode*> nodes;
-        if (sentinel_node.parent != &sentinel_node) {
-            nodes.push(sentinel_node.parent);
-        }
+    // Links the handle's node in. If an equal element is already there, the
+    // node is handed back in the result, whose position is that element.
+    insert_return_type insert(node_type&& handle) {
+        return insert_handle(std::move(handle), [this](NodeType* node) {
+            return attach_node(node);
+        });
+    }
 
-        while (!nodes.empty()) {
-            BaseNode* current = nodes.front();
-            nodes.pop();
+    // Moves over every element of other whose key this tree lacks
+    void merge(BinaryTree& other) {
+        merge_from(*this, other);
+    }
 
-            std::cout << current->as_derived()->value << ' ';
+    [[nodiscard]] size_t size() const noexcept
+            requires augments::Counting<Augment> {
+        return Augment::count(augment_of(sentinel_node.parent));
+    }
 
-            if (current->left != &sentinel_node) {
-                nodes.push(current->left);
-            }
-            if (current->right != &sentinel_node) {
-                nodes.push(current->right);
-            }
-        }
-        std::cout << '\n';
+    // k-th smallest element counting from zero, end() if k >= size()
+    iterator nth(size_t k) noexcept requires augments::Counting<Augment> {
+        return iterator(find_nth(k), *this);
     }
 
-protected:
+    const_iterator nth(size_t k) const noexcept
+            requires augments::Counting<Augment> {
+        return const_iterator(find_nth(k), *this);
+    }
+
+    // Number of elements less than value
+    size_t rank(const T& value) const noexcept
+            requires augments::Counting<Augment> {
+        size_t result = 0;
+        BaseNode* current = sentinel_node.parent;
+        while (current != &sentinel_node) {
+            if (comp(current->as_derived()->value, value)) {
+                result += Augment::count(augment_of(current->left)) + 1;
+                current = current->right;
+            } else {
+                current = current->left;
+            }
+        }
+        return result;
+    }
+
+    // Summary of the values in [lo, hi), combined in order. Below the node
+    // where the paths to lo and hi part, every subtree hanging inside the
+    // range contributes its stored summary, so this takes O(log n).
+    typename Augment::value_type aggregate(const T& lo, const T& hi) const
+            requires is_augmented {
+        BaseNode* split = sentinel_node.parent;
+        while (split != &sentinel_node) {
+            if (comp(split->as_derived()->value, lo)) {
+                split = split->right;
+            } else if (!comp(split->as_derived()->value, hi)) {
+                split = split->left;
+            } else {
+                break;
+            }
+        }
+        if (split == &sentinel_node) {
+            return Augment::identity();
+        }
+
+        // Pieces right of lo, each one left of those found before it
+        auto left = Augment::identity();
+        for (BaseNode* current = split->left; current != &sentinel_node;) {
+            if (comp(current->as_derived()->value, lo)) {
+                current = current->right;
+            } else {
+                left = Augment::combine(
+                    Augment::combine(Augment::lift(current->as_derived()->value),
+                                     augment_of(current->right)),
+                    left
+                );
+                current = current->left;
+            }
+        }
+
+        // Pieces left of hi, each one right of those found before it
+        auto right = Augment::identity();
+        for (BaseNode* current = split->right; current != &sentinel_node;) {
+            if (comp(current->as_derived()->value, hi)) {
+                right = Augment::combine(
+                    right,
+                    Augment::combine(augment_of(current->left),
+                                     Augment::lift(current->as_derived()->value))
+                );
+                current = current->right;
+            } else {
+                current = current->left;
+            }
+        }
+
+        return Augment::combine(
+            Augment::combine(left, Augment::lift(split->as_derived()->value)),
+            right
+        );
+    }
+
+    void clear() noexcept {
+        if (sentinel_node.parent != &sentinel_node) {
+            if constexpr (BulkReleasable<node_allocator>) {
+                if (alloc.exclusive()) {
+                    if constexpr (!std::is_trivially_destructible_v<NodeType>) {
+                        for_each_node(sentinel_node.parent, [](BaseNode* node) {
+                            std::destroy_at(node->as_derived());
+                        });
+                    }
+                    alloc.release();
+                    instrument.on_release();
+                    reset_sentinel();
+                    return;
+                }
+            }
+            delete_subtree(sentinel_node.parent);
+        }
+        reset_sentinel();
+    }
+
+    // Read-only copy laid out for fast lookups; later changes to the tree
+    // are not reflected in it
+    FrozenTree<T, Compare> freeze() const {
+        return FrozenTree<T, Compare>(begin(), end(), comp);
+    }
+
+    // State of the Instrument policy, e.g. instruments::counters
+    const Instrument& instrumentation() const noexcept {
+        return instrument;
+    }
+
+    Instrument& instrumentation() noexcept {
+        return instrument;
+    }
+
+    void print_by_layer() const noexcept {
+        std::queue<BaseNode*> nodes;
+        if (sentinel_node.parent != &sentinel_node) {
+            nodes.push(sentinel_node.parent);
+        }
+
+        while (!nodes.empty()) {
+            BaseNode* current = nodes.front();
+            nodes.pop();
+
+            std::cout << current->as_derived()->value << ' ';
+
+            if (current->left != &sentinel_node) {
+                nodes.push(current->left);
+            }
+            if (current->right != &sentinel_node) {
+                nodes.push(current->right);
+            }
+        }
+        std::cout << '\n';
+    }
+
+protected:
     mutable BaseNode sentinel_node;
     [[no_unique_address]] node_allocator alloc;
+    [[no_unique_address]] Instrument instrument;
+    [[no_unique_address]] Compare comp;
+
+    // Searches find_many keeps in flight at once
+    static constexpr size_t batch_lanes = 16;
+
+    // Hints the cache to fetch node ahead of use
+    static void prefetch([[maybe_unused]] const BaseNode* node) noexcept {
+#if defined(__GNUC__)
+        __builtin_prefetch(node);
+#endif
+    }
+
+    // What searches compare against: key itself when Compare takes it,
+    // otherwise a T made from it once up front rather than once per level
+    template <typename Key>
+    decltype(auto) lookup_key(const Key& key) const {
+        if constexpr (!converts_key<Key>) {
+            return (key);
+        } else {
+            return T(key);
+        }
+    }
+
+    // Orders lhs against rhs. Under std::less, keys with <=> are told apart
+    // by one three-way comparison, as they are by comparators with their own
+    // three_way; other comparators take a second call to tell greater from
+    // equivalent.
+    template <typename Lhs, typename Rhs>
+    std::weak_ordering compare(const Lhs& lhs, const Rhs& rhs) {
+        instrument.on_compare();
+        if constexpr (requires { comp.three_way(lhs, rhs); }) {
+            return comp.three_way(lhs, rhs);
+        } else if constexpr ((std::is_same_v<Compare, std::less<T>>
+                          || std::is_same_v<Compare, std::less<>>)
+                      && std::three_way_comparable_with<Lhs, Rhs,
+                                                        std::weak_ordering>) {
+            return lhs <=> rhs;
+        } else {
+            if (comp(lhs, rhs)) {
+                return std::weak_ordering::less;
+            }
+            instrument.on_compare();
+            return comp(rhs, lhs) ? std::weak_ordering::greater
+                                  : std::weak_ordering::equivalent;
+        }
+    }
+
+    // Where a search ends: the node equivalent to the key, or the last node
+    // passed, below which the key belongs on the side order gives
+    struct Slot {
+        BaseNode* node;
+        std::weak_ordering order;
+    };
+
+    template <typename Key>
+    Slot find_slot(const Key& key) {
+        return descend(sentinel_node.parent,
+                       Slot{&sentinel_node, std::weak_ordering::less},
+                       lookup_key(key), 0);
+    }
+
+    // Finger search: climbs from finger only until the subtree on key's
+    // side of the last node passed is bounded beyond key, then descends
+    // into it. A key d positions from the finger costs O(log d)
+    // comparisons unless the two sit on opposite sides of a high node. A
+    // new maximum with end() or the old maximum as finger, or a new minimum
+    // with begin(), is placed after one comparison.
+    template <typename Key>
+    Slot find_slot_from(const_iterator position, const Key& key) {
+        if (sentinel_node.parent == &sentinel_node) {
+            return Slot{&sentinel_node, std::weak_ordering::less};
+        }
+        BaseNode* finger = position.current != &sentinel_node
+            ? position.current : sentinel_node.right;
+
+        const auto& search_key = lookup_key(key);
+        Slot slot{finger, compare(search_key, finger->as_derived()->value)};
+        size_t depth = 1;
+        if (slot.order == 0) {
+            instrument.on_search(depth);
+            return slot;
+        }
+
+        // The extreme nodes have no bound on their open side
+        bool is_right = slot.order > 0;
+        BaseNode* extreme = is_right ? sentinel_node.right : sentinel_node.left;
+        while (slot.node != extreme) {
+            BaseNode* top = slot.node;
+            while (top->parent != &sentinel_node
+                    && top == (is_right ? top->parent->right : top->parent->left)) {
+                top = top->parent;
+            }
+
+            BaseNode* bound = top->parent;
+            if (bound == &sentinel_node) {
+                break;
+            }
+            std::weak_ordering order =
+                compare(search_key, bound->as_derived()->value);
+            ++depth;
+            if (order == 0) {
+                instrument.on_search(depth);
+                return Slot{bound, order};
+            }
+            if ((order > 0) != is_right) {
+                break;
+            }
+            slot.node = bound;
+        }
 
-    std::pair<BaseNode*, bool> find_helper(const T& value) {
+        return descend(is_right ? slot.node->right : slot.node->left,
+                       slot, search_key, depth);
+    }
+
+    // Continues a search at current, below the slot passed last
+    template <typename Key>
+    Slot descend(BaseNode* current, Slot slot, const Key& search_key,
+                 size_t depth) {
+        for (; current != &sentinel_node; ++depth) {
+            slot = Slot{current, compare(search_key, current->as_derived()->value)};
+            if (slot.order == 0) {
+                break;
+            }
+            current = slot.order < 0 ? current->left : current->right;
+        }
+
+        instrument.on_search(depth);
+        return slot;
+    }
+
+    // The equivalent node and true, or the last node passed and false
+    template <typename Key>
+    std::pair<BaseNode*, bool> find_helper(const Key& key) {
+        Slot slot = find_slot(key);
+        return std::make_pair(slot.node,
+                              slot.node != &sentinel_node && slot.order == 0);
+    }
+
+    template <typename Key>
+    BaseNode* lower_bound_node(const Key& value) const noexcept {
         BaseNode* current = sentinel_node.parent;
-        BaseNode* parent = &sentinel_node;
+        BaseNode* result = &sentinel_node;
 
         while (current != &sentinel_node) {
-            parent = current;
-            if (current->as_derived()->value < value) {
+            if (comp(current->as_derived()->value, value)) {
                 current = current->right;
-            } else if (current->as_derived()->value > value) {
+            } else {
+                result = current;
+                current = current->left;
+            }
+        }
+        return result;
+    }
+
+    template <typename Key>
+    BaseNode* upper_bound_node(const Key& value) const noexcept {
+        BaseNode* current = sentinel_node.parent;
+        BaseNode* result = &sentinel_node;
+
+        while (current != &sentinel_node) {
+            if (comp(value, current->as_derived()->value)) {
+                result = current;
                 current = current->left;
             } else {
-                return std::make_pair(current, true);
+                current = current->right;
             }
         }
+        return result;
+    }
 
-        return std::make_pair(parent, false);
+    template <typename Key>
+    std::pair<BaseNode*, BaseNode*>
+    equal_range_nodes(const Key& value) const noexcept {
+        BaseNode* first = lower_bound_node(value);
+        if (first != &sentinel_node && !comp(value, first->as_derived()->value)) {
+            return std::make_pair(first, find_next(first));
+        }
+        return std::make_pair(first, first);
     }
 
     template <typename... Args>
@@ -298,29 +1187,381 @@ protected:
                 &sentinel_node, &sentinel_node, &sentinel_node, 
                 std::forward<Args>(args)...
         );
-        auto [ptr, is_self] = find_helper(new_node->value);
+        auto result = link_leaf(new_node);
+        if (!result.second) {
+            destroy_node(new_node);
+        }
+        return result;
+    }
+
+    // Makes the node from args and hangs it where a finger search from hint
+    // ends, unless an equal element is found there
+    template <typename... Args>
+    std::pair<BaseNode*, bool> emplace_hint_helper(const_iterator hint,
+                                                   Args&&... args) {
+        NodeType* new_node = create_node(
+                &sentinel_node, &sentinel_node, &sentinel_node,
+                std::forward<Args>(args)...
+        );
+        Slot slot = find_slot_from(hint, new_node->value);
+        if (slot.node != &sentinel_node && slot.order == 0) {
+            destroy_node(new_node);
+            return std::make_pair(slot.node, false);
+        }
 
+        link_at(slot, new_node);
+        return std::make_pair(new_node, true);
+    }
+
+    // Searches for key and, if nothing is equivalent, makes the node from
+    // args, or from key without args, and hangs it where the search ended
+    template <typename Key, typename... Args>
+    std::pair<BaseNode*, bool> try_emplace_helper(const Key& key,
+                                                  Args&&... args) {
+        return try_emplace_at(find_slot(key), key, std::forward<Args>(args)...);
+    }
+
+    // The same with a finger search from hint, see find_from
+    template <typename Key, typename... Args>
+    std::pair<BaseNode*, bool> try_emplace_hint_helper(const_iterator hint,
+                                                       const Key& key,
+                                                       Args&&... args) {
+        return try_emplace_at(find_slot_from(hint, key), key,
+                              std::forward<Args>(args)...);
+    }
+
+    template <typename Key, typename... Args>
+    std::pair<BaseNode*, bool> try_emplace_at(const Slot& slot, const Key& key,
+                                              Args&&... args) {
+        if (slot.node != &sentinel_node && slot.order == 0) {
+            return std::make_pair(slot.node, false);
+        }
+
+        NodeType* new_node;
+        if constexpr (sizeof...(Args) == 0) {
+            new_node = create_node(&sentinel_node, &sentinel_node,
+                                   &sentinel_node, key);
+        } else {
+            new_node = create_node(&sentinel_node, &sentinel_node,
+                                   &sentinel_node, std::forward<Args>(args)...);
+        }
+        link_at(slot, new_node);
+        return std::make_pair(new_node, true);
+    }
+
+    // Hangs an unlinked node as a leaf where the search for its value ends.
+    // If an equal element is found instead, returns it and links nothing.
+    std::pair<BaseNode*, bool> link_leaf(NodeType* new_node) {
+        Slot slot = find_slot(new_node->value);
+        if (slot.node != &sentinel_node && slot.order == 0) {
+            return std::make_pair(slot.node, false);
+        }
+
+        link_at(slot, new_node);
+        return std::make_pair(new_node, true);
+    }
+
+    // Links new_node below the slot a failed search ended at
+    void link_at(const Slot& slot, NodeType* new_node) noexcept {
+        BaseNode* ptr = slot.node;
+        new_node->parent = ptr;
         if (ptr == &sentinel_node) {
             sentinel_node.left = sentinel_node.right 
                 = sentinel_node.parent = new_node;
-        } else if (is_self) {
-            destroy_node(new_node);
-            return std::make_pair(ptr, false);
-        } else if (ptr->as_derived()->value < new_node->value) {
-            new_node->parent = ptr;
+        } else if (slot.order > 0) {
             ptr->right = new_node;
             if (sentinel_node.right == ptr) {
                 sentinel_node.right = new_node;
             }
         } else {
-            new_node->parent = ptr;
             ptr->left = new_node;
             if (sentinel_node.left == ptr) {
                 sentinel_node.left = new_node;
             }
         }
+    }
+
+    template <std::input_iterator InputIt>
+    std::vector<T> sorted_unique(InputIt first, InputIt last) const {
+        std::vector<T> values(first, last);
+        if (!std::is_sorted(values.begin(), values.end(), comp)) {
+            std::sort(values.begin(), values.end(), comp);
+        }
+        values.erase(std::unique(values.begin(), values.end(),
+                [this](const T& lhs, const T& rhs) { return !comp(lhs, rhs); }),
+            values.end());
+        return values;
+    }
+
+    // Builds a perfectly balanced tree out of strictly increasing values.
+    // on_link(node, subtree_size) runs once per node after its children
+    // are attached.
+    template <typename OnLink>
+    void assign_sorted(std::vector<T>&& values, OnLink&& on_link) {
+        clear();
+        relink_balanced(create_nodes(std::move(values)), on_link);
+    }
+
+    // Rebuilds the tree from its own nodes merged with new nodes for the
+    // sorted, unique values that are missing, in O(n + k). Returns the
+    // number of values inserted.
+    template <typename OnLink>
+    size_t rebuild_with(std::vector<T>&& values, OnLink&& on_link) {
+        std::vector<NodeType*> existing = collect_nodes();
+        std::vector<T> missing;
+        missing.reserve(values.size());
+
+        auto current = existing.begin();
+        for (T& value : values) {
+            while (current != existing.end() && comp((*current)->value, value)) {
+                ++current;
+            }
+            if (current == existing.end() || comp(value, (*current)->value)) {
+                missing.push_back(std::move(value));
+            }
+        }
 
-        return std::make_pair(new_node, true);
+        std::vector<NodeType*> nodes(existing.size() + missing.size());
+        std::vector<NodeType*> added = create_nodes(std::move(missing));
+        std::merge(existing.begin(), existing.end(), added.begin(), added.end(),
+                   nodes.begin(), [this](const NodeType* lhs, const NodeType* rhs) {
+                       return comp(lhs->value, rhs->value);
+                   });
+        relink_balanced(std::move(nodes), on_link);
+        return added.size();
+    }
+
+    // Rebuilds the tree without the nodes holding any of the sorted, unique
+    // values in O(n + k). Returns the number of values erased.
+    template <typename OnLink>
+    size_t rebuild_without(const std::vector<T>& values, OnLink&& on_link) {
+        std::vector<NodeType*> nodes = collect_nodes();
+        std::vector<NodeType*> kept;
+        kept.reserve(nodes.size());
+
+        auto value = values.begin();
+        for (NodeType* node : nodes) {
+            while (value != values.end() && comp(*value, node->value)) {
+                ++value;
+            }
+            if (value != values.end() && !comp(node->value, *value)) {
+                destroy_node(node);
+            } else {
+                kept.push_back(node);
+            }
+        }
+
+        relink_balanced(std::move(kept), on_link);
+        return nodes.size() - kept.size();
+    }
+
+    std::vector<NodeType*> collect_nodes() const {
+        std::vector<NodeType*> nodes;
+        for (BaseNode* node = sentinel_node.left; node != &sentinel_node;
+                node = find_next(node)) {
+            nodes.push_back(node->as_derived());
+        }
+        return nodes;
+    }
+
+    // Links detached nodes, sorted by value, into a perfectly balanced tree
+    // that replaces the current shape
+    template <typename OnLink>
+    void relink_balanced(std::vector<NodeType*>&& nodes, OnLink& on_link) noexcept {
+        reset_sentinel();
+        if (nodes.empty()) {
+            return;
+        }
+
+        sentinel_node.parent = link_balanced(
+            nodes.data(), nodes.size(), &sentinel_node, on_link
+        );
+        sentinel_node.left = nodes.front();
+        sentinel_node.right = nodes.back();
+    }
+
+    typename Augment::value_type augment_of(const BaseNode* node) const noexcept {
+        if (node == &sentinel_node) {
+            return Augment::identity();
+        }
+        return node->as_derived()->augment;
+    }
+
+    // Recomputes node's summary from its children, which must be up to date
+    void update_augment(BaseNode* node) noexcept {
+        if constexpr (is_augmented) {
+            Node* derived = node->as_derived();
+            derived->augment = Augment::combine(
+                Augment::combine(augment_of(node->left),
+                                 Augment::lift(derived->value)),
+                augment_of(node->right)
+            );
+        }
+    }
+
+    void update_augment_upward(BaseNode* node) noexcept {
+        if constexpr (is_augmented) {
+            while (node != &sentinel_node) {
+                update_augment(node);
+                node = node->parent;
+            }
+        }
+    }
+
+    // Recomputes every summary of a subtree whose shape was built by hand
+    void update_augment_subtree(BaseNode* node) {
+        if constexpr (is_augmented) {
+            std::vector<BaseNode*> order;
+            for_each_node(node, [&order](BaseNode* current) {
+                order.push_back(current);
+            });
+            for (auto it = order.rbegin(); it != order.rend(); ++it) {
+                update_augment(*it);
+            }
+        }
+    }
+
+    BaseNode* find_nth(size_t k) const noexcept
+            requires augments::Counting<Augment> {
+        BaseNode* current = sentinel_node.parent;
+        while (current != &sentinel_node) {
+            size_t left_size = Augment::count(augment_of(current->left));
+            if (k < left_size) {
+                current = current->left;
+            } else if (k == left_size) {
+                return current;
+            } else {
+                k -= left_size + 1;
+                current = current->right;
+            }
+        }
+        return &sentinel_node;
+    }
+
+    // Position of node in sorted order; the sentinel ranks after the last
+    size_t rank_of(const BaseNode* node) const noexcept
+            requires augments::Counting<Augment> {
+        if (node == &sentinel_node) {
+            return size();
+        }
+
+        size_t result = Augment::count(augment_of(node->left));
+        while (node->parent != &sentinel_node) {
+            if (node->parent->right == node) {
+                result += Augment::count(augment_of(node->parent->left)) + 1;
+            }
+            node = node->parent;
+        }
+        return result;
+    }
+
+    // Allocates detached nodes for the values, releasing them all on failure
+    std::vector<NodeType*> create_nodes(std::vector<T>&& values) {
+        std::vector<NodeType*> nodes;
+        nodes.reserve(values.size());
+        try {
+            for (T& value : values) {
+                nodes.push_back(create_node(
+                    &sentinel_node, &sentinel_node, &sentinel_node,
+                    std::move(value)
+                ));
+            }
+        } catch (...) {
+            for (NodeType* node : nodes) {
+                destroy_node(node);
+            }
+            throw;
+        }
+        return nodes;
+    }
+
+    // Writes the tree as an image, see mapped-tree.h, with shape_of(node)
+    // giving the metadata each record keeps
+    template <typename ShapeOf>
+    void save_image(const std::string& path, images::Kind kind,
+                    ShapeOf&& shape_of) const {
+        std::vector<images::Record<T>> records;
+        std::uint32_t root = emit_records(sentinel_node.parent, records, shape_of);
+        images::write(path, kind, root, records);
+    }
+
+    // Appends node's subtree in order and returns the index of its root
+    template <typename ShapeOf>
+    std::uint32_t emit_records(const BaseNode* node,
+                               std::vector<images::Record<T>>& records,
+                               ShapeOf& shape_of) const {
+        if (node == &sentinel_node) {
+            return images::nil;
+        }
+
+        std::uint32_t left = emit_records(node->left, records, shape_of);
+        if (records.size() >= images::nil) {
+            throw std::length_error("tree is too large for an image");
+        }
+        auto index = static_cast<std::uint32_t>(records.size());
+        records.push_back(images::Record<T>{
+            static_cast<std::uint64_t>(shape_of(node->as_derived())),
+            left, images::nil, node->as_derived()->value
+        });
+        records[index].right = emit_records(node->right, records, shape_of);
+        return index;
+    }
+
+    // Rebuilds the imaged tree node for node, set_shape(node, shape) putting
+    // back each record's metadata. Nothing is compared or rebalanced.
+    template <typename SetShape>
+    void assign_image(const MappedTree<T, Compare>& image, images::Kind kind,
+                      SetShape&& set_shape) {
+        if (!image.empty() && image.kind() != kind) {
+            throw std::invalid_argument("tree image is of another kind");
+        }
+
+        clear();
+        std::vector<NodeType*> nodes =
+            create_nodes(std::vector<T>(image.begin(), image.end()));
+        if (nodes.empty()) {
+            return;
+        }
+
+        auto link = [&](NodeType* parent, std::uint32_t child) -> BaseNode* {
+            if (child == images::nil) {
+                return &sentinel_node;
+            }
+            nodes[child]->parent = parent;
+            return nodes[child];
+        };
+        const images::Record<T>* records = image.record_data();
+        for (size_t i = 0; i < nodes.size(); i++) {
+            nodes[i]->left = link(nodes[i], records[i].left);
+            nodes[i]->right = link(nodes[i], records[i].right);
+            set_shape(nodes[i], records[i].shape);
+        }
+
+        BaseNode* root = nodes[image.root_index()];
+        sentinel_node.parent = root;
+        root->parent = &sentinel_node;
+        sentinel_node.left = nodes.front();
+        sentinel_node.right = nodes.back();
+        update_augment_subtree(root);
+    }
+
+    template <typename OnLink>
+    BaseNode* link_balanced(NodeType* const* nodes, size_t count,
+                            BaseNode* parent, OnLink& on_link) noexcept {
+        if (count == 0) {
+            return &sentinel_node;
+        }
+
+        size_t middle = count / 2;
+        BaseNode* root = nodes[middle];
+        root->parent = parent;
+        root->left = link_balanced(nodes, middle, root, on_link);
+        root->right = link_balanced(
+            nodes + middle + 1, count - middle - 1, root, on_link
+        );
+        update_augment(root);
+        on_link(root, count);
+        return root;
     }
 
     template <typename... Args>
@@ -328,6 +1569,7 @@ protected:
                           BaseNode* parent, Args&&... args) {
         NodeType* new_node =
             std::allocator_traits<node_allocator>::allocate(alloc, 1);
+        instrument.on_allocate();
         try {
             std::allocator_traits<node_allocator>::construct(
                 alloc, new_node,
@@ -337,11 +1579,80 @@ protected:
                 std::forward<Args>(args)...);
         } catch (...) {
             std::allocator_traits<node_allocator>::deallocate(alloc, new_node, 1);
+            instrument.on_deallocate();
             throw std::bad_alloc();
         }
         return new_node;
     }
 
+    // Copy-constructs src, metadata such as heights and priorities included,
+    // as a detached node
+    NodeType* clone_node(const NodeType& src) {
+        NodeType* new_node =
+            std::allocator_traits<node_allocator>::allocate(alloc, 1);
+        instrument.on_allocate();
+        try {
+            std::allocator_traits<node_allocator>::construct(
+                alloc, new_node, src);
+        } catch (...) {
+            std::allocator_traits<node_allocator>::deallocate(alloc, new_node, 1);
+            instrument.on_deallocate();
+            throw;
+        }
+        new_node->left = new_node->right = new_node->parent = &sentinel_node;
+        return new_node;
+    }
+
+    // Copies other's shape node by node in a single preorder walk, so the
+    // copy is allocated in the order searches visit it. Expects an empty tree.
+    void clone_from(const BinaryTree& other) {
+        comp = other.comp;
+        // link is null for the root, which hangs off the sentinel's parent
+        struct Pending {
+            const BaseNode* src;
+            BaseNode* parent;
+            BaseNode** link;
+        };
+
+        const BaseNode* other_sentinel = &other.sentinel_node;
+        std::vector<Pending> pending;
+        if (other.sentinel_node.parent != other_sentinel) {
+            pending.push_back({other.sentinel_node.parent, &sentinel_node, nullptr});
+        }
+
+        try {
+            while (!pending.empty()) {
+                auto [src, parent, link] = pending.back();
+                pending.pop_back();
+
+                NodeType* node = clone_node(*src->as_derived());
+                node->parent = parent;
+                if (link != nullptr) {
+                    *link = node;
+                } else {
+                    sentinel_node.parent = node;
+                }
+
+                if (src == other.sentinel_node.left) {
+                    sentinel_node.left = node;
+                }
+                if (src == other.sentinel_node.right) {
+                    sentinel_node.right = node;
+                }
+
+                if (src->right != other_sentinel) {
+                    pending.push_back({src->right, node, &node->right});
+                }
+                if (src->left != other_sentinel) {
+                    pending.push_back({src->left, node, &node->left});
+                }
+            }
+        } catch (...) {
+            clear();
+            throw;
+        }
+    }
+
     void destroy_node(NodeType* node) noexcept {
         try {
             std::allocator_traits<node_allocator>::destroy(alloc, node);
@@ -349,6 +1660,21 @@ protected:
             std::terminate();
         }
         std::allocator_traits<node_allocator>::deallocate(alloc, node, 1);
+        instrument.on_deallocate();
+    }
+
+    BaseNode* leftmost(BaseNode* node) const noexcept {
+        while (node->left != &sentinel_node) {
+            node = node->left;
+        }
+        return node;
+    }
+
+    BaseNode* rightmost(BaseNode* node) const noexcept {
+        while (node->right != &sentinel_node) {
+            node = node->right;
+        }
+        return node;
     }
 
     BaseNode* find_next(BaseNode* node) const noexcept {
@@ -369,11 +1695,144 @@ protected:
         }
     }
 
-    void clear() noexcept {
-        if (sentinel_node.parent != &sentinel_node) {
-            delete_subtree(sentinel_node.parent);
+    // Unlinking and linking for a plain search tree; balanced trees bring
+    // their own, restoring balance on the way
+    void detach_node(BaseNode* node) noexcept {
+        auto [child, child_parent] = unlink_node(node, [](BaseNode*) {});
+        update_augment_upward(child_parent);
+    }
+
+    std::pair<BaseNode*, bool> attach_node(NodeType* node) {
+        auto result = link_leaf(node);
+        if (result.second) {
+            update_augment_upward(node);
+        }
+        return result;
+    }
+
+    // detach(node) unlinks the node at position from the tree
+    template <typename Detach>
+    node_type extract_handle(const_iterator position, Detach&& detach) {
+        BaseNode* node = position.current;
+        if (node == &sentinel_node) {
+            return node_type();
+        }
+
+        detach(node);
+        return node_type(node->as_derived(), alloc);
+    }
+
+    // attach(node) links an unlinked node in as emplace would, returning
+    // the node or the equal element already present. Nodes from another
+    // allocator cannot be freed through this one, so their values move
+    // into new nodes instead.
+    template <typename Attach>
+    insert_return_type insert_handle(node_type&& handle, Attach&& attach) {
+        if (handle.empty()) {
+            return {end(), false, node_type()};
+        }
+
+        NodeType* node = handle.node;
+        if (*handle.alloc != alloc) {
+            auto [ptr, is_self] = find_helper(node->value);
+            if (is_self) {
+                return {iterator(ptr, *this), false, std::move(handle)};
+            }
+            node = create_node(&sentinel_node, &sentinel_node, &sentinel_node,
+                               std::move(node->value));
+            handle.reset();
+            return {iterator(attach(node).first, *this), true, node_type()};
+        }
+
+        node->left = node->right = node->parent = &sentinel_node;
+        auto [ptr, is_inserted] = attach(node);
+        if (!is_inserted) {
+            return {iterator(ptr, *this), false, std::move(handle)};
+        }
+        handle.release();
+        return {iterator(ptr, *this), true, node_type()};
+    }
+
+    // Moves every element of other that tree lacks over to tree, relinking
+    // the nodes when the allocators compare equal and copying otherwise
+    template <typename Tree>
+    static void merge_from(Tree& tree, Tree& other) {
+        // Trees may hide the helpers, so they are reached through the base
+        BinaryTree& target = tree;
+        if (&tree == &other) {
+            return;
+        }
+
+        bool is_relinking = target.alloc == static_cast<BinaryTree&>(other).alloc;
+        for (auto it = other.begin(); it != other.end();) {
+            auto current = it++;
+            if (target.find_helper(*current).second) {
+                continue;
+            }
+            if (is_relinking) {
+                tree.insert(other.extract(current));
+            } else {
+                tree.insert(*current);
+                other.erase(*current);
+            }
+        }
+    }
+
+    // Detaches node from the tree without touching any values. A node with
+    // two children is replaced by its successor, and on_replace(successor)
+    // runs once that successor has taken node's place so balance metadata
+    // can be carried over. Returns the child that moved up into the vacated
+    // position, possibly the sentinel, together with its new parent: the
+    // lowest node whose subtree lost an element. Augments are left stale.
+    template <typename OnReplace>
+    std::pair<BaseNode*, BaseNode*> unlink_node(BaseNode* node,
+                                                OnReplace&& on_replace) noexcept {
+        if (sentinel_node.left == node) {
+            sentinel_node.left = find_next(node);
+        }
+        if (sentinel_node.right == node) {
+            sentinel_node.right = (node->left != &sentinel_node)
+                ? rightmost(node->left) : node->parent;
+        }
+
+        if (node->left == &sentinel_node || node->right == &sentinel_node) {
+            BaseNode* child = (node->left != &sentinel_node)
+                ? node->left : node->right;
+            replace_child(node, child);
+            return {child, node->parent};
+        }
+
+        BaseNode* successor = leftmost(node->right);
+        BaseNode* child = successor->right;
+        BaseNode* child_parent = successor;
+        if (successor != node->right) {
+            child_parent = successor->parent;
+            child_parent->left = child;
+            if (child != &sentinel_node) {
+                child->parent = child_parent;
+            }
+            successor->right = node->right;
+            node->right->parent = successor;
+        }
+        successor->left = node->left;
+        node->left->parent = successor;
+        replace_child(node, successor);
+        on_replace(successor);
+        return {child, child_parent};
+    }
+
+    // Hangs replacement where node was, or makes it the root
+    void replace_child(BaseNode* node, BaseNode* replacement) noexcept {
+        if (node->parent == &sentinel_node) {
+            sentinel_node.parent = replacement;
+        } else if (node->parent->left == node) {
+            node->parent->left = replacement;
+        } else {
+            node->parent->right = replacement;
+        }
+        if (replacement != &sentinel_node) {
+            replacement->parent = node->parent;
         }
-        reset_sentinel();
     }
 
     void reset_sentinel() noexcept {
@@ -383,19 +1842,93 @@ protected:
     }
 
     void delete_subtree(BaseNode* node) noexcept {
-        std::queue<BaseNode*> nodes;
-        nodes.push(node);
+        for_each_node(node, [this](BaseNode* current) {
+            destroy_node(current->as_derived());
+        });
+    }
+
+    // Visits every node of the subtree; children are read before the
+    // visitor runs, so it may destroy the node it is given
+    template <typename Visitor>
+    void for_each_node(BaseNode* node, Visitor&& visit) noexcept {
+        std::vector<BaseNode*> nodes;
+        if (node != &sentinel_node) {
+            nodes.push_back(node);
+        }
 
         while (!nodes.empty()) {
-            BaseNode* current = nodes.front();
-            nodes.pop();
+            BaseNode* current = nodes.back();
+            nodes.pop_back();
 
-            if (current != &sentinel_node) {
-                nodes.push(current->left);
-                nodes.push(current->right);
-                destroy_node(current->as_derived());
+            if (current->left != &sentinel_node) {
+                nodes.push_back(current->left);
+            }
+            if (current->right != &sentinel_node) {
+                nodes.push_back(current->right);
+            }
+            visit(current);
+        }
+    }
+
+    // Takes over other's nodes and allocator. Leaves point at the owning
+    // tree's sentinel, so they have to be redirected to ours.
+    void steal(BinaryTree& other) noexcept {
+        comp = other.comp;
+        alloc = std::exchange(other.alloc, node_allocator());
+        BaseNode* root = other.sentinel_node.parent;
+        other.reset_sentinel();
+        adopt_subtree(root, &other.sentinel_node);
+    }
+
+    // Makes a detached subtree, whose leaves still point at old_sentinel,
+    // the whole contents of this tree. Expects an empty tree.
+    void adopt_subtree(BaseNode* root, const BaseNode* old_sentinel) noexcept {
+        if (root == old_sentinel) {
+            return;
+        }
+
+        relink_subtree(root, old_sentinel);
+        sentinel_node.parent = root;
+        root->parent = &sentinel_node;
+        sentinel_node.left = leftmost(root);
+        sentinel_node.right = rightmost(root);
+    }
+
+    // Points the leaf links of a non-empty detached subtree at this tree's
+    // sentinel and returns its node count. An in-order walk along parent
+    // links, so it needs no stack and cannot fail.
+    size_t relink_subtree(BaseNode* root, const BaseNode* old_sentinel) noexcept {
+        size_t count = 0;
+        BaseNode* current = root;
+        while (current->left != old_sentinel) {
+            current = current->left;
+        }
+
+        while (true) {
+            ++count;
+            if (current->left == old_sentinel) {
+                current->left = &sentinel_node;
+            }
+
+            if (current->right != old_sentinel) {
+                current = current->right;
+                while (current->left != old_sentinel) {
+                    current = current->left;
+                }
+                continue;
+            }
+
+            // Climb past the subtrees this walk has finished
+            current->right = &sentinel_node;
+            while (current != root && current->parent->right == current) {
+                current = current->parent;
+            }
+            if (current == root) {
+                break;
             }
+            current = current->parent;
         }
+        return count;
     }
 };
 
@@ -0,0 +1,827 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "frozen-tree.h"
+
+// B+-tree with the find/emplace/insert/erase/iterator surface of the binary
+// trees, so it can stand in for them behind a type alias. Nodes span four
+// cache lines; all values live in the leaves, which are linked for ordered
+// scans, and inner nodes only route searches. Keys are kept in plain arrays,
+// so T has to be default constructible.
+//
+// For arithmetic keys the unused slots of every key array hold the largest
+// value of T, infinity for floating point, which lets in-node searches scan
+// the whole fixed-size array without branches and, for int32_t, four keys
+// per SSE2 compare. Counts are clamped to the used slots as well, so they
+// stay in bounds whatever the key. NaN is not ordered against anything, so
+// as with std::set it must not be used as a key.
+template <
+    std::default_initializable T,
+    typename Allocator = std::allocator<T>
+> class BPlusTree {
+    static constexpr size_t cache_line = 64;
+    static constexpr size_t node_bytes = 4 * cache_line;
+
+    static constexpr bool is_padded = std::is_arithmetic_v<T>;
+
+    struct NodeBase {
+        std::uint32_t size = 0;
+        bool is_leaf;
+
+        explicit NodeBase(bool is_leaf) noexcept : is_leaf(is_leaf) {}
+    };
+
+    // A multiple of four keeps whole SSE2 registers inside the array
+    static constexpr size_t leaf_capacity = std::max<size_t>(
+        4, (node_bytes - sizeof(NodeBase) - sizeof(void*)) / sizeof(T) / 4 * 4
+    );
+    static constexpr size_t inner_capacity = std::max<size_t>(
+        4, (node_bytes - sizeof(NodeBase) - sizeof(void*))
+            / (sizeof(T) + sizeof(void*))
+    );
+
+    // Fewest keys a node other than the root may hold
+    static constexpr size_t min_leaf_size = leaf_capacity / 2;
+    static constexpr size_t min_inner_size = inner_capacity / 2;
+
+    // Unused key slots, see above
+    static T padding() noexcept {
+        if constexpr (std::numeric_limits<T>::has_infinity) {
+            return std::numeric_limits<T>::infinity();
+        } else {
+            return std::numeric_limits<T>::max();
+        }
+    }
+
+    template <size_t Capacity>
+    struct Keys {
+        std::array<T, Capacity> keys;
+
+        Keys() {
+            pad(0, Capacity);
+        }
+
+        void pad(size_t from, size_t to) noexcept {
+            if constexpr (is_padded) {
+                std::fill(keys.begin() + from, keys.begin() + to, padding());
+            }
+        }
+    };
+
+    struct alignas(cache_line) Leaf : NodeBase, Keys<leaf_capacity> {
+        Leaf* next = nullptr;
+
+        Leaf() : NodeBase(true) {}
+    };
+
+    struct alignas(cache_line) Inner : NodeBase, Keys<inner_capacity> {
+        // Child i holds the values in [keys[i - 1], keys[i])
+        std::array<NodeBase*, inner_capacity + 1> children{};
+
+        Inner() : NodeBase(false) {}
+    };
+
+    // Inner levels a tree can have. The root has at least two children and
+    // every other inner node at least min_inner_size + 1, so the number of
+    // leaves, which the element count bounds, grows geometrically with it.
+    static constexpr size_t max_height = [] {
+        size_t height = 1;
+        for (size_t leaves = 2;
+             leaves <= std::numeric_limits<size_t>::max() / (min_inner_size + 1);
+             leaves *= min_inner_size + 1) {
+            height++;
+        }
+        return height;
+    }();
+
+    // Inner nodes passed on the way down to a leaf and the child taken from
+    // each. The height is bounded, so it fits on the stack.
+    class Path {
+    public:
+        struct Step {
+            Inner* node;
+            size_t child;
+        };
+
+        void push(Inner* node, size_t child) noexcept {
+            steps[depth++] = Step{node, child};
+        }
+
+        Step pop() noexcept {
+            return steps[--depth];
+        }
+
+        [[nodiscard]] bool empty() const noexcept {
+            return depth == 0;
+        }
+
+    private:
+        std::array<Step, max_height> steps;
+        size_t depth = 0;
+    };
+
+    using leaf_allocator = typename
+        std::allocator_traits<Allocator>::template rebind_alloc<Leaf>;
+    using inner_allocator = typename
+        std::allocator_traits<Allocator>::template rebind_alloc<Inner>;
+
+    // Elements change only through the tree, like in std::set
+    class ConstIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = T;
+        using pointer = const T*;
+        using reference = const T&;
+
+        ConstIterator() = default;
+
+        ConstIterator(const Leaf* leaf, size_t index)
+                : leaf(leaf), index(index)
+        {}
+
+        bool operator==(const ConstIterator& other) const noexcept {
+            return leaf == other.leaf && index == other.index;
+        }
+
+        bool operator!=(const ConstIterator& other) const noexcept {
+            return !(*this == other);
+        }
+
+        ConstIterator operator++(int) {
+            auto temp = *this;
+            ++(*this);
+            return temp;
+        }
+
+        ConstIterator& operator++() {
+            if (++index == leaf->size) {
+                leaf = leaf->next;
+                index = 0;
+            }
+            return *this;
+        }
+
+        reference operator*() const {
+            return leaf->keys[index];
+        }
+
+        pointer operator->() const {
+            return &leaf->keys[index];
+        }
+
+    private:
+        const Leaf* leaf = nullptr;
+        size_t index = 0;
+    };
+
+public:
+    using iterator = ConstIterator;
+    using const_iterator = ConstIterator;
+
+    BPlusTree() = default;
+
+    template <std::input_iterator InputIt>
+    BPlusTree(InputIt first, InputIt last) {
+        assign(first, last);
+    }
+
+    BPlusTree(const BPlusTree& other)
+            : leaf_alloc(std::allocator_traits<leaf_allocator>::
+                  select_on_container_copy_construction(other.leaf_alloc))
+            , inner_alloc(std::allocator_traits<inner_allocator>::
+                  select_on_container_copy_construction(other.inner_alloc))
+    {
+        assign(other.begin(), other.end());
+    }
+
+    BPlusTree(BPlusTree&& other) noexcept
+            : leaf_alloc(std::move(other.leaf_alloc))
+            , inner_alloc(std::move(other.inner_alloc))
+    {
+        steal(other);
+    }
+
+    BPlusTree& operator=(const BPlusTree& other) {
+        if (this != &other) {
+            assign(other.begin(), other.end());
+        }
+        return *this;
+    }
+
+    BPlusTree& operator=(BPlusTree&& other) noexcept {
+        if (this != &other) {
+            clear();
+            leaf_alloc = std::move(other.leaf_alloc);
+            inner_alloc = std::move(other.inner_alloc);
+            steal(other);
+        }
+        return *this;
+    }
+
+    ~BPlusTree() {
+        clear();
+    }
+
+    // Basic functions
+    const_iterator find(const T& value) const noexcept {
+        if (root == nullptr) {
+            return end();
+        }
+
+        const Leaf* leaf = find_leaf(value);
+        size_t index = count_less(leaf->keys, leaf->size, value);
+        if (index < leaf->size && !(value < leaf->keys[index])) {
+            return const_iterator(leaf, index);
+        }
+        return end();
+    }
+
+    // First element not less than value
+    const_iterator lower_bound(const T& value) const noexcept {
+        if (root == nullptr) {
+            return end();
+        }
+
+        const Leaf* leaf = find_leaf(value);
+        return position(leaf, count_less(leaf->keys, leaf->size, value));
+    }
+
+    // First element greater than value
+    const_iterator upper_bound(const T& value) const noexcept {
+        if (root == nullptr) {
+            return end();
+        }
+
+        const Leaf* leaf = find_leaf(value);
+        return position(leaf,
+                        count_not_greater(leaf->keys, leaf->size, value));
+    }
+
+    std::pair<const_iterator, const_iterator> equal_range(const T& value) const noexcept {
+        return std::make_pair(lower_bound(value), upper_bound(value));
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        return count == 0;
+    }
+
+    [[nodiscard]] size_t size() const noexcept {
+        return count;
+    }
+
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args) {
+        return insert(T(std::forward<Args>(args)...));
+    }
+
+    std::pair<iterator, bool> insert(const T& value) {
+        return insert(T(value));
+    }
+
+    // Splits full nodes on the way back up; a split root grows the tree by
+    // one level
+    std::pair<iterator, bool> insert(T&& value) {
+        if (root == nullptr) {
+            Leaf* leaf = create_leaf();
+            root = head = leaf;
+        }
+
+        Path path;
+        Leaf* leaf = find_leaf(value, path);
+        size_t index = count_less(leaf->keys, leaf->size, value);
+        if (index < leaf->size && !(value < leaf->keys[index])) {
+            return std::make_pair(iterator(leaf, index), false);
+        }
+
+        if (leaf->size < leaf_capacity) {
+            insert_key(*leaf, index, std::move(value));
+            ++count;
+            return std::make_pair(iterator(leaf, index), true);
+        }
+
+        Leaf* right = create_leaf();
+        size_t half = (leaf_capacity + 1) / 2;
+        move_keys(*leaf, half, leaf->size, *right, 0);
+        right->size = leaf->size - half;
+        leaf->size = half;
+        leaf->pad(half, leaf_capacity);
+        right->next = leaf->next;
+        leaf->next = right;
+
+        Leaf* target = leaf;
+        if (index > half) {
+            target = right;
+            index -= half;
+        }
+        insert_key(*target, index, std::move(value));
+        ++count;
+
+        insert_into_parent(path, leaf, T(right->keys[0]), right);
+        return std::make_pair(iterator(target, index), true);
+    }
+
+    // Replaces the contents with [first, last) in O(n) for sorted input,
+    // O(n log n) otherwise; duplicates are dropped. Nodes come out evenly
+    // filled, each as full as the count allows.
+    template <std::input_iterator InputIt>
+    void assign(InputIt first, InputIt last) {
+        std::vector<T> values(first, last);
+        if (!std::is_sorted(values.begin(), values.end())) {
+            std::sort(values.begin(), values.end());
+        }
+        values.erase(std::unique(values.begin(), values.end(),
+                [](const T& lhs, const T& rhs) { return !(lhs < rhs); }),
+            values.end());
+
+        clear();
+        if (values.empty()) {
+            return;
+        }
+
+        // Each level is a list of nodes with the smallest value below them
+        std::vector<std::pair<NodeBase*, const T*>> level;
+        size_t leaves = (values.size() + leaf_capacity - 1) / leaf_capacity;
+        Leaf* previous = nullptr;
+        for (size_t i = 0, taken = 0; i < leaves; i++) {
+            size_t take = (values.size() - taken) / (leaves - i);
+            Leaf* leaf = create_leaf();
+            std::move(values.begin() + taken, values.begin() + taken + take,
+                      leaf->keys.begin());
+            leaf->size = take;
+            count += take;
+            taken += take;
+
+            if (previous != nullptr) {
+                previous->next = leaf;
+            } else {
+                head = leaf;
+            }
+            previous = leaf;
+            level.emplace_back(leaf, &leaf->keys[0]);
+        }
+
+        while (level.size() > 1) {
+            std::vector<std::pair<NodeBase*, const T*>> parents;
+            size_t fanout = inner_capacity + 1;
+            size_t nodes = (level.size() + fanout - 1) / fanout;
+            for (size_t i = 0, taken = 0; i < nodes; i++) {
+                size_t take = (level.size() - taken) / (nodes - i);
+                Inner* inner = create_inner();
+                for (size_t j = 0; j < take; j++) {
+                    inner->children[j] = level[taken + j].first;
+                    if (j > 0) {
+                        inner->keys[j - 1] = *level[taken + j].second;
+                    }
+                }
+                inner->size = take - 1;
+                parents.emplace_back(inner, level[taken].second);
+                taken += take;
+            }
+            level = std::move(parents);
+        }
+        root = level.front().first;
+    }
+
+    // Refills an underfull node from a sibling when it has keys to spare and
+    // merges the two otherwise, which may leave the parent underfull in turn
+    bool erase(const T& value) {
+        if (root == nullptr) {
+            return false;
+        }
+
+        Path path;
+        Leaf* leaf = find_leaf(value, path);
+        size_t index = count_less(leaf->keys, leaf->size, value);
+        if (index == leaf->size || value < leaf->keys[index]) {
+            return false;
+        }
+
+        erase_key(*leaf, index);
+        --count;
+
+        if (path.empty()) {
+            if (leaf->size == 0) {
+                destroy_leaf(leaf);
+                root = head = nullptr;
+            }
+            return true;
+        }
+        if (leaf->size >= min_leaf_size) {
+            return true;
+        }
+
+        auto [parent, child] = path.pop();
+        rebalance_leaf(*parent, child);
+
+        Inner* node = parent;
+        while (!path.empty() && node->size < min_inner_size) {
+            auto [grandparent, position] = path.pop();
+            rebalance_inner(*grandparent, position);
+            node = grandparent;
+        }
+
+        if (!root->is_leaf && root->size == 0) {
+            Inner* top = static_cast<Inner*>(root);
+            root = top->children[0];
+            destroy_inner(top);
+        }
+        return true;
+    }
+
+    void clear() noexcept {
+        if (root == nullptr) {
+            return;
+        }
+
+        destroy_subtree(root);
+        root = nullptr;
+        head = nullptr;
+        count = 0;
+    }
+
+    // Read-only copy laid out for fast lookups, see frozen-tree.h
+    FrozenTree<T> freeze() const {
+        return FrozenTree<T>(begin(), end());
+    }
+
+    // Iterators
+    const_iterator begin() const noexcept {
+        return const_iterator(head, 0);
+    }
+
+    const_iterator end() const noexcept {
+        return const_iterator(nullptr, 0);
+    }
+
+private:
+    [[no_unique_address]] leaf_allocator leaf_alloc;
+    [[no_unique_address]] inner_allocator inner_alloc;
+    NodeBase* root = nullptr;
+    // Leftmost leaf, where ordered scans start
+    Leaf* head = nullptr;
+    size_t count = 0;
+
+    // Number of keys among the first size that are less than value. Padded
+    // arrays are scanned whole, and the clamp keeps any padding that does
+    // compare less out of the count.
+    template <size_t Capacity>
+    static size_t count_less(const std::array<T, Capacity>& keys, size_t size,
+                             const T& value) noexcept {
+        if constexpr (is_padded) {
+            return std::min(scan_less(keys.data(), Capacity, value), size);
+        } else {
+            return std::lower_bound(keys.begin(), keys.begin() + size, value)
+                - keys.begin();
+        }
+    }
+
+    // Number of keys among the first size that are not greater than value.
+    // Padding compares equal to the largest value, hence the clamp.
+    template <size_t Capacity>
+    static size_t count_not_greater(const std::array<T, Capacity>& keys,
+                                    size_t size, const T& value) noexcept {
+        if constexpr (is_padded) {
+            size_t result = 0;
+            for (size_t i = 0; i < Capacity; i++) {
+                result += !(value < keys[i]);
+            }
+            return std::min(result, size);
+        } else {
+            return std::upper_bound(keys.begin(), keys.begin() + size, value)
+                - keys.begin();
+        }
+    }
+
+    static size_t scan_less(const T* keys, size_t capacity,
+                            const T& value) noexcept {
+#if defined(__SSE2__)
+        if constexpr (std::is_same_v<T, std::int32_t>) {
+            if (capacity % 4 == 0) {
+                __m128i key = _mm_set1_epi32(value);
+                size_t result = 0;
+                for (size_t i = 0; i < capacity; i += 4) {
+                    __m128i block = _mm_loadu_si128(
+                        reinterpret_cast<const __m128i*>(keys + i));
+                    result += std::popcount(static_cast<unsigned>(
+                        _mm_movemask_ps(_mm_castsi128_ps(
+                            _mm_cmplt_epi32(block, key)))));
+                }
+                return result;
+            }
+        }
+#endif
+        size_t result = 0;
+        for (size_t i = 0; i < capacity; i++) {
+            result += keys[i] < value;
+        }
+        return result;
+    }
+
+    const_iterator position(const Leaf* leaf, size_t index) const noexcept {
+        if (index == leaf->size) {
+            return const_iterator(leaf->next, 0);
+        }
+        return const_iterator(leaf, index);
+    }
+
+    // Child of inner to descend into for value
+    static size_t route(const Inner& inner, const T& value) noexcept {
+        return count_not_greater(inner.keys, inner.size, value);
+    }
+
+    const Leaf* find_leaf(const T& value) const noexcept {
+        const NodeBase* node = root;
+        while (!node->is_leaf) {
+            const Inner* inner = static_cast<const Inner*>(node);
+            node = inner->children[route(*inner, value)];
+        }
+        return static_cast<const Leaf*>(node);
+    }
+
+    // Also records every inner node passed and the child taken from it
+    Leaf* find_leaf(const T& value, Path& path) {
+        NodeBase* node = root;
+        while (!node->is_leaf) {
+            Inner* inner = static_cast<Inner*>(node);
+            size_t child = route(*inner, value);
+            path.push(inner, child);
+            node = inner->children[child];
+        }
+        return static_cast<Leaf*>(node);
+    }
+
+    // Hangs right, whose smallest value is separator, next to left, splitting
+    // ancestors that are full
+    void insert_into_parent(Path& path, NodeBase* left, T&& separator,
+                            NodeBase* right) {
+        while (!path.empty()) {
+            auto [parent, child] = path.pop();
+
+            if (parent->size < inner_capacity) {
+                insert_child(*parent, child, std::move(separator), right);
+                return;
+            }
+
+            // Split around the middle key, which moves up instead of staying
+            Inner* sibling = create_inner();
+            separator = insert_child_overflowing(*parent, *sibling, child,
+                                                 std::move(separator), right);
+            left = parent;
+            right = sibling;
+        }
+
+        Inner* new_root = create_inner();
+        new_root->keys[0] = std::move(separator);
+        new_root->children[0] = left;
+        new_root->children[1] = right;
+        new_root->size = 1;
+        root = new_root;
+    }
+
+    // Inserts key and child right of position child into a full node,
+    // leaving the upper half in sibling. Returns the middle key, which
+    // belongs in the parent. Works in place: the upper half and the middle
+    // key are read as if key and right were already inserted, before the
+    // lower half makes room for them.
+    T insert_child_overflowing(Inner& node, Inner& sibling, size_t child,
+                               T&& key, NodeBase* right) {
+        auto key_at = [&](size_t i) -> T& {
+            return i < child ? node.keys[i] : i == child ? key : node.keys[i - 1];
+        };
+        auto child_at = [&](size_t i) {
+            return i <= child ? node.children[i]
+                : i == child + 1 ? right : node.children[i - 1];
+        };
+
+        size_t total = node.size + 1;
+        size_t middle = total / 2;
+        for (size_t i = middle + 1; i < total; i++) {
+            sibling.keys[i - middle - 1] = std::move(key_at(i));
+        }
+        for (size_t i = middle + 1; i <= total; i++) {
+            sibling.children[i - middle - 1] = child_at(i);
+        }
+        sibling.size = total - middle - 1;
+        T separator = std::move(key_at(middle));
+
+        if (child < middle) {
+            std::move_backward(node.keys.begin() + child,
+                               node.keys.begin() + middle - 1,
+                               node.keys.begin() + middle);
+            node.keys[child] = std::move(key);
+            std::copy_backward(node.children.begin() + child + 1,
+                               node.children.begin() + middle,
+                               node.children.begin() + middle + 1);
+            node.children[child + 1] = right;
+        }
+        node.size = middle;
+        node.pad(middle, inner_capacity);
+        return separator;
+    }
+
+    void rebalance_leaf(Inner& parent, size_t child) {
+        Leaf& leaf = *static_cast<Leaf*>(parent.children[child]);
+        Leaf* left = child > 0
+            ? static_cast<Leaf*>(parent.children[child - 1]) : nullptr;
+        Leaf* right = child < parent.size
+            ? static_cast<Leaf*>(parent.children[child + 1]) : nullptr;
+
+        if (left != nullptr && left->size > min_leaf_size) {
+            insert_key(leaf, 0, std::move(left->keys[left->size - 1]));
+            erase_key(*left, left->size - 1);
+            parent.keys[child - 1] = leaf.keys[0];
+        } else if (right != nullptr && right->size > min_leaf_size) {
+            insert_key(leaf, leaf.size, std::move(right->keys[0]));
+            erase_key(*right, 0);
+            parent.keys[child] = right->keys[0];
+        } else if (left != nullptr) {
+            merge_leaves(parent, child - 1);
+        } else {
+            merge_leaves(parent, child);
+        }
+    }
+
+    // Moves the leaf right of position into the one at position
+    void merge_leaves(Inner& parent, size_t position) {
+        Leaf& left = *static_cast<Leaf*>(parent.children[position]);
+        Leaf* right = static_cast<Leaf*>(parent.children[position + 1]);
+
+        move_keys(*right, 0, right->size, left, left.size);
+        left.size += right->size;
+        left.next = right->next;
+
+        erase_child(parent, position);
+        destroy_leaf(right);
+    }
+
+    void rebalance_inner(Inner& parent, size_t child) {
+        Inner& node = *static_cast<Inner*>(parent.children[child]);
+        Inner* left = child > 0
+            ? static_cast<Inner*>(parent.children[child - 1]) : nullptr;
+        Inner* right = child < parent.size
+            ? static_cast<Inner*>(parent.children[child + 1]) : nullptr;
+
+        if (left != nullptr && left->size > min_inner_size) {
+            // The separator comes down, left's last key goes up
+            std::move_backward(node.keys.begin(), node.keys.begin() + node.size,
+                               node.keys.begin() + node.size + 1);
+            std::copy_backward(node.children.begin(),
+                               node.children.begin() + node.size + 1,
+                               node.children.begin() + node.size + 2);
+            node.keys[0] = std::move(parent.keys[child - 1]);
+            node.children[0] = left->children[left->size];
+            ++node.size;
+
+            parent.keys[child - 1] = std::move(left->keys[left->size - 1]);
+            --left->size;
+            left->pad(left->size, left->size + 1);
+        } else if (right != nullptr && right->size > min_inner_size) {
+            node.keys[node.size] = std::move(parent.keys[child]);
+            node.children[node.size + 1] = right->children[0];
+            ++node.size;
+
+            parent.keys[child] = std::move(right->keys[0]);
+            std::move(right->keys.begin() + 1, right->keys.begin() + right->size,
+                      right->keys.begin());
+            std::copy(right->children.begin() + 1,
+                      right->children.begin() + right->size + 1,
+                      right->children.begin());
+            --right->size;
+            right->pad(right->size, right->size + 1);
+        } else if (left != nullptr) {
+            merge_inner(parent, child - 1);
+        } else {
+            merge_inner(parent, child);
+        }
+    }
+
+    // Pulls the separator down between the keys of the two nodes
+    void merge_inner(Inner& parent, size_t position) {
+        Inner& left = *static_cast<Inner*>(parent.children[position]);
+        Inner* right = static_cast<Inner*>(parent.children[position + 1]);
+
+        left.keys[left.size] = std::move(parent.keys[position]);
+        std::move(right->keys.begin(), right->keys.begin() + right->size,
+                  left.keys.begin() + left.size + 1);
+        std::copy(right->children.begin(), right->children.begin() + right->size + 1,
+                  left.children.begin() + left.size + 1);
+        left.size += right->size + 1;
+
+        erase_child(parent, position);
+        destroy_inner(right);
+    }
+
+    template <typename Node>
+    static void insert_key(Node& node, size_t index, T&& value) {
+        std::move_backward(node.keys.begin() + index,
+                           node.keys.begin() + node.size,
+                           node.keys.begin() + node.size + 1);
+        node.keys[index] = std::move(value);
+        ++node.size;
+    }
+
+    template <typename Node>
+    static void erase_key(Node& node, size_t index) {
+        std::move(node.keys.begin() + index + 1, node.keys.begin() + node.size,
+                  node.keys.begin() + index);
+        --node.size;
+        node.pad(node.size, node.size + 1);
+    }
+
+    static void move_keys(Leaf& from, size_t first, size_t last,
+                          Leaf& to, size_t index) {
+        std::move(from.keys.begin() + first, from.keys.begin() + last,
+                  to.keys.begin() + index);
+        from.pad(first, last);
+    }
+
+    // Inserts key with child right after position child
+    static void insert_child(Inner& node, size_t child, T&& key, NodeBase* right) {
+        insert_key(node, child, std::move(key));
+        std::copy_backward(node.children.begin() + child + 1,
+                           node.children.begin() + node.size,
+                           node.children.begin() + node.size + 1);
+        node.children[child + 1] = right;
+    }
+
+    // Drops the key at position and the child right of it
+    static void erase_child(Inner& node, size_t position) {
+        std::copy(node.children.begin() + position + 2,
+                  node.children.begin() + node.size + 1,
+                  node.children.begin() + position + 1);
+        erase_key(node, position);
+    }
+
+    Leaf* create_leaf() {
+        using traits = std::allocator_traits<leaf_allocator>;
+        Leaf* leaf = traits::allocate(leaf_alloc, 1);
+        try {
+            traits::construct(leaf_alloc, leaf);
+        } catch (...) {
+            traits::deallocate(leaf_alloc, leaf, 1);
+            throw;
+        }
+        return leaf;
+    }
+
+    Inner* create_inner() {
+        using traits = std::allocator_traits<inner_allocator>;
+        Inner* inner = traits::allocate(inner_alloc, 1);
+        try {
+            traits::construct(inner_alloc, inner);
+        } catch (...) {
+            traits::deallocate(inner_alloc, inner, 1);
+            throw;
+        }
+        return inner;
+    }
+
+    // Recurses at most max_height levels deep
+    void destroy_subtree(NodeBase* node) noexcept {
+        if (node->is_leaf) {
+            destroy_leaf(static_cast<Leaf*>(node));
+            return;
+        }
+
+        Inner* inner = static_cast<Inner*>(node);
+        for (size_t i = 0; i <= inner->size; i++) {
+            destroy_subtree(inner->children[i]);
+        }
+        destroy_inner(inner);
+    }
+
+    void destroy_leaf(Leaf* leaf) noexcept {
+        using traits = std::allocator_traits<leaf_allocator>;
+        traits::destroy(leaf_alloc, leaf);
+        traits::deallocate(leaf_alloc, leaf, 1);
+    }
+
+    void destroy_inner(Inner* inner) noexcept {
+        using traits = std::allocator_traits<inner_allocator>;
+        traits::destroy(inner_alloc, inner);
+        traits::deallocate(inner_alloc, inner, 1);
+    }
+
+    void steal(BPlusTree& other) noexcept {
+        root = std::exchange(other.root, nullptr);
+        head = std::exchange(other.head, nullptr);
+        count = std::exchange(other.count, 0);
+    }
+};
@@ -0,0 +1,778 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "binary-tree.h"
+#include "frozen-tree.h"
+
+// Treap whose nodes live in one contiguous array and link to each other by
+// 32-bit indices, with a 32-bit priority. For int keys a node takes 20 bytes
+// instead of the 40 of a TreapNode. Freed slots are reused through a
+// freelist; the array grows by doubling and keeps its capacity on clear().
+// Iterators hold an index, so unlike pointers they survive the array moving.
+// Compare orders the keys as in BinaryTree, transparent ones included.
+template <
+    typename T,
+    typename Allocator = std::allocator<T>,
+    typename Compare = std::less<T>
+> class CompactTreap {
+public:
+    using index_type = std::uint32_t;
+
+private:
+    static constexpr index_type nil = std::numeric_limits<index_type>::max();
+    // Parent link of a slot on the freelist, which chains through left
+    static constexpr index_type vacant = nil - 1;
+    static constexpr size_t max_capacity = vacant;
+
+    struct Node {
+        index_type left;
+        index_type right;
+        index_type parent;
+        std::uint32_t priority;
+        alignas(T) std::byte storage[sizeof(T)];
+
+        T* value_ptr() noexcept {
+            return std::launder(reinterpret_cast<T*>(storage));
+        }
+
+        const T* value_ptr() const noexcept {
+            return std::launder(reinterpret_cast<const T*>(storage));
+        }
+
+        T& value() noexcept {
+            return *value_ptr();
+        }
+
+        const T& value() const noexcept {
+            return *value_ptr();
+        }
+
+        bool is_live() const noexcept {
+            return parent != vacant;
+        }
+    };
+
+    using node_allocator = typename
+        std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+    using node_traits = std::allocator_traits<node_allocator>;
+
+    static constexpr bool is_transparent =
+        requires { typename Compare::is_transparent; };
+
+    // Whether searching for a Key first builds a T, which may throw
+    template <typename Key>
+    static constexpr bool converts_key =
+        !is_transparent && !std::is_same_v<Key, T>;
+
+    // Per thread, so trees on different threads share no state
+    inline static thread_local std::mt19937 rng{
+        static_cast<unsigned>(
+            std::chrono::steady_clock::now().time_since_epoch().count()
+        )
+    };
+
+    template <bool IsConst>
+    class BaseIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = T;
+        using pointer = std::conditional_t<IsConst, const T*, T*>;
+        using reference = std::conditional_t<IsConst, const T&, T&>;
+
+        BaseIterator() = default;
+
+        BaseIterator(index_type index, const CompactTreap& tree)
+                : tree(&tree), current(index)
+        {}
+
+        bool operator==(const BaseIterator& other) const noexcept {
+            return current == other.current;
+        }
+
+        bool operator!=(const BaseIterator& other) const noexcept {
+            return current != other.current;
+        }
+
+        BaseIterator operator++(int) {
+            auto temp = *this;
+            ++(*this);
+            return temp;
+        }
+
+        BaseIterator& operator++() {
+            current = tree->find_next(current);
+            return *this;
+        }
+
+        reference operator*() const {
+            return tree->slots[current].value();
+        }
+
+        pointer operator->() const {
+            return tree->slots[current].value_ptr();
+        }
+
+    private:
+        const CompactTreap* tree = nullptr;
+        index_type current = nil;
+    };
+
+public:
+    using iterator = BaseIterator<false>;
+    using const_iterator = BaseIterator<true>;
+
+    CompactTreap() = default;
+
+    explicit CompactTreap(const Compare& comp)
+            : comp(comp)
+    {}
+
+    template <std::input_iterator InputIt>
+    CompactTreap(InputIt first, InputIt last) {
+        assign(first, last);
+    }
+
+    CompactTreap(const CompactTreap& other)
+            : alloc(node_traits::select_on_container_copy_construction(
+                  other.alloc))
+            , comp(other.comp)
+    {
+        copy_slots(other);
+    }
+
+    CompactTreap(CompactTreap&& other) noexcept
+            : alloc(std::move(other.alloc))
+            , comp(other.comp)
+    {
+        take_slots(other);
+    }
+
+    CompactTreap& operator=(const CompactTreap& other) {
+        if (this != &other) {
+            CompactTreap copy(other);
+            release();
+            alloc = copy.alloc;
+            comp = copy.comp;
+            take_slots(copy);
+        }
+        return *this;
+    }
+
+    CompactTreap& operator=(CompactTreap&& other) noexcept {
+        if (this != &other) {
+            release();
+            alloc = std::move(other.alloc);
+            comp = other.comp;
+            take_slots(other);
+        }
+        return *this;
+    }
+
+    ~CompactTreap() {
+        release();
+    }
+
+    // Basic functions. Lookups take a T or, with a transparent Compare, any
+    // key it orders against T, as in BinaryTree.
+    template <LookupKey<T, Compare> Key = T>
+    iterator find(const Key& key) {
+        return iterator(find_index(lookup_key(key)), *this);
+    }
+
+    template <LookupKey<T, Compare> Key = T>
+    const_iterator find(const Key& key) const {
+        return const_iterator(find_index(lookup_key(key)), *this);
+    }
+
+    // First element not less than key
+    template <LookupKey<T, Compare> Key = T>
+    iterator lower_bound(const Key& key) {
+        return iterator(lower_bound_index(lookup_key(key)), *this);
+    }
+
+    template <LookupKey<T, Compare> Key = T>
+    const_iterator lower_bound(const Key& key) const {
+        return const_iterator(lower_bound_index(lookup_key(key)), *this);
+    }
+
+    // First element greater than key
+    template <LookupKey<T, Compare> Key = T>
+    iterator upper_bound(const Key& key) {
+        return iterator(upper_bound_index(lookup_key(key)), *this);
+    }
+
+    template <LookupKey<T, Compare> Key = T>
+    const_iterator upper_bound(const Key& key) const {
+        return const_iterator(upper_bound_index(lookup_key(key)), *this);
+    }
+
+    template <LookupKey<T, Compare> Key = T>
+    std::pair<iterator, iterator> equal_range(const Key& key) {
+        decltype(auto) probe = lookup_key(key);
+        return std::make_pair(lower_bound(probe), upper_bound(probe));
+    }
+
+    template <LookupKey<T, Compare> Key = T>
+    std::pair<const_iterator, const_iterator> equal_range(const Key& key) const {
+        decltype(auto) probe = lookup_key(key);
+        return std::make_pair(lower_bound(probe), upper_bound(probe));
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        return root == nil;
+    }
+
+    [[nodiscard]] size_t size() const noexcept {
+        return count;
+    }
+
+    Compare key_comp() const {
+        return comp;
+    }
+
+    // Grows the node array to hold at least n nodes without reallocating
+    void reserve(size_t n) {
+        if (n > max_capacity) {
+            throw std::length_error("CompactTreap is out of 32-bit indices");
+        }
+        if (n > capacity) {
+            grow(n);
+        }
+    }
+
+    // Builds the T on the stack rather than in a slot, so a duplicate takes
+    // no slot; see try_emplace
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args) {
+        if constexpr (sizeof...(Args) == 1
+                          && (std::is_same_v<std::remove_cvref_t<Args>, T>
+                              && ...)) {
+            return try_emplace(args..., std::forward<Args>(args)...);
+        } else {
+            T value(std::forward<Args>(args)...);
+            return try_emplace(value, std::move(value));
+        }
+    }
+
+    // Searches for key first: only if it is missing is a node made from
+    // args, or from key without args, hung as a leaf where the search ended
+    // and rotated up by priority. The min and max links follow the leaf, so
+    // no spine is walked. The T made must be equivalent to key.
+    template <LookupKey<T, Compare> Key = T, typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args) {
+        decltype(auto) probe = lookup_key(key);
+        index_type parent = nil;
+        bool is_left = false;
+        for (index_type current = root; current != nil;) {
+            auto order = compare(probe, slots[current].value());
+            parent = current;
+            if (order > 0) {
+                is_left = false;
+                current = slots[current].right;
+            } else if (order < 0) {
+                is_left = true;
+                current = slots[current].left;
+            } else {
+                return std::make_pair(iterator(current, *this), false);
+            }
+        }
+
+        // key is not stored here, so growing the array cannot move it
+        index_type node;
+        if constexpr (sizeof...(Args) == 0) {
+            node = create_node(key);
+        } else {
+            node = create_node(std::forward<Args>(args)...);
+        }
+        link_leaf(node, parent, is_left);
+        return std::make_pair(iterator(node, *this), true);
+    }
+
+    std::pair<iterator, bool> insert(const T& value) {
+        return try_emplace(value);
+    }
+
+    std::pair<iterator, bool> insert(T&& value) {
+        return try_emplace(value, std::move(value));
+    }
+
+    // Builds the treap over the sorted, deduplicated input in O(n) after
+    // sorting, the same way Treap::assign does
+    template <std::input_iterator InputIt>
+    void assign(InputIt first, InputIt last) {
+        std::vector<T> values(first, last);
+        if (!std::is_sorted(values.begin(), values.end(), comp)) {
+            std::sort(values.begin(), values.end(), comp);
+        }
+        values.erase(std::unique(values.begin(), values.end(),
+                [this](const T& lhs, const T& rhs) { return !comp(lhs, rhs); }),
+            values.end());
+
+        clear();
+        reserve(values.size());
+
+        // The stack holds the right spine of the tree built so far
+        std::vector<index_type> spine;
+        for (T& value : values) {
+            index_type node = create_node(std::move(value));
+            index_type last_popped = nil;
+            while (!spine.empty()
+                    && slots[spine.back()].priority < slots[node].priority) {
+                last_popped = spine.back();
+                spine.pop_back();
+            }
+
+            slots[node].left = last_popped;
+            if (last_popped != nil) {
+                slots[last_popped].parent = node;
+            }
+            if (!spine.empty()) {
+                slots[spine.back()].right = node;
+                slots[node].parent = spine.back();
+            }
+            spine.push_back(node);
+        }
+
+        if (!spine.empty()) {
+            set_root(spine.front());
+            update_bounds();
+        }
+    }
+
+    template <LookupKey<T, Compare> Key = T>
+    bool erase(const Key& key) {
+        index_type node = find_index(lookup_key(key));
+        if (node == nil) {
+            return false;
+        }
+
+        // The min has no left child, so its successor is the leftmost node
+        // on its right or else its parent; the max mirrors that
+        if (node == min_node) {
+            min_node = (slots[node].right != nil)
+                ? leftmost(slots[node].right) : slots[node].parent;
+        }
+        if (node == max_node) {
+            max_node = (slots[node].left != nil)
+                ? rightmost(slots[node].left) : slots[node].parent;
+        }
+
+        index_type parent = slots[node].parent;
+        index_type subtree = merge(slots[node].left, slots[node].right);
+        if (parent == nil) {
+            set_root(subtree);
+        } else {
+            if (slots[parent].left == node) {
+                slots[parent].left = subtree;
+            } else {
+                slots[parent].right = subtree;
+            }
+            if (subtree != nil) {
+                slots[subtree].parent = parent;
+            }
+        }
+
+        destroy_node(node);
+        return true;
+    }
+
+    // Read-only copy laid out for fast lookups, see frozen-tree.h
+    FrozenTree<T, Compare> freeze() const {
+        return FrozenTree<T, Compare>(begin(), end(), comp);
+    }
+
+    // Destroys every element but keeps the node array
+    void clear() noexcept {
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            for (index_type i = 0; i < used; i++) {
+                if (slots[i].is_live()) {
+                    std::destroy_at(slots[i].value_ptr());
+                }
+            }
+        }
+        used = 0;
+        free_head = nil;
+        count = 0;
+        root = min_node = max_node = nil;
+    }
+
+    // Iterators
+    iterator begin() noexcept {
+        return iterator(min_node, *this);
+    }
+
+    iterator end() noexcept {
+        return iterator(nil, *this);
+    }
+
+    const_iterator begin() const noexcept {
+        return const_iterator(min_node, *this);
+    }
+
+    const_iterator end() const noexcept {
+        return const_iterator(nil, *this);
+    }
+
+private:
+    [[no_unique_address]] node_allocator alloc;
+    [[no_unique_address]] Compare comp;
+    Node* slots = nullptr;
+    size_t capacity = 0;
+    // Slots past used have never been handed out
+    index_type used = 0;
+    index_type free_head = nil;
+    size_t count = 0;
+
+    index_type root = nil;
+    index_type min_node = nil;
+    index_type max_node = nil;
+
+    // What searches compare against: key itself when Compare takes it,
+    // otherwise a T made from it once up front rather than once per level
+    template <typename Key>
+    decltype(auto) lookup_key(const Key& key) const {
+        if constexpr (!converts_key<Key>) {
+            return (key);
+        } else {
+            return T(key);
+        }
+    }
+
+    // Orders lhs against rhs in one three-way comparison where Compare
+    // allows it, like BinaryTree::compare
+    template <typename Lhs, typename Rhs>
+    std::weak_ordering compare(const Lhs& lhs, const Rhs& rhs) const {
+        if constexpr (requires { comp.three_way(lhs, rhs); }) {
+            return comp.three_way(lhs, rhs);
+        } else if constexpr ((std::is_same_v<Compare, std::less<T>>
+                          || std::is_same_v<Compare, std::less<>>)
+                      && std::three_way_comparable_with<Lhs, Rhs,
+                                                        std::weak_ordering>) {
+            return lhs <=> rhs;
+        } else {
+            if (comp(lhs, rhs)) {
+                return std::weak_ordering::less;
+            }
+            return comp(rhs, lhs) ? std::weak_ordering::greater
+                                  : std::weak_ordering::equivalent;
+        }
+    }
+
+    template <typename Key>
+    index_type find_index(const Key& key) const {
+        index_type current = root;
+        while (current != nil) {
+            auto order = compare(key, slots[current].value());
+            if (order > 0) {
+                current = slots[current].right;
+            } else if (order < 0) {
+                current = slots[current].left;
+            } else {
+                return current;
+            }
+        }
+        return nil;
+    }
+
+    template <typename Key>
+    index_type lower_bound_index(const Key& key) const {
+        index_type current = root;
+        index_type result = nil;
+        while (current != nil) {
+            if (comp(slots[current].value(), key)) {
+                current = slots[current].right;
+            } else {
+                result = current;
+                current = slots[current].left;
+            }
+        }
+        return result;
+    }
+
+    template <typename Key>
+    index_type upper_bound_index(const Key& key) const {
+        index_type current = root;
+        index_type result = nil;
+        while (current != nil) {
+            if (comp(key, slots[current].value())) {
+                result = current;
+                current = slots[current].left;
+            } else {
+                current = slots[current].right;
+            }
+        }
+        return result;
+    }
+
+    index_type find_next(index_type node) const noexcept {
+        if (slots[node].right != nil) {
+            return leftmost(slots[node].right);
+        }
+
+        index_type parent = slots[node].parent;
+        while (parent != nil && node == slots[parent].right) {
+            node = parent;
+            parent = slots[parent].parent;
+        }
+        return parent;
+    }
+
+    index_type leftmost(index_type node) const noexcept {
+        while (slots[node].left != nil) {
+            node = slots[node].left;
+        }
+        return node;
+    }
+
+    index_type rightmost(index_type node) const noexcept {
+        while (slots[node].right != nil) {
+            node = slots[node].right;
+        }
+        return node;
+    }
+
+    void update_bounds() noexcept {
+        min_node = (root != nil) ? leftmost(root) : nil;
+        max_node = (root != nil) ? rightmost(root) : nil;
+    }
+
+    // Hangs a detached node below parent, nil for an empty treap, and
+    // rotates it up past parents of lower priority
+    void link_leaf(index_type node, index_type parent, bool is_left) noexcept {
+        slots[node].parent = parent;
+        if (parent == nil) {
+            root = min_node = max_node = node;
+            return;
+        }
+
+        if (is_left) {
+            slots[parent].left = node;
+            if (parent == min_node) {
+                min_node = node;
+            }
+        } else {
+            slots[parent].right = node;
+            if (parent == max_node) {
+                max_node = node;
+            }
+        }
+
+        while (slots[node].parent != nil
+                && slots[slots[node].parent].priority < slots[node].priority) {
+            rotate_up(node);
+        }
+    }
+
+    // Swaps node with its parent, which becomes its child on the other side
+    void rotate_up(index_type node) noexcept {
+        index_type parent = slots[node].parent;
+        index_type grandparent = slots[parent].parent;
+
+        if (slots[parent].left == node) {
+            slots[parent].left = slots[node].right;
+            if (slots[node].right != nil) {
+                slots[slots[node].right].parent = parent;
+            }
+            slots[node].right = parent;
+        } else {
+            slots[parent].right = slots[node].left;
+            if (slots[node].left != nil) {
+                slots[slots[node].left].parent = parent;
+            }
+            slots[node].left = parent;
+        }
+
+        slots[parent].parent = node;
+        slots[node].parent = grandparent;
+        if (grandparent == nil) {
+            root = node;
+        } else if (slots[grandparent].left == parent) {
+            slots[grandparent].left = node;
+        } else {
+            slots[grandparent].right = node;
+        }
+    }
+
+    void set_root(index_type node) noexcept {
+        root = node;
+        if (node != nil) {
+            slots[node].parent = nil;
+        }
+    }
+
+    index_type merge(index_type lhs, index_type rhs) {
+        if (lhs == nil) {
+            return rhs;
+        } else if (rhs == nil) {
+            return lhs;
+        } else if (slots[lhs].priority > slots[rhs].priority) {
+            index_type right = merge(slots[lhs].right, rhs);
+            slots[lhs].right = right;
+            slots[right].parent = lhs;
+            return lhs;
+        } else {
+            index_type left = merge(lhs, slots[rhs].left);
+            slots[rhs].left = left;
+            slots[left].parent = rhs;
+            return rhs;
+        }
+    }
+
+    // Returns a detached node holding T(args...)
+    template <typename... Args>
+    index_type create_node(Args&&... args) {
+        index_type index;
+        if (free_head != nil) {
+            index = free_head;
+        } else {
+            if (used == capacity) {
+                grow(capacity * 2);
+            }
+            index = used;
+        }
+
+        Node& node = slots[index];
+        std::construct_at(reinterpret_cast<T*>(node.storage),
+                          std::forward<Args>(args)...);
+        if (index == free_head) {
+            free_head = node.left;
+        } else {
+            ++used;
+        }
+
+        node.left = node.right = node.parent = nil;
+        node.priority = static_cast<std::uint32_t>(rng());
+        ++count;
+        return index;
+    }
+
+    void destroy_node(index_type index) noexcept {
+        Node& node = slots[index];
+        std::destroy_at(node.value_ptr());
+        node.parent = vacant;
+        node.left = free_head;
+        free_head = index;
+        --count;
+    }
+
+    // Moves every slot handed out so far into a new array of new_capacity
+    void grow(size_t new_capacity) {
+        new_capacity = std::min(std::max<size_t>(new_capacity, 16), max_capacity);
+        if (new_capacity <= capacity) {
+            throw std::length_error("CompactTreap is out of 32-bit indices");
+        }
+
+        Node* fresh = node_traits::allocate(alloc, new_capacity);
+        index_type moved = 0;
+        try {
+            for (; moved < used; moved++) {
+                relocate(slots[moved], fresh[moved]);
+            }
+        } catch (...) {
+            destroy_values(fresh, moved);
+            node_traits::deallocate(alloc, fresh, new_capacity);
+            throw;
+        }
+
+        destroy_values(slots, used);
+        if (slots != nullptr) {
+            node_traits::deallocate(alloc, slots, capacity);
+        }
+        slots = fresh;
+        capacity = new_capacity;
+    }
+
+    static void relocate(Node& src, Node& dst) {
+        Node* node = std::construct_at(&dst);
+        node->left = src.left;
+        node->right = src.right;
+        node->parent = src.parent;
+        node->priority = src.priority;
+        if (src.is_live()) {
+            std::construct_at(reinterpret_cast<T*>(node->storage),
+                              std::move_if_noexcept(src.value()));
+        }
+    }
+
+    static void destroy_values(Node* nodes, index_type n) noexcept {
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            for (index_type i = 0; i < n; i++) {
+                if (nodes[i].is_live()) {
+                    std::destroy_at(nodes[i].value_ptr());
+                }
+            }
+        }
+    }
+
+    // Copies other's slots index for index, so the links stay valid
+    void copy_slots(const CompactTreap& other) {
+        if (other.used == 0) {
+            return;
+        }
+
+        Node* fresh = node_traits::allocate(alloc, other.used);
+        index_type copied = 0;
+        try {
+            for (; copied < other.used; copied++) {
+                const Node& src = other.slots[copied];
+                Node* node = std::construct_at(&fresh[copied]);
+                node->left = src.left;
+                node->right = src.right;
+                node->parent = src.parent;
+                node->priority = src.priority;
+                if (src.is_live()) {
+                    std::construct_at(reinterpret_cast<T*>(node->storage),
+                                      src.value());
+                }
+            }
+        } catch (...) {
+            destroy_values(fresh, copied);
+            node_traits::deallocate(alloc, fresh, other.used);
+            throw;
+        }
+
+        slots = fresh;
+        capacity = used = other.used;
+        free_head = other.free_head;
+        count = other.count;
+        root = other.root;
+        min_node = other.min_node;
+        max_node = other.max_node;
+    }
+
+    void take_slots(CompactTreap& other) noexcept {
+        slots = std::exchange(other.slots, nullptr);
+        capacity = std::exchange(other.capacity, 0);
+        used = std::exchange(other.used, 0);
+        free_head = std::exchange(other.free_head, nil);
+        count = std::exchange(other.count, 0);
+        root = std::exchange(other.root, nil);
+        min_node = std::exchange(other.min_node, nil);
+        max_node = std::exchange(other.max_node, nil);
+    }
+
+    void release() noexcept {
+        clear();
+        if (slots != nullptr) {
+            node_traits::deallocate(alloc, slots, capacity);
+        }
+        slots = nullptr;
+        capacity = 0;
+    }
+};
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "persistent-treap.h"
+
+// Set that any number of threads may use at once. Keys are partitioned by
+// range over S shards, split at fixed boundaries; each shard publishes its
+// contents as an immutable PersistentTreap version behind a
+// std::atomic<std::shared_ptr>.
+//
+// Readers take no shard lock: they load the current version and search it
+// as it is, and the version stays alive, and unchanged, for as long as
+// they hold it. The load itself is not lock-free everywhere; libstdc++
+// guards the shared_ptr with a short internal spin lock, held only while
+// the reference count is taken. Writers lock only their key's shard,
+// derive the next version by path copying and publish it, so writers on
+// different shards never wait for each other.
+//
+// Shards keep the order: finding a key's shard is a binary search over the
+// boundaries, and point operations then touch that shard alone, in
+// O(log S + log n). lower_bound and upper_bound read the key's shard and
+// move on only past shards with nothing above the key, so in a populated
+// set they read one shard and answer from a single version. to_vector
+// concatenates the shards in O(n), each read at its own moment, so it is
+// consistent per shard but not atomic across them.
+//
+// Writers contend only within a shard, so the boundaries should split the
+// keys actually used into parts of similar traffic, e.g. at quantiles of a
+// sample. Keys are ordered by <, like PersistentTreap.
+template <
+    typename T,
+    typename Allocator = std::allocator<T>
+> class ConcurrentSet {
+    using version = PersistentTreap<T, Allocator>;
+
+    // Own cache lines, so writers on neighbouring shards do not contend
+    struct alignas(64) Shard {
+        std::mutex write_lock;
+        std::atomic<std::shared_ptr<const version>> current{
+            std::make_shared<const version>()
+        };
+    };
+
+    // Several shards per core keep writers from colliding
+    static size_t default_shard_count() noexcept {
+        return 4 * std::max(1u, std::thread::hardware_concurrency());
+    }
+
+public:
+    // One shard holding every key, so writers take turns
+    ConcurrentSet() : shards(1) {}
+
+    // Shard i holds the keys in [boundaries[i - 1], boundaries[i]), the
+    // first and last shards everything below and above. Boundaries may come
+    // in any order; repeated ones are dropped.
+    explicit ConcurrentSet(std::vector<T> boundaries)
+            : boundaries(sorted(std::move(boundaries)))
+            , shards(this->boundaries.size() + 1)
+    {}
+
+    // Splits [lowest, highest] into shard_count ranges of equal width. Keys
+    // outside it are still fine, in the first and last shards.
+    explicit ConcurrentSet(T lowest, T highest,
+                           size_t shard_count = default_shard_count())
+        requires std::is_arithmetic_v<T>
+            : ConcurrentSet(even_boundaries(lowest, highest, shard_count))
+    {}
+
+    ConcurrentSet(const ConcurrentSet&) = delete;
+    ConcurrentSet& operator=(const ConcurrentSet&) = delete;
+
+    // Basic functions
+    bool contains(const T& value) const {
+        return shards[shard_index(value)].current.load(std::memory_order_acquire)
+            ->contains(value);
+    }
+
+    // Smallest element not less than value
+    std::optional<T> lower_bound(const T& value) const {
+        return first_from(value, [&](const version& tree) {
+            return tree.lower_bound(value);
+        });
+    }
+
+    // Smallest element greater than value
+    std::optional<T> upper_bound(const T& value) const {
+        return first_from(value, [&](const version& tree) {
+            return tree.upper_bound(value);
+        });
+    }
+
+    bool insert(const T& value) {
+        return update(value, false, [&](version& tree) {
+            tree.insert(value);
+        });
+    }
+
+    bool erase(const T& value) {
+        return update(value, true, [&](version& tree) {
+            tree.erase(value);
+        });
+    }
+
+    // Concurrent writers can make the count stale as soon as it returns
+    [[nodiscard]] size_t size() const {
+        size_t result = 0;
+        for (const Shard& shard : shards) {
+            result += shard.current.load(std::memory_order_acquire)->size();
+        }
+        return result;
+    }
+
+    [[nodiscard]] bool empty() const {
+        return size() == 0;
+    }
+
+    void clear() {
+        for (Shard& shard : shards) {
+            std::lock_guard lock(shard.write_lock);
+            shard.current.store(std::make_shared<const version>(),
+                                std::memory_order_release);
+        }
+    }
+
+    // Sorted elements, each shard read at its own moment
+    std::vector<T> to_vector() const {
+        std::vector<T> result;
+        for (const Shard& shard : shards) {
+            auto tree = shard.current.load(std::memory_order_acquire);
+            result.insert(result.end(), tree->begin(), tree->end());
+        }
+        return result;
+    }
+
+    [[nodiscard]] size_t shard_count() const noexcept {
+        return shards.size();
+    }
+
+private:
+    // Sorted and distinct; fixed for the set's lifetime, so reading them
+    // needs no synchronization
+    std::vector<T> boundaries;
+    std::vector<Shard> shards;
+
+    static std::vector<T> sorted(std::vector<T> values) {
+        std::sort(values.begin(), values.end());
+        values.erase(std::unique(values.begin(), values.end(),
+                [](const T& lhs, const T& rhs) { return !(lhs < rhs); }),
+            values.end());
+        return values;
+    }
+
+    static std::vector<T> even_boundaries(T lowest, T highest, size_t shard_count) {
+        if (highest < lowest) {
+            std::swap(lowest, highest);
+        }
+        // In long double, so the width of a 64-bit range cannot overflow;
+        // rounding only shifts boundaries a little, and the constructor
+        // drops any that end up equal
+        long double width = static_cast<long double>(highest) - lowest;
+        std::vector<T> result;
+        for (size_t i = 1; i < shard_count; i++) {
+            result.push_back(static_cast<T>(lowest + width * i / shard_count));
+        }
+        return result;
+    }
+
+    size_t shard_index(const T& value) const {
+        return std::upper_bound(boundaries.begin(), boundaries.end(), value)
+            - boundaries.begin();
+    }
+
+    // If value is in the shard exactly when is_present says, applies change
+    // to a copy of the current version and publishes the copy. The copy
+    // shares all nodes, so only the ones change rebuilds are new.
+    template <typename Change>
+    bool update(const T& value, bool is_present, Change&& change) {
+        Shard& shard = shards[shard_index(value)];
+        std::lock_guard lock(shard.write_lock);
+
+        auto current = shard.current.load(std::memory_order_relaxed);
+        if (current->contains(value) != is_present) {
+            return false;
+        }
+
+        auto next = std::make_shared<version>(*current);
+        change(*next);
+        shard.current.store(std::move(next), std::memory_order_release);
+        return true;
+    }
+
+    // First element bound picks from value's shard or, when that one has
+    // none, from the next shard that has any. Every element of a later
+    // shard is above value, so its smallest one is the answer.
+    template <typename Bound>
+    std::optional<T> first_from(const T& value, Bound&& bound) const {
+        size_t index = shard_index(value);
+        auto tree = shards[index].current.load(std::memory_order_acquire);
+        auto it = bound(*tree);
+        if (it != tree->end()) {
+            return *it;
+        }
+        while (++index < shards.size()) {
+            tree = shards[index].current.load(std::memory_order_acquire);
+            if (tree->begin() != tree->end()) {
+                return *tree->begin();
+            }
+        }
+        return std::nullopt;
+    }
+};
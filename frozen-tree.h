@@ -0,0 +1,294 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Immutable sorted set in Eytzinger order: the implicit complete binary tree
+// where node k has children 2k and 2k + 1, stored breadth first from index 1.
+// A search touches one array instead of chasing pointers, descends without
+// branching and prefetches the cache line holding its descendants four
+// levels down. The array is aligned to a cache line, so for arithmetic keys
+// the top levels share the first line and are compared in one block.
+template <typename T, typename Compare = std::less<T>>
+class FrozenTree {
+    static constexpr size_t cache_line = 64;
+    static constexpr size_t alignment = std::max(cache_line, alignof(T));
+
+    // The 2^j descendants j levels below k sit at [k * 2^j, (k + 1) * 2^j),
+    // so a stride of one cache line worth of elements reaches a whole line
+    static constexpr size_t prefetch_stride =
+        std::max<size_t>(2, std::bit_floor(cache_line / sizeof(T)));
+
+    // Slots [1, top_size) of the first cache line hold the top levels. The
+    // block compare stands in for operator<, so it needs the default order.
+    static constexpr bool has_top_block = std::is_arithmetic_v<T>
+        && (std::is_same_v<Compare, std::less<T>>
+            || std::is_same_v<Compare, std::less<>>)
+        && cache_line % sizeof(T) == 0 && cache_line / sizeof(T) >= 4;
+    static constexpr size_t top_size = cache_line / sizeof(T);
+    static constexpr int top_levels = std::countr_zero(top_size);
+
+    struct Deleter {
+        size_t count;
+
+        void operator()(T* data) const noexcept {
+            if constexpr (!std::is_trivially_destructible_v<T>) {
+                std::destroy(data + 1, data + count + 1);
+            }
+            ::operator delete(data, std::align_val_t{alignment});
+        }
+    };
+
+    class ConstIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = T;
+        using pointer = const T*;
+        using reference = const T&;
+
+        ConstIterator() = default;
+
+        ConstIterator(size_t index, const FrozenTree& tree)
+                : tree(&tree), current(index)
+        {}
+
+        bool operator==(const ConstIterator& other) const noexcept {
+            return current == other.current;
+        }
+
+        bool operator!=(const ConstIterator& other) const noexcept {
+            return current != other.current;
+        }
+
+        ConstIterator operator++(int) {
+            auto temp = *this;
+            ++(*this);
+            return temp;
+        }
+
+        ConstIterator& operator++() {
+            current = tree->find_next(current);
+            return *this;
+        }
+
+        reference operator*() const {
+            return tree->data[current];
+        }
+
+        pointer operator->() const {
+            return &tree->data[current];
+        }
+
+    private:
+        const FrozenTree* tree = nullptr;
+        size_t current = 0;
+    };
+
+public:
+    // Elements cannot change, so both iterate read-only
+    using iterator = ConstIterator;
+    using const_iterator = ConstIterator;
+
+    FrozenTree() = default;
+
+    // Expects values strictly increasing under comp, e.g. a tree's own
+    // begin() and end()
+    template <std::forward_iterator ForwardIt>
+    FrozenTree(ForwardIt first, ForwardIt last, const Compare& comp = Compare())
+            : count(static_cast<size_t>(std::distance(first, last)))
+            , comp(comp)
+    {
+        if (count == 0) {
+            return;
+        }
+
+        // Index 0 only keeps node k at offset k. It is zeroed for the top
+        // block compare, which loads the whole first line, and never
+        // constructed otherwise.
+        T* raw = static_cast<T*>(::operator new(
+            (count + 1) * sizeof(T), std::align_val_t{alignment}
+        ));
+        if constexpr (has_top_block) {
+            raw[0] = T{};
+        }
+
+        // Placing values in order along the in-order walk of the implicit
+        // tree lays them out breadth first
+        size_t index = leftmost(1);
+        size_t constructed = 0;
+        try {
+            for (; first != last; ++first, ++constructed) {
+                std::construct_at(raw + index, *first);
+                index = find_next(index);
+            }
+        } catch (...) {
+            for (size_t k = leftmost(1); constructed > 0; constructed--) {
+                std::destroy_at(raw + k);
+                k = find_next(k);
+            }
+            ::operator delete(raw, std::align_val_t{alignment});
+            throw;
+        }
+        data = std::unique_ptr<T[], Deleter>(raw, Deleter{count});
+    }
+
+    FrozenTree(FrozenTree&& other) noexcept
+            : data(std::move(other.data))
+            , count(std::exchange(other.count, 0))
+            , comp(other.comp)
+    {}
+
+    FrozenTree& operator=(FrozenTree&& other) noexcept {
+        data = std::move(other.data);
+        count = std::exchange(other.count, 0);
+        comp = other.comp;
+        return *this;
+    }
+
+    const_iterator find(const T& value) const noexcept {
+        size_t index = lower_bound_index(value);
+        if (index != 0 && !comp(value, data[index])) {
+            return const_iterator(index, *this);
+        }
+        return end();
+    }
+
+    // First element not less than value
+    const_iterator lower_bound(const T& value) const noexcept {
+        return const_iterator(lower_bound_index(value), *this);
+    }
+
+    // First element greater than value
+    const_iterator upper_bound(const T& value) const noexcept {
+        size_t k = 1;
+        while (k <= count) {
+            prefetch(k * prefetch_stride);
+            k = 2 * k + !comp(value, data[k]);
+        }
+        return const_iterator(k >> (std::countr_one(k) + 1), *this);
+    }
+
+    std::pair<const_iterator, const_iterator> equal_range(const T& value) const noexcept {
+        return std::make_pair(lower_bound(value), upper_bound(value));
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        return count == 0;
+    }
+
+    [[nodiscard]] size_t size() const noexcept {
+        return count;
+    }
+
+    const_iterator begin() const noexcept {
+        return const_iterator(count != 0 ? leftmost(1) : 0, *this);
+    }
+
+    const_iterator end() const noexcept {
+        return const_iterator(0, *this);
+    }
+
+private:
+    std::unique_ptr<T[], Deleter> data{nullptr, Deleter{0}};
+    size_t count = 0;
+    [[no_unique_address]] Compare comp;
+
+    // Index of the first element not less than value, 0 if there is none.
+    // Going right appends a 1 bit to k, so once k falls off the tree the
+    // answer is the last node the path went left at: k with its trailing
+    // ones and one more bit shifted out.
+    size_t lower_bound_index(const T& value) const noexcept {
+        size_t k = 1;
+        if constexpr (has_top_block) {
+            if (count >= top_size - 1) {
+                k = descend_top_block(value);
+            }
+        }
+
+        while (k <= count) {
+            prefetch(k * prefetch_stride);
+            k = 2 * k + comp(data[k], value);
+        }
+        return k >> (std::countr_one(k) + 1);
+    }
+
+    // Compares value with every node of the first cache line at once, then
+    // walks the top levels through the resulting mask without touching
+    // memory
+    size_t descend_top_block(const T& value) const noexcept {
+        std::uint64_t mask = top_block_mask(value);
+        size_t k = 1;
+        for (int level = 0; level < top_levels; level++) {
+            k = 2 * k + ((mask >> k) & 1);
+        }
+        return k;
+    }
+
+    // Bit i is set when the i-th slot of the first line is less than value
+    std::uint64_t top_block_mask(const T& value) const noexcept {
+        const T* top = std::assume_aligned<cache_line>(data.get());
+#if defined(__SSE2__)
+        if constexpr (std::is_same_v<T, std::int32_t> || std::is_same_v<T, float>) {
+            std::uint64_t mask = 0;
+            for (size_t i = 0; i < top_size / 4; i++) {
+                __m128 less;
+                if constexpr (std::is_same_v<T, float>) {
+                    less = _mm_cmplt_ps(_mm_load_ps(top + 4 * i),
+                                        _mm_set1_ps(value));
+                } else {
+                    less = _mm_castsi128_ps(_mm_cmplt_epi32(
+                        _mm_load_si128(reinterpret_cast<const __m128i*>(top) + i),
+                        _mm_set1_epi32(value)
+                    ));
+                }
+                mask |= std::uint64_t(_mm_movemask_ps(less)) << (4 * i);
+            }
+            return mask;
+        }
+#endif
+        std::uint64_t mask = 0;
+        for (size_t i = 1; i < top_size; i++) {
+            mask |= std::uint64_t{top[i] < value} << i;
+        }
+        return mask;
+    }
+
+    // Hints at the element at index without dereferencing it, so running
+    // past the end of the array is harmless
+    void prefetch([[maybe_unused]] size_t index) const noexcept {
+#if defined(__GNUC__)
+        __builtin_prefetch(reinterpret_cast<const void*>(
+            reinterpret_cast<std::uintptr_t>(data.get()) + index * sizeof(T)
+        ));
+#endif
+    }
+
+    size_t leftmost(size_t k) const noexcept {
+        while (2 * k <= count) {
+            k *= 2;
+        }
+        return k;
+    }
+
+    // In-order successor: the leftmost node of the right subtree if there
+    // is one, otherwise the first ancestor reached from a left child
+    size_t find_next(size_t k) const noexcept {
+        if (2 * k + 1 <= count) {
+            return leftmost(2 * k + 1);
+        }
+        return k >> (std::countr_one(k) + 1);
+    }
+};
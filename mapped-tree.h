@@ -0,0 +1,335 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// On-disk tree snapshots. An image is a header followed by one record per
+// node in sorted order; children are named by record index, so the image
+// reads the same wherever it is mapped. Each record keeps the node's shape
+// metadata (an AVL height or a treap priority), which lets a tree be
+// rebuilt from an image without comparing or rebalancing anything.
+//
+// Records hold values byte for byte, so T has to be trivially copyable, and
+// images only load on machines with the same endianness and value layout.
+namespace images {
+
+enum class Kind : std::uint32_t {
+    avl = 1,
+    treap = 2,
+};
+
+inline constexpr char magic[8] = {'B', 'T', 'R', 'E', 'E', 'I', 'M', 'G'};
+inline constexpr std::uint32_t version = 1;
+inline constexpr std::uint32_t byte_order = 0x01020304;
+inline constexpr std::uint32_t nil = 0xffffffff;
+
+struct alignas(64) Header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    Kind kind;
+    std::uint32_t record_size;
+    std::uint32_t value_size;
+    std::uint64_t count;
+    std::uint32_t root;
+};
+
+template <typename T>
+struct Record {
+    std::uint64_t shape;
+    std::uint32_t left;
+    std::uint32_t right;
+    T value;
+};
+
+// Copies the fields one by one into zeroed bytes, so the padding between
+// them goes to disk as zeros rather than as whatever memory held
+template <typename T>
+void write_fields(std::ofstream& out, const Record<T>& record) {
+    char bytes[sizeof(Record<T>)] = {};
+    auto copy = [&](const auto& field) {
+        auto offset = reinterpret_cast<const char*>(&field)
+            - reinterpret_cast<const char*>(&record);
+        std::memcpy(bytes + offset, &field, sizeof(field));
+    };
+    copy(record.shape);
+    copy(record.left);
+    copy(record.right);
+    copy(record.value);
+    out.write(bytes, sizeof(bytes));
+}
+
+// Writes the header and records next to path, then renames the result over
+// path, so processes mapping the old image keep reading it undisturbed
+template <typename T>
+void write(const std::string& path, Kind kind, std::uint32_t root,
+           const std::vector<Record<T>>& records) {
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "images store values byte for byte");
+
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.byte_order = byte_order;
+    header.kind = kind;
+    header.record_size = sizeof(Record<T>);
+    header.value_size = sizeof(T);
+    header.count = records.size();
+    header.root = root;
+
+    std::string temporary = path + ".tmp";
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const Record<T>& record : records) {
+        write_fields(out, record);
+    }
+    out.close();
+    if (!out || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        throw std::runtime_error("cannot write tree image " + path);
+    }
+}
+
+} // namespace images
+
+// Read-only tree served straight from a mapped image: opening one costs a
+// header check, and pages are read in as lookups reach them. Searches follow
+// the saved shape; records are in sorted order, so iteration walks the
+// array. Images must come from save(): child indices are not validated.
+// Compare has to be the order the saving tree used.
+template <typename T, typename Compare = std::less<T>>
+class MappedTree {
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "images store values byte for byte");
+
+    using Record = images::Record<T>;
+
+    class ConstIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = T;
+        using pointer = const T*;
+        using reference = const T&;
+
+        ConstIterator() = default;
+
+        explicit ConstIterator(const Record* record)
+                : record(record)
+        {}
+
+        bool operator==(const ConstIterator& other) const noexcept {
+            return record == other.record;
+        }
+
+        bool operator!=(const ConstIterator& other) const noexcept {
+            return record != other.record;
+        }
+
+        ConstIterator operator++(int) {
+            auto temp = *this;
+            ++(*this);
+            return temp;
+        }
+
+        ConstIterator& operator++() {
+            ++record;
+            return *this;
+        }
+
+        reference operator*() const {
+            return record->value;
+        }
+
+        pointer operator->() const {
+            return &record->value;
+        }
+
+    private:
+        const Record* record = nullptr;
+    };
+
+public:
+    // Elements live in a read-only mapping, so both iterate read-only
+    using iterator = ConstIterator;
+    using const_iterator = ConstIterator;
+
+    MappedTree() = default;
+
+    // Throws std::runtime_error if path cannot be mapped or does not hold
+    // an image of kind for T
+    MappedTree(const std::string& path, images::Kind kind,
+               const Compare& comp = Compare())
+            : comp(comp)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("cannot open tree image " + path);
+        }
+
+        struct stat status;
+        if (::fstat(fd, &status) != 0
+                || static_cast<size_t>(status.st_size) < sizeof(images::Header)) {
+            ::close(fd);
+            throw std::runtime_error("truncated tree image " + path);
+        }
+        length = static_cast<size_t>(status.st_size);
+
+        void* address = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (address == MAP_FAILED) {
+            throw std::runtime_error("cannot map tree image " + path);
+        }
+        mapping = address;
+
+        const auto* header = static_cast<const images::Header*>(mapping);
+        if (std::memcmp(header->magic, images::magic, sizeof(images::magic)) != 0
+                || header->version != images::version
+                || header->byte_order != images::byte_order
+                || header->kind != kind
+                || header->record_size != sizeof(Record)
+                || header->value_size != sizeof(T)
+                || header->count > (length - sizeof(images::Header)) / sizeof(Record)
+                || (header->root == images::nil) != (header->count == 0)
+                || (header->count != 0 && header->root >= header->count)) {
+            unmap();
+            throw std::runtime_error("incompatible tree image " + path);
+        }
+
+        records = reinterpret_cast<const Record*>(header + 1);
+        count = header->count;
+        root = header->root;
+        image_kind = kind;
+    }
+
+    MappedTree(MappedTree&& other) noexcept
+            : mapping(std::exchange(other.mapping, nullptr))
+            , length(std::exchange(other.length, 0))
+            , records(std::exchange(other.records, nullptr))
+            , count(std::exchange(other.count, 0))
+            , root(std::exchange(other.root, images::nil))
+            , image_kind(other.image_kind)
+            , comp(other.comp)
+    {}
+
+    MappedTree& operator=(MappedTree&& other) noexcept {
+        if (this != &other) {
+            unmap();
+            mapping = std::exchange(other.mapping, nullptr);
+            length = std::exchange(other.length, 0);
+            records = std::exchange(other.records, nullptr);
+            count = std::exchange(other.count, 0);
+            root = std::exchange(other.root, images::nil);
+            image_kind = other.image_kind;
+            comp = other.comp;
+        }
+        return *this;
+    }
+
+    ~MappedTree() {
+        unmap();
+    }
+
+    // Basic functions
+    const_iterator find(const T& value) const noexcept {
+        const_iterator it = lower_bound(value);
+        if (it != end() && !comp(value, *it)) {
+            return it;
+        }
+        return end();
+    }
+
+    // First element not less than value
+    const_iterator lower_bound(const T& value) const noexcept {
+        size_t result = count;
+        for (std::uint32_t index = root; index != images::nil;) {
+            if (comp(records[index].value, value)) {
+                index = records[index].right;
+            } else {
+                result = index;
+                index = records[index].left;
+            }
+        }
+        return const_iterator(records + result);
+    }
+
+    // First element greater than value
+    const_iterator upper_bound(const T& value) const noexcept {
+        size_t result = count;
+        for (std::uint32_t index = root; index != images::nil;) {
+            if (comp(value, records[index].value)) {
+                result = index;
+                index = records[index].left;
+            } else {
+                index = records[index].right;
+            }
+        }
+        return const_iterator(records + result);
+    }
+
+    std::pair<const_iterator, const_iterator> equal_range(const T& value) const noexcept {
+        return std::make_pair(lower_bound(value), upper_bound(value));
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        return count == 0;
+    }
+
+    [[nodiscard]] size_t size() const noexcept {
+        return count;
+    }
+
+    // Iterators
+    const_iterator begin() const noexcept {
+        return const_iterator(records);
+    }
+
+    const_iterator end() const noexcept {
+        return const_iterator(records + count);
+    }
+
+    // Raw records, for trees rebuilding themselves from the image
+    const Record* record_data() const noexcept {
+        return records;
+    }
+
+    std::uint32_t root_index() const noexcept {
+        return root;
+    }
+
+    images::Kind kind() const noexcept {
+        return image_kind;
+    }
+
+private:
+    void* mapping = nullptr;
+    size_t length = 0;
+    const Record* records = nullptr;
+    size_t count = 0;
+    std::uint32_t root = images::nil;
+    images::Kind image_kind{};
+    [[no_unique_address]] Compare comp;
+
+    void unmap() noexcept {
+        if (mapping != nullptr) {
+            ::munmap(mapping, length);
+            mapping = nullptr;
+        }
+    }
+};
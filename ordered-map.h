@@ -0,0 +1,473 @@
+#pragma once
+
+#include <compare>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "avl-tree.h"
+#include "treap.h"
+
+// Where a map keeps its values
+namespace payloads {
+
+// In the node, next to the key
+struct in_node {};
+
+// In a separate allocation the node points to. Searches then bring only
+// keys and links into cache, however large the values are; reaching a
+// value costs one more pointer hop. Values come from operator new, the
+// Allocator only places nodes, and nodes only pack densely if it keeps them
+// apart from the values, as PoolAllocator does.
+struct out_of_line {};
+
+} // namespace payloads
+
+namespace maps {
+
+// What the tree underneath a map stores: a key and its value or a pointer
+// to it. The tree orders entries by key alone, see EntryCompare.
+template <typename Key, typename Value, typename Payload>
+struct Entry {
+    Key key;
+    Value value;
+
+    template <typename K, typename... Args>
+            requires std::constructible_from<Key, K&&>
+    explicit Entry(K&& key, Args&&... args)
+            : key(std::forward<K>(key)), value(std::forward<Args>(args)...)
+    {}
+
+    Value& payload() noexcept {
+        return value;
+    }
+
+    const Value& payload() const noexcept {
+        return value;
+    }
+};
+
+// Copies copy the value too, so maps copy as they would with in_node.
+// A moved-from entry holds no value and may only be destroyed.
+template <typename Key, typename Value>
+struct Entry<Key, Value, payloads::out_of_line> {
+    Key key;
+    std::unique_ptr<Value> value;
+
+    template <typename K, typename... Args>
+            requires std::constructible_from<Key, K&&>
+    explicit Entry(K&& key, Args&&... args)
+            : key(std::forward<K>(key))
+            , value(std::make_unique<Value>(std::forward<Args>(args)...))
+    {}
+
+    Entry(const Entry& other)
+            : key(other.key), value(std::make_unique<Value>(*other.value))
+    {}
+
+    Entry(Entry&&) noexcept = default;
+
+    Entry& operator=(const Entry& other) {
+        if (this != &other) {
+            key = other.key;
+            value = std::make_unique<Value>(*other.value);
+        }
+        return *this;
+    }
+
+    Entry& operator=(Entry&&) noexcept = default;
+
+    Value& payload() noexcept {
+        return *value;
+    }
+
+    const Value& payload() const noexcept {
+        return *value;
+    }
+};
+
+// Orders entries, and keys against entries, by key. It is transparent, so
+// the tree searches with the key as given; keys other than Key are only
+// accepted if Compare is transparent as well. Under std::less it also
+// offers the tree one three-way comparison per node, see
+// BinaryTree::compare.
+template <typename Key, typename Entry, typename Compare>
+class EntryCompare {
+    template <typename K>
+    static constexpr bool Comparable = std::is_same_v<K, Entry>
+        || std::is_same_v<K, Key>
+        || requires { typename Compare::is_transparent; };
+
+    static const Key& key_of(const Entry& entry) noexcept {
+        return entry.key;
+    }
+
+    template <typename K>
+    static const K& key_of(const K& key) noexcept {
+        return key;
+    }
+
+public:
+    using is_transparent = void;
+
+    [[no_unique_address]] Compare comp;
+
+    template <typename Lhs, typename Rhs>
+            requires Comparable<Lhs> && Comparable<Rhs>
+    bool operator()(const Lhs& lhs, const Rhs& rhs) const {
+        return comp(key_of(lhs), key_of(rhs));
+    }
+
+    template <typename Lhs, typename Rhs>
+            requires Comparable<Lhs> && Comparable<Rhs>
+                && (std::is_same_v<Compare, std::less<Key>>
+                    || std::is_same_v<Compare, std::less<>>)
+                && std::three_way_comparable_with<
+                       decltype(key_of(std::declval<const Lhs&>())),
+                       decltype(key_of(std::declval<const Rhs&>())),
+                       std::weak_ordering>
+    std::weak_ordering three_way(const Lhs& lhs, const Rhs& rhs) const {
+        return key_of(lhs) <=> key_of(rhs);
+    }
+};
+
+} // namespace maps
+
+// Ordered map over one of the trees, AVLMap and TreapMap below. Entries
+// are unique by key; Payload says where the values live, see payloads.
+// Iterators dereference to std::pair<const Key&, Value&>, the same for
+// both payloads, and stay valid until their element is erased.
+template <
+    template <typename, typename, typename, typename, typename> class Tree,
+    typename Key,
+    typename Value,
+    typename Payload,
+    typename Allocator,
+    typename Instrument,
+    typename Compare
+> class OrderedMap {
+    using entry_type = maps::Entry<Key, Value, Payload>;
+    using entry_compare = maps::EntryCompare<Key, entry_type, Compare>;
+    using tree_type = Tree<entry_type, Allocator, augments::none,
+                           Instrument, entry_compare>;
+
+    template <bool IsConst>
+    class BaseIterator {
+        using tree_iterator = std::conditional_t<IsConst,
+            typename tree_type::const_iterator, typename tree_type::iterator>;
+        using mapped_reference =
+            std::conditional_t<IsConst, const Value&, Value&>;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = std::pair<const Key, Value>;
+        using reference = std::pair<const Key&, mapped_reference>;
+
+        // Holds the pair operator-> points into
+        class pointer {
+        public:
+            const reference* operator->() const noexcept {
+                return &pair;
+            }
+
+        private:
+            friend class BaseIterator;
+
+            reference pair;
+
+            explicit pointer(reference pair)
+                    : pair(pair)
+            {}
+        };
+
+        BaseIterator() = default;
+
+        explicit BaseIterator(tree_iterator position)
+                : position(position)
+        {}
+
+        operator BaseIterator<true>() const noexcept requires (!IsConst) {
+            return BaseIterator<true>(position);
+        }
+
+        bool operator==(const BaseIterator& other) const noexcept {
+            return position == other.position;
+        }
+
+        bool operator!=(const BaseIterator& other) const noexcept {
+            return position != other.position;
+        }
+
+        BaseIterator operator++(int) {
+            auto temp = *this;
+            ++(*this);
+            return temp;
+        }
+
+        BaseIterator& operator++() {
+            ++position;
+            return *this;
+        }
+
+        reference operator*() const {
+            return reference(position->key, position->payload());
+        }
+
+        pointer operator->() const {
+            return pointer(**this);
+        }
+
+    private:
+        tree_iterator position;
+    };
+
+public:
+    using key_type = Key;
+    using mapped_type = Value;
+    using value_type = std::pair<const Key, Value>;
+    using key_compare = Compare;
+
+    using iterator = BaseIterator<false>;
+    using const_iterator = BaseIterator<true>;
+
+    OrderedMap() = default;
+
+    explicit OrderedMap(const Compare& comp)
+            : tree(entry_compare{comp})
+    {}
+
+    // O(n) for input sorted by key, O(n log n) otherwise; of equal keys
+    // only the first is kept
+    template <std::input_iterator InputIt>
+    OrderedMap(InputIt first, InputIt last, const Compare& comp = Compare())
+            : OrderedMap(comp)
+    {
+        assign(first, last);
+    }
+
+    OrderedMap(std::initializer_list<value_type> values,
+               const Compare& comp = Compare())
+            : OrderedMap(values.begin(), values.end(), comp)
+    {}
+
+    template <std::input_iterator InputIt>
+    void assign(InputIt first, InputIt last) {
+        std::vector<entry_type> entries;
+        for (; first != last; ++first) {
+            const auto& [key, value] = *first;
+            entries.emplace_back(key, value);
+        }
+        tree.assign(std::make_move_iterator(entries.begin()),
+                    std::make_move_iterator(entries.end()));
+        count = static_cast<size_t>(std::distance(tree.begin(), tree.end()));
+    }
+
+    // Basic functions
+    template <LookupKey<Key, Compare> K = Key>
+    iterator find(const K& key) {
+        return iterator(tree.find(lookup_key(key)));
+    }
+
+    template <LookupKey<Key, Compare> K = Key>
+    const_iterator find(const K& key) const {
+        const auto& search_key = lookup_key(key);
+        auto it = tree.lower_bound(search_key);
+        if (it != tree.end() && !tree.key_comp()(search_key, *it)) {
+            return const_iterator(it);
+        }
+        return end();
+    }
+
+    template <LookupKey<Key, Compare> K = Key>
+    bool contains(const K& key) const {
+        return find(key) != end();
+    }
+
+    // First element whose key is not less than key
+    template <LookupKey<Key, Compare> K = Key>
+    iterator lower_bound(const K& key) {
+        return iterator(tree.lower_bound(lookup_key(key)));
+    }
+
+    template <LookupKey<Key, Compare> K = Key>
+    const_iterator lower_bound(const K& key) const {
+        return const_iterator(tree.lower_bound(lookup_key(key)));
+    }
+
+    // First element whose key is greater than key
+    template <LookupKey<Key, Compare> K = Key>
+    iterator upper_bound(const K& key) {
+        return iterator(tree.upper_bound(lookup_key(key)));
+    }
+
+    template <LookupKey<Key, Compare> K = Key>
+    const_iterator upper_bound(const K& key) const {
+        return const_iterator(tree.upper_bound(lookup_key(key)));
+    }
+
+    // Throws std::out_of_range if key is missing
+    template <LookupKey<Key, Compare> K = Key>
+    Value& at(const K& key) {
+        auto it = find(key);
+        if (it == end()) {
+            throw std::out_of_range("OrderedMap::at: no such key");
+        }
+        return it->second;
+    }
+
+    template <LookupKey<Key, Compare> K = Key>
+    const Value& at(const K& key) const {
+        auto it = find(key);
+        if (it == end()) {
+            throw std::out_of_range("OrderedMap::at: no such key");
+        }
+        return it->second;
+    }
+
+    // Value-initializes the value of a missing key
+    Value& operator[](const Key& key) {
+        return try_emplace(key).first->second;
+    }
+
+    Value& operator[](Key&& key) {
+        return try_emplace(std::move(key)).first->second;
+    }
+
+    // Searches first: only a missing key gets a node, and a value made from
+    // args. Otherwise nothing is built and args are left untouched.
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args) {
+        return inserted(tree.try_emplace(key, key,
+                                         std::forward<Args>(args)...));
+    }
+
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args) {
+        // The search is over before the node takes key
+        return inserted(tree.try_emplace(key, std::move(key),
+                                         std::forward<Args>(args)...));
+    }
+
+    // Assigns value to an existing key, inserts it otherwise
+    template <typename M>
+    std::pair<iterator, bool> insert_or_assign(const Key& key, M&& value) {
+        auto result = try_emplace(key, std::forward<M>(value));
+        if (!result.second) {
+            result.first->second = std::forward<M>(value);
+        }
+        return result;
+    }
+
+    template <typename M>
+    std::pair<iterator, bool> insert_or_assign(Key&& key, M&& value) {
+        auto result = try_emplace(std::move(key), std::forward<M>(value));
+        if (!result.second) {
+            result.first->second = std::forward<M>(value);
+        }
+        return result;
+    }
+
+    std::pair<iterator, bool> insert(const value_type& value) {
+        return try_emplace(value.first, value.second);
+    }
+
+    template <LookupKey<Key, Compare> K = Key>
+    bool erase(const K& key) {
+        bool erased = tree.erase(lookup_key(key));
+        count -= erased;
+        return erased;
+    }
+
+    void clear() noexcept {
+        tree.clear();
+        count = 0;
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        return count == 0;
+    }
+
+    [[nodiscard]] size_t size() const noexcept {
+        return count;
+    }
+
+    Compare key_comp() const {
+        return tree.key_comp().comp;
+    }
+
+    // State of the Instrument policy, e.g. instruments::counters
+    const Instrument& instrumentation() const noexcept {
+        return tree.instrumentation();
+    }
+
+    Instrument& instrumentation() noexcept {
+        return tree.instrumentation();
+    }
+
+    // Iterators
+    iterator begin() noexcept {
+        return iterator(tree.begin());
+    }
+
+    const_iterator begin() const noexcept {
+        return const_iterator(tree.begin());
+    }
+
+    iterator end() noexcept {
+        return iterator(tree.end());
+    }
+
+    const_iterator end() const noexcept {
+        return const_iterator(tree.end());
+    }
+
+private:
+    tree_type tree;
+    size_t count = 0;
+
+    // Keys other than Key become a Key once, unless Compare takes them as
+    // they are, see BinaryTree::lookup_key
+    template <typename K>
+    static decltype(auto) lookup_key(const K& key) {
+        if constexpr (requires { typename Compare::is_transparent; }
+                          || std::is_same_v<K, Key>) {
+            return (key);
+        } else {
+            return Key(key);
+        }
+    }
+
+    std::pair<iterator, bool>
+    inserted(std::pair<typename tree_type::iterator, bool> result) {
+        count += result.second;
+        return std::make_pair(iterator(result.first), result.second);
+    }
+};
+
+template <
+    typename Key,
+    typename Value,
+    typename Payload = payloads::in_node,
+    typename Allocator = std::allocator<std::pair<const Key, Value>>,
+    typename Instrument = instruments::none,
+    typename Compare = std::less<Key>
+> using AVLMap = OrderedMap<AVLTree, Key, Value, Payload, Allocator,
+                           Instrument, Compare>;
+
+template <
+    typename Key,
+    typename Value,
+    typename Payload = payloads::in_node,
+    typename Allocator = std::allocator<std::pair<const Key, Value>>,
+    typename Instrument = instruments::none,
+    typename Compare = std::less<Key>
+> using TreapMap = OrderedMap<Treap, Key, Value, Payload, Allocator,
+                             Instrument, Compare>;
@@ -0,0 +1,550 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "frozen-tree.h"
+
+// Treap whose versions share structure. Copying one is O(1) and gives a
+// snapshot that later changes to either copy never show through: insert and
+// erase rebuild only the O(log n) shared nodes on their search path and split
+// or merge spines, and link the new path to the untouched subtrees of the
+// old version. Nodes no other version can reach are changed in place, so an
+// unshared tree costs little more than a plain Treap. Nodes are reference
+// counted and freed with their last version.
+//
+// Reference counts are atomic, so different PersistentTreap objects that
+// share nodes may be used from different threads, e.g. readers on a snapshot
+// while a writer keeps changing the original. A single object still needs
+// external synchronization, like any other container.
+//
+// Versions free each other's nodes, so copies of a stateful allocator must
+// be able to deallocate what the others allocated.
+template <
+    typename T,
+    typename Allocator = std::allocator<T>
+> class PersistentTreap {
+    struct Node {
+        Node* left;
+        Node* right;
+        mutable std::atomic<size_t> references{1};
+        std::uint64_t priority;
+        T value;
+
+        template <typename... Args>
+        Node(Node* left, Node* right, std::uint64_t priority, Args&&... args)
+                : left(left), right(right), priority(priority)
+                , value(std::forward<Args>(args)...)
+        {}
+    };
+
+    using node_allocator = typename
+        std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+    using node_traits = std::allocator_traits<node_allocator>;
+
+    // Writers on different versions run concurrently, so each thread draws
+    // priorities from its own generator
+    static std::uint64_t draw_priority() {
+        thread_local std::mt19937_64 rng{
+            static_cast<unsigned>(
+                std::chrono::steady_clock::now().time_since_epoch().count()
+            ) ^ std::hash<std::thread::id>{}(std::this_thread::get_id())
+        };
+        return rng();
+    }
+
+    // Holds the ancestors still to visit, the current node on top. Stays
+    // valid while some version holding its nodes is alive.
+    class ConstIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = T;
+        using pointer = const T*;
+        using reference = const T&;
+
+        ConstIterator() = default;
+
+        bool operator==(const ConstIterator& other) const noexcept {
+            if (path.empty() || other.path.empty()) {
+                return path.empty() == other.path.empty();
+            }
+            return path.back() == other.path.back();
+        }
+
+        bool operator!=(const ConstIterator& other) const noexcept {
+            return !(*this == other);
+        }
+
+        ConstIterator operator++(int) {
+            auto temp = *this;
+            ++(*this);
+            return temp;
+        }
+
+        ConstIterator& operator++() {
+            const Node* node = path.back();
+            path.pop_back();
+            push_leftmost(node->right);
+            return *this;
+        }
+
+        reference operator*() const {
+            return path.back()->value;
+        }
+
+        pointer operator->() const {
+            return &path.back()->value;
+        }
+
+    private:
+        friend class PersistentTreap;
+
+        std::vector<const Node*> path;
+
+        void push_leftmost(const Node* node) {
+            for (; node != nullptr; node = node->left) {
+                path.push_back(node);
+            }
+        }
+    };
+
+public:
+    // Nodes are shared between versions, so elements are read-only
+    using iterator = ConstIterator;
+    using const_iterator = ConstIterator;
+
+    PersistentTreap() = default;
+
+    template <std::input_iterator InputIt>
+    PersistentTreap(InputIt first, InputIt last) {
+        assign(first, last);
+    }
+
+    // Snapshot sharing every node with other
+    PersistentTreap(const PersistentTreap& other) noexcept
+            : alloc(other.alloc)
+            , root(retain(other.root))
+            , count(other.count)
+    {}
+
+    PersistentTreap(PersistentTreap&& other) noexcept
+            : alloc(std::move(other.alloc))
+            , root(std::exchange(other.root, nullptr))
+            , count(std::exchange(other.count, 0))
+    {}
+
+    PersistentTreap& operator=(const PersistentTreap& other) noexcept {
+        if (this != &other) {
+            Node* old_root = std::exchange(root, retain(other.root));
+            release(old_root);
+            alloc = other.alloc;
+            count = other.count;
+        }
+        return *this;
+    }
+
+    PersistentTreap& operator=(PersistentTreap&& other) noexcept {
+        if (this != &other) {
+            clear();
+            alloc = std::move(other.alloc);
+            root = std::exchange(other.root, nullptr);
+            count = std::exchange(other.count, 0);
+        }
+        return *this;
+    }
+
+    ~PersistentTreap() {
+        clear();
+    }
+
+    // Basic functions
+    const_iterator find(const T& value) const {
+        const_iterator it = lower_bound(value);
+        if (it != end() && !(value < *it)) {
+            return it;
+        }
+        return end();
+    }
+
+    // First element not less than value
+    const_iterator lower_bound(const T& value) const {
+        const_iterator it;
+        for (const Node* node = root; node != nullptr;) {
+            if (node->value < value) {
+                node = node->right;
+            } else {
+                it.path.push_back(node);
+                node = node->left;
+            }
+        }
+        return it;
+    }
+
+    // First element greater than value
+    const_iterator upper_bound(const T& value) const {
+        const_iterator it;
+        for (const Node* node = root; node != nullptr;) {
+            if (value < node->value) {
+                it.path.push_back(node);
+                node = node->left;
+            } else {
+                node = node->right;
+            }
+        }
+        return it;
+    }
+
+    std::pair<const_iterator, const_iterator> equal_range(const T& value) const {
+        return std::make_pair(lower_bound(value), upper_bound(value));
+    }
+
+    bool contains(const T& value) const noexcept {
+        for (const Node* node = root; node != nullptr;) {
+            if (node->value < value) {
+                node = node->right;
+            } else if (value < node->value) {
+                node = node->left;
+            } else {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        return count == 0;
+    }
+
+    [[nodiscard]] size_t size() const noexcept {
+        return count;
+    }
+
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args) {
+        return insert(T(std::forward<Args>(args)...));
+    }
+
+    std::pair<iterator, bool> insert(const T& value) {
+        return insert_value(value);
+    }
+
+    std::pair<iterator, bool> insert(T&& value) {
+        return insert_value(std::move(value));
+    }
+
+    // Other versions keep the element. On an exception this version stays
+    // as it was.
+    bool erase(const T& value) {
+        if (!contains(value)) {
+            return false;
+        }
+
+        commit(erase_node(root, value, true));
+        --count;
+        return true;
+    }
+
+    // Replaces the contents with [first, last) in O(n) for sorted input,
+    // O(n log n) otherwise; duplicates are dropped
+    template <std::input_iterator InputIt>
+    void assign(InputIt first, InputIt last) {
+        std::vector<T> values(first, last);
+        if (!std::is_sorted(values.begin(), values.end())) {
+            std::sort(values.begin(), values.end());
+        }
+        values.erase(std::unique(values.begin(), values.end(),
+                [](const T& lhs, const T& rhs) { return !(lhs < rhs); }),
+            values.end());
+
+        std::vector<Node*> nodes;
+        nodes.reserve(values.size());
+        try {
+            for (T& value : values) {
+                nodes.push_back(create_node(nullptr, nullptr, std::move(value)));
+            }
+        } catch (...) {
+            for (Node* node : nodes) {
+                destroy_node(node);
+            }
+            throw;
+        }
+
+        // Cartesian tree over the sorted nodes, the right spine on a stack
+        std::vector<Node*> spine;
+        for (Node* node : nodes) {
+            Node* last_popped = nullptr;
+            while (!spine.empty() && spine.back()->priority < node->priority) {
+                last_popped = spine.back();
+                spine.pop_back();
+            }
+            node->left = last_popped;
+            if (!spine.empty()) {
+                spine.back()->right = node;
+            }
+            spine.push_back(node);
+        }
+
+        commit(spine.empty() ? nullptr : spine.front());
+        count = nodes.size();
+    }
+
+    // Drops this version's references; nodes other versions hold survive
+    void clear() noexcept {
+        release(std::exchange(root, nullptr));
+        count = 0;
+    }
+
+    // Read-only copy laid out for fast lookups, see frozen-tree.h
+    FrozenTree<T> freeze() const {
+        return FrozenTree<T>(begin(), end());
+    }
+
+    // Iterators
+    const_iterator begin() const {
+        const_iterator it;
+        it.push_leftmost(root);
+        return it;
+    }
+
+    const_iterator end() const noexcept {
+        return const_iterator();
+    }
+
+private:
+    [[no_unique_address]] node_allocator alloc;
+    Node* root = nullptr;
+    size_t count = 0;
+
+    template <typename U>
+    std::pair<iterator, bool> insert_value(U&& value) {
+        if (contains(value)) {
+            return std::make_pair(find(value), false);
+        }
+
+        Node* node = create_node(nullptr, nullptr, std::forward<U>(value));
+        commit(insert_node(root, node, true));
+        ++count;
+        return std::make_pair(find(node->value), true);
+    }
+
+    // Makes new_root the current version and lets go of the old one
+    void commit(Node* new_root) noexcept {
+        replace_link(root, new_root);
+    }
+
+    // The functions below return a new version of the subtree they are
+    // given, leaving nodes other versions can reach untouched. With
+    // exclusive set, only the caller reaches tree, and tree may come back
+    // changed in place; any other result is a new reference the caller owns,
+    // see replace_link. Arguments marked owned are consumed, even when an
+    // exception is thrown. Nodes only change in place once nothing below
+    // them can throw, so a failed operation leaves the version as it was.
+
+    // Hangs owned node into a version of tree, splitting the subtree it
+    // displaces
+    Node* insert_node(Node* tree, Node* node, bool exclusive) {
+        if (tree == nullptr || tree->priority < node->priority) {
+            std::pair<Node*, Node*> halves;
+            try {
+                halves = split(tree, node->value);
+            } catch (...) {
+                destroy_node(node);
+                throw;
+            }
+            node->left = halves.first;
+            node->right = halves.second;
+            return node;
+        }
+
+        exclusive = exclusive && is_unique(tree);
+        if (node->value < tree->value) {
+            Node* left = insert_node(tree->left, node, exclusive);
+            return with_left(tree, left, exclusive);
+        }
+        Node* right = insert_node(tree->right, node, exclusive);
+        return with_right(tree, right, exclusive);
+    }
+
+    // Version of tree without value, which must be present. The children of
+    // the erased node are merged by copy even in place, so a failed merge
+    // does not lose them.
+    Node* erase_node(Node* tree, const T& value, bool exclusive) {
+        exclusive = exclusive && is_unique(tree);
+        if (value < tree->value) {
+            Node* left = erase_node(tree->left, value, exclusive);
+            return with_left(tree, left, exclusive);
+        }
+        if (tree->value < value) {
+            Node* right = erase_node(tree->right, value, exclusive);
+            return with_right(tree, right, exclusive);
+        }
+        return merge(retain(tree->left), retain(tree->right));
+    }
+
+    // Tree with its left child replaced by owned left
+    Node* with_left(Node* tree, Node* left, bool exclusive) {
+        if (exclusive) {
+            replace_link(tree->left, left);
+            return tree;
+        }
+        return copy_node(tree, left, retain(tree->right));
+    }
+
+    Node* with_right(Node* tree, Node* right, bool exclusive) {
+        if (exclusive) {
+            replace_link(tree->right, right);
+            return tree;
+        }
+        return copy_node(tree, retain(tree->left), right);
+    }
+
+    // Points link at a subtree version returned with exclusive set
+    void replace_link(Node*& link, Node* node) noexcept {
+        if (link != node) {
+            release(std::exchange(link, node));
+        }
+    }
+
+    // Versions of the values of tree less than value and not less than it
+    std::pair<Node*, Node*> split(const Node* tree, const T& value) {
+        if (tree == nullptr) {
+            return std::make_pair(nullptr, nullptr);
+        }
+
+        if (tree->value < value) {
+            auto [less, rest] = split(tree->right, value);
+            try {
+                return std::make_pair(copy_node(tree, retain(tree->left), less),
+                                      rest);
+            } catch (...) {
+                release(rest);
+                throw;
+            }
+        }
+
+        auto [rest, greater] = split(tree->left, value);
+        try {
+            return std::make_pair(rest,
+                                  copy_node(tree, greater, retain(tree->right)));
+        } catch (...) {
+            release(rest);
+            throw;
+        }
+    }
+
+    // Joins owned lhs and rhs, all of whose values are smaller than rhs's
+    Node* merge(Node* lhs, Node* rhs) {
+        if (lhs == nullptr) {
+            return rhs;
+        } else if (rhs == nullptr) {
+            return lhs;
+        }
+
+        if (lhs->priority > rhs->priority) {
+            Node* right;
+            try {
+                right = merge(retain(lhs->right), rhs);
+            } catch (...) {
+                release(lhs);
+                throw;
+            }
+            return relink(lhs, retain(lhs->left), right);
+        }
+
+        Node* left;
+        try {
+            left = merge(lhs, retain(rhs->left));
+        } catch (...) {
+            release(rhs);
+            throw;
+        }
+        return relink(rhs, left, retain(rhs->right));
+    }
+
+    // Owned node with owned children left and right. Changed in place when
+    // no version can see it, copied otherwise.
+    Node* relink(Node* node, Node* left, Node* right) {
+        if (is_unique(node)) {
+            release(std::exchange(node->left, left));
+            release(std::exchange(node->right, right));
+            return node;
+        }
+
+        Node* copy;
+        try {
+            copy = copy_node(node, left, right);
+        } catch (...) {
+            release(node);
+            throw;
+        }
+        release(node);
+        return copy;
+    }
+
+    // New node holding tree's value and priority over owned children
+    Node* copy_node(const Node* tree, Node* left, Node* right) {
+        try {
+            Node* node = create_node(left, right, tree->value);
+            node->priority = tree->priority;
+            return node;
+        } catch (...) {
+            release(left);
+            release(right);
+            throw;
+        }
+    }
+
+    // Whether the reference the caller holds is the only one. Nobody else
+    // can add one, so the answer cannot go stale.
+    static bool is_unique(const Node* node) noexcept {
+        return node->references.load(std::memory_order_acquire) == 1;
+    }
+
+    static Node* retain(const Node* node) noexcept {
+        if (node != nullptr) {
+            node->references.fetch_add(1, std::memory_order_relaxed);
+        }
+        return const_cast<Node*>(node);
+    }
+
+    // Drops one reference, freeing whatever only it kept alive. Recurses as
+    // deep as the tree, like split and merge.
+    void release(Node* node) noexcept {
+        while (node != nullptr
+                && node->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            release(node->left);
+            Node* right = node->right;
+            destroy_node(node);
+            node = right;
+        }
+    }
+
+    template <typename... Args>
+    Node* create_node(Node* left, Node* right, Args&&... args) {
+        Node* node = node_traits::allocate(alloc, 1);
+        try {
+            node_traits::construct(alloc, node, left, right, draw_priority(),
+                                   std::forward<Args>(args)...);
+        } catch (...) {
+            node_traits::deallocate(alloc, node, 1);
+            throw;
+        }
+        return node;
+    }
+
+    void destroy_node(Node* node) noexcept {
+        node_traits::destroy(alloc, node);
+        node_traits::deallocate(alloc, node, 1);
+    }
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+// Slab allocator for tree nodes. Single-object allocations are carved out of
+// slabs of NodesPerSlab slots and recycled through an intrusive freelist.
+// Every default-constructed allocator owns a fresh pool, so each tree gets its
+// own; copies share the pool and compare equal.
+template <typename T, std::size_t NodesPerSlab = 256>
+class PoolAllocator {
+    template <typename, std::size_t>
+    friend class PoolAllocator;
+
+    union Slot {
+        Slot* next;
+        alignas(T) std::byte storage[sizeof(T)];
+    };
+
+    class Pool {
+    public:
+        Pool() = default;
+        Pool(const Pool&) = delete;
+        Pool& operator=(const Pool&) = delete;
+
+        ~Pool() {
+            release();
+        }
+
+        T* allocate() {
+            if (free_list != nullptr) {
+                Slot* slot = free_list;
+                free_list = slot->next;
+                return reinterpret_cast<T*>(slot);
+            }
+            if (cursor == slab_end) {
+                grow();
+            }
+            return reinterpret_cast<T*>(cursor++);
+        }
+
+        void deallocate(T* ptr) noexcept {
+            Slot* slot = reinterpret_cast<Slot*>(ptr);
+            slot->next = free_list;
+            free_list = slot;
+        }
+
+        void release() noexcept {
+            for (Slot* slab : slabs) {
+                ::operator delete(slab, std::align_val_t{alignof(Slot)});
+            }
+            slabs.clear();
+            free_list = cursor = slab_end = nullptr;
+        }
+
+    private:
+        std::vector<Slot*> slabs;
+        Slot* free_list = nullptr;
+        Slot* cursor = nullptr;
+        Slot* slab_end = nullptr;
+
+        void grow() {
+            slabs.reserve(slabs.size() + 1);
+            cursor = static_cast<Slot*>(::operator new(
+                sizeof(Slot) * NodesPerSlab, std::align_val_t{alignof(Slot)}
+            ));
+            slab_end = cursor + NodesPerSlab;
+            slabs.push_back(cursor);
+        }
+    };
+
+    std::shared_ptr<Pool> pool;
+
+public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = PoolAllocator<U, NodesPerSlab>;
+    };
+
+    PoolAllocator()
+            : pool(std::make_shared<Pool>())
+    {}
+
+    PoolAllocator(const PoolAllocator&) = default;
+    PoolAllocator& operator=(const PoolAllocator&) = default;
+
+    // A pool only hands out slots of one size, so rebinding starts a new one
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U, NodesPerSlab>&)
+            : PoolAllocator()
+    {}
+
+    T* allocate(std::size_t n) {
+        if (n != 1) {
+            return static_cast<T*>(::operator new(
+                n * sizeof(T), std::align_val_t{alignof(T)}
+            ));
+        }
+        return pool->allocate();
+    }
+
+    void deallocate(T* ptr, std::size_t n) noexcept {
+        if (n != 1) {
+            ::operator delete(ptr, std::align_val_t{alignof(T)});
+        } else {
+            pool->deallocate(ptr);
+        }
+    }
+
+    // True when no other allocator shares this pool, so release() is safe
+    // once every object allocated from it has been destroyed
+    [[nodiscard]] bool exclusive() const noexcept {
+        return pool.use_count() == 1;
+    }
+
+    // Returns every slab at once, invalidating all outstanding allocations
+    void release() noexcept {
+        pool->release();
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U, NodesPerSlab>& other) const noexcept {
+        return pool.get() == static_cast<const void*>(other.pool.get());
+    }
+};
@@ -0,0 +1,420 @@
+#pragma once
+
+#include "binary-tree.h"
+
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace nodes {
+
+template <typename T, typename Augment>
+class RBNode;
+
+template <typename T, typename Augment>
+inline constexpr bool tags_parent<RBNode<T, Augment>> = true;
+
+// The colour lives in the low bit of the parent link, so a node is exactly
+// as large as a DefaultNode whatever the key
+template <typename T, typename Augment = augments::none>
+class RBNode : public BaseNode<RBNode<T, Augment>> {
+public:
+    using augment_type = Augment;
+
+    T value;
+    [[no_unique_address]] typename Augment::value_type augment{};
+
+    using base_type = BaseNode<RBNode<T, Augment>>;
+    using base_type::base_type;
+
+    template <typename... Args>
+    RBNode(RBNode* left, RBNode* right, RBNode* parent, Args&&... args)
+            : base_type(left, right, parent)
+            , value(std::forward<Args>(args)...)
+    {
+        this->parent.set_flag(true);
+    }
+
+    bool red() const noexcept {
+        return this->parent.flag();
+    }
+
+    void paint(bool red) noexcept {
+        this->parent.set_flag(red);
+    }
+};
+
+static_assert(sizeof(RBNode<std::int32_t>) == sizeof(DefaultNode<std::int32_t>));
+static_assert(sizeof(RBNode<std::int64_t>) == sizeof(DefaultNode<std::int64_t>));
+static_assert(sizeof(RBNode<double>) == sizeof(DefaultNode<double>));
+static_assert(sizeof(RBNode<void*>) == sizeof(DefaultNode<void*>));
+static_assert(sizeof(RBNode<std::string>) == sizeof(DefaultNode<std::string>));
+
+} // namespace nodes
+
+// Insertion does at most two rotations and erasure at most three, the
+// recolouring above them is amortized O(1)
+template <
+    typename T,
+    typename Allocator = std::allocator<T>,
+    typename Augment = augments::none,
+    typename Instrument = instruments::none,
+    typename Compare = std::less<T>
+> class RBTree : public BinaryTree<T, nodes::RBNode<T, Augment>, Allocator,
+                                  Instrument, Compare> {
+    using base_type = BinaryTree<T, nodes::RBNode<T, Augment>, Allocator,
+                                 Instrument, Compare>;
+    using base_type::base_type;
+
+    using base_type::find_helper;
+    using base_type::emplace_helper;
+    using base_type::try_emplace_helper;
+    using base_type::emplace_hint_helper;
+    using base_type::link_leaf;
+    using base_type::unlink_node;
+    using base_type::replace_child;
+
+    using base_type::sentinel_node;
+    using base_type::destroy_node;
+
+    using base_type::update_augment;
+    using base_type::update_augment_upward;
+
+public:
+    RBTree() = default;
+
+    template <std::input_iterator InputIt>
+    RBTree(InputIt first, InputIt last) {
+        assign(first, last);
+    }
+
+    // Basic functions
+    using base_type::find;
+    using base_type::lower_bound;
+    using base_type::upper_bound;
+    using base_type::equal_range;
+    using base_type::find_many;
+    using base_type::find_from;
+    using base_type::key_comp;
+    using base_type::clear;
+
+    // Order statistics, available with augments::subtree_size
+    using base_type::size;
+    using base_type::nth;
+    using base_type::rank;
+
+    // Range aggregates, available with any augment
+    using base_type::aggregate;
+
+    // Helpers
+    using base_type::print_by_layer;
+    using base_type::freeze;
+    using base_type::instrumentation;
+
+    // Iterators
+    using typename base_type::iterator;
+    using typename base_type::const_iterator;
+
+    // Node handles, see NodeHandle
+    using typename base_type::node_type;
+    using typename base_type::insert_return_type;
+
+    using base_type::begin;
+    using base_type::end;
+
+    // Fake node connects first, last and root
+    using BaseNode = nodes::BaseNode<nodes::RBNode<T, Augment>>;
+
+    // Modified functions
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args) {
+        auto [ptr, is_successful] = emplace_helper(std::forward<Args>(args)...);
+        if (!is_successful) {
+            return std::make_pair(iterator(ptr, *this), false);
+        }
+
+        update_augment_upward(ptr);
+        insert_fixup(ptr);
+        return std::make_pair(iterator(ptr, *this), true);
+    }
+
+    // Searches from hint, see BinaryTree::find_from
+    template <typename... Args>
+    iterator emplace_hint(const_iterator hint, Args&&... args) {
+        auto [ptr, is_successful] =
+            emplace_hint_helper(hint, std::forward<Args>(args)...);
+        if (is_successful) {
+            update_augment_upward(ptr);
+            insert_fixup(ptr);
+        }
+        return iterator(ptr, *this);
+    }
+
+    // Searches first and builds the T only if key is missing, see
+    // BinaryTree::try_emplace
+    template <LookupKey<T, Compare> Key = T, typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args) {
+        auto [ptr, is_successful] =
+            try_emplace_helper(key, std::forward<Args>(args)...);
+        if (is_successful) {
+            update_augment_upward(ptr);
+            insert_fixup(ptr);
+        }
+        return std::make_pair(iterator(ptr, *this), is_successful);
+    }
+
+    std::pair<iterator, bool> insert(const T& value) {
+        return try_emplace(value);
+    }
+
+    std::pair<iterator, bool> insert(T&& value) {
+        return try_emplace(value, std::move(value));
+    }
+
+    // A balanced build has all leaves on its last two levels; colouring the
+    // last level red when it is incomplete gives every path the same number
+    // of black nodes
+    template <std::input_iterator InputIt>
+    void assign(InputIt first, InputIt last) {
+        std::vector<T> values = base_type::sorted_unique(first, last);
+        size_t full_levels = std::bit_width(values.size() + 1) - 1;
+        base_type::assign_sorted(std::move(values), [](BaseNode*, size_t) {});
+        if (sentinel_node.parent == &sentinel_node) {
+            return;
+        }
+
+        std::vector<std::pair<BaseNode*, size_t>> pending{
+            {sentinel_node.parent, 0}
+        };
+        while (!pending.empty()) {
+            auto [node, depth] = pending.back();
+            pending.pop_back();
+
+            node->as_derived()->paint(depth == full_levels);
+            if (node->left != &sentinel_node) {
+                pending.emplace_back(node->left, depth + 1);
+            }
+            if (node->right != &sentinel_node) {
+                pending.emplace_back(node->right, depth + 1);
+            }
+        }
+    }
+
+    // Unlinks the node itself rather than moving its successor's value, so
+    // the colour fixup can start from where a node actually disappeared
+    template <LookupKey<T, Compare> Key = T>
+    bool erase(const Key& key) {
+        auto [node, is_self] = find_helper(key);
+        if (!is_self) {
+            return false;
+        }
+
+        detach_node(node);
+        destroy_node(node->as_derived());
+        return true;
+    }
+
+    template <LookupKey<T, Compare> Key = T>
+            requires (!base_type::template is_position<Key>)
+    node_type extract(const Key& key) {
+        auto [node, is_self] = find_helper(key);
+        return extract(const_iterator(is_self ? node : &sentinel_node, *this));
+    }
+
+    node_type extract(const_iterator position) {
+        return base_type::extract_handle(position, [this](BaseNode* node) {
+            detach_node(node);
+        });
+    }
+
+    insert_return_type insert(node_type&& handle) {
+        return base_type::insert_handle(std::move(handle), [this](auto* node) {
+            return attach_node(node);
+        });
+    }
+
+    void merge(RBTree& other) {
+        base_type::merge_from(*this, other);
+    }
+
+private:
+    void detach_node(BaseNode* node) noexcept {
+        // A successor taking node's place takes its colour as well, so the
+        // colour that goes missing is the successor's own
+        bool removed_red = is_red(node);
+        auto [child, child_parent] = unlink_node(node,
+            [&removed_red, node](BaseNode* successor) {
+                removed_red = successor->as_derived()->red();
+                successor->as_derived()->paint(node->as_derived()->red());
+            });
+
+        update_augment_upward(child_parent);
+        if (!removed_red) {
+            erase_fixup(child, child_parent);
+        }
+    }
+
+    std::pair<BaseNode*, bool> attach_node(nodes::RBNode<T, Augment>* node) {
+        node->paint(true);
+        auto result = link_leaf(node);
+        if (result.second) {
+            update_augment_upward(node);
+            insert_fixup(node);
+        }
+        return result;
+    }
+
+    bool is_red(const BaseNode* node) const noexcept {
+        return node != &sentinel_node && node->as_derived()->red();
+    }
+
+    static void paint(BaseNode* node, bool red) noexcept {
+        node->as_derived()->paint(red);
+    }
+
+    void insert_fixup(BaseNode* x) {
+        paint(x, true);
+        while (x != sentinel_node.parent && is_red(x->parent)) {
+            BaseNode* parent = x->parent;
+            BaseNode* grandparent = parent->parent;
+
+            if (parent == grandparent->left) {
+                BaseNode* uncle = grandparent->right;
+                if (is_red(uncle)) {
+                    paint(parent, false);
+                    paint(uncle, false);
+                    paint(grandparent, true);
+                    x = grandparent;
+                } else {
+                    if (x == parent->right) {
+                        rotate_left(parent);
+                        x = parent;
+                        parent = x->parent;
+                    }
+                    paint(parent, false);
+                    paint(grandparent, true);
+                    rotate_right(grandparent);
+                }
+            } else {
+                BaseNode* uncle = grandparent->left;
+                if (is_red(uncle)) {
+                    paint(parent, false);
+                    paint(uncle, false);
+                    paint(grandparent, true);
+                    x = grandparent;
+                } else {
+                    if (x == parent->left) {
+                        rotate_right(parent);
+                        x = parent;
+                        parent = x->parent;
+                    }
+                    paint(parent, false);
+                    paint(grandparent, true);
+                    rotate_left(grandparent);
+                }
+            }
+        }
+        paint(sentinel_node.parent, false);
+    }
+
+    // x carries an extra black; it may be the sentinel, hence x_parent
+    void erase_fixup(BaseNode* x, BaseNode* x_parent) {
+        while (x != sentinel_node.parent && !is_red(x)) {
+            if (x == x_parent->left) {
+                BaseNode* sibling = x_parent->right;
+                if (is_red(sibling)) {
+                    paint(sibling, false);
+                    paint(x_parent, true);
+                    rotate_left(x_parent);
+                    sibling = x_parent->right;
+                }
+
+                if (!is_red(sibling->left) && !is_red(sibling->right)) {
+                    paint(sibling, true);
+                    x = x_parent;
+                    x_parent = x_parent->parent;
+                } else {
+                    if (!is_red(sibling->right)) {
+                        paint(sibling->left, false);
+                        paint(sibling, true);
+                        rotate_right(sibling);
+                        sibling = x_parent->right;
+                    }
+                    paint(sibling, is_red(x_parent));
+                    paint(x_parent, false);
+                    if (sibling->right != &sentinel_node) {
+                        paint(sibling->right, false);
+                    }
+                    rotate_left(x_parent);
+                    break;
+                }
+            } else {
+                BaseNode* sibling = x_parent->left;
+                if (is_red(sibling)) {
+                    paint(sibling, false);
+                    paint(x_parent, true);
+                    rotate_right(x_parent);
+                    sibling = x_parent->left;
+                }
+
+                if (!is_red(sibling->right) && !is_red(sibling->left)) {
+                    paint(sibling, true);
+                    x = x_parent;
+                    x_parent = x_parent->parent;
+                } else {
+                    if (!is_red(sibling->left)) {
+                        paint(sibling->right, false);
+                        paint(sibling, true);
+                        rotate_left(sibling);
+                        sibling = x_parent->left;
+                    }
+                    paint(sibling, is_red(x_parent));
+                    paint(x_parent, false);
+                    if (sibling->left != &sentinel_node) {
+                        paint(sibling->left, false);
+                    }
+                    rotate_right(x_parent);
+                    break;
+                }
+            }
+        }
+        if (x != &sentinel_node) {
+            paint(x, false);
+        }
+    }
+
+    void rotate_left(BaseNode* x) {
+        this->instrument.on_rotation();
+        BaseNode* y = x->right;
+        x->right = y->left;
+        if (y->left != &sentinel_node) {
+            y->left->parent = x;
+        }
+        replace_child(x, y);
+        y->left = x;
+        x->parent = y;
+
+        update_augment(x);
+        update_augment(y);
+    }
+
+    void rotate_right(BaseNode* y) {
+        this->instrument.on_rotation();
+        BaseNode* x = y->left;
+        y->left = x->right;
+        if (x->right != &sentinel_node) {
+            x->right->parent = y;
+        }
+        replace_child(y, x);
+        x->right = y;
+        y->parent = x;
+
+        update_augment(y);
+        update_augment(x);
+    }
+};
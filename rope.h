@@ -0,0 +1,453 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <random>
+#include <utility>
+#include <vector>
+
+// Sequence kept as a treap keyed implicitly by position: a node's index is
+// the size of everything left of it, so split and merge work on counts
+// instead of keys. Inserting or erasing anywhere, cutting out a range and
+// joining two ropes all take O(log n) expected time.
+//
+// Range updates are lazy. reverse_range, add_to_range and assign_range tag
+// the root of the cut-out range, and a tag is pushed down to the children
+// only when something descends past its node. A node's own value is always
+// up to date; its tags describe what its subtrees still owe.
+template <
+    typename T,
+    typename Allocator = std::allocator<T>
+> class Rope {
+    struct Node {
+        Node* left = nullptr;
+        Node* right = nullptr;
+        size_t size = 1;
+        std::uint64_t priority;
+
+        // Pending for both subtrees. An assignment absorbs any later
+        // addition, so the two are never pending at once.
+        bool reversed = false;
+        std::optional<T> assigned;
+        std::optional<T> added;
+
+        T value;
+
+        template <typename... Args>
+        explicit Node(std::uint64_t priority, Args&&... args)
+                : priority(priority), value(std::forward<Args>(args)...)
+        {}
+    };
+
+    using node_allocator = typename
+        std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+    using node_traits = std::allocator_traits<node_allocator>;
+
+    // Per thread, so ropes on different threads share no state
+    inline static thread_local std::mt19937_64 rng{
+        static_cast<unsigned>(
+            std::chrono::steady_clock::now().time_since_epoch().count()
+        )
+    };
+
+public:
+    Rope() = default;
+
+    template <std::input_iterator InputIt>
+    Rope(InputIt first, InputIt last) {
+        assign(first, last);
+    }
+
+    Rope(const Rope& other)
+            : alloc(node_traits::select_on_container_copy_construction(
+                  other.alloc))
+    {
+        root = clone(other.root);
+    }
+
+    Rope(Rope&& other) noexcept
+            : alloc(std::move(other.alloc))
+            , root(std::exchange(other.root, nullptr))
+    {}
+
+    Rope& operator=(const Rope& other) {
+        if (this != &other) {
+            Node* copy = clone(other.root);
+            clear();
+            root = copy;
+        }
+        return *this;
+    }
+
+    Rope& operator=(Rope&& other) noexcept {
+        if (this != &other) {
+            clear();
+            alloc = std::move(other.alloc);
+            root = std::exchange(other.root, nullptr);
+        }
+        return *this;
+    }
+
+    ~Rope() {
+        clear();
+    }
+
+    // Basic functions. Indices must be in range, like for std::vector.
+    T& operator[](size_t index) {
+        Node* node = root;
+        while (true) {
+            push_down(node);
+            size_t left_size = size_of(node->left);
+            if (index < left_size) {
+                node = node->left;
+            } else if (index == left_size) {
+                return node->value;
+            } else {
+                index -= left_size + 1;
+                node = node->right;
+            }
+        }
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        return root == nullptr;
+    }
+
+    [[nodiscard]] size_t size() const noexcept {
+        return size_of(root);
+    }
+
+    // Inserts before index; index == size() appends
+    template <typename... Args>
+    void emplace(size_t index, Args&&... args) {
+        Node* node = create_node(std::forward<Args>(args)...);
+        auto [lhs, rhs] = split(root, index);
+        root = merge(merge(lhs, node), rhs);
+    }
+
+    void insert(size_t index, const T& value) {
+        emplace(index, value);
+    }
+
+    void insert(size_t index, T&& value) {
+        emplace(index, std::move(value));
+    }
+
+    void push_back(const T& value) {
+        emplace(size(), value);
+    }
+
+    void push_back(T&& value) {
+        emplace(size(), std::move(value));
+    }
+
+    void erase(size_t index) {
+        erase_range(index, index + 1);
+    }
+
+    void erase_range(size_t first, size_t last) {
+        destroy_subtree(cut_range(first, last));
+    }
+
+    // Moves [first, last) into a new rope sharing this one's allocator
+    Rope extract_range(size_t first, size_t last) {
+        Rope result;
+        result.alloc = alloc;
+        result.root = cut_range(first, last);
+        return result;
+    }
+
+    // Moves all of other in before index. Nodes are taken over when the
+    // allocators compare equal and copied otherwise.
+    void splice(size_t index, Rope&& other) {
+        Node* inserted = alloc == other.alloc
+            ? std::exchange(other.root, nullptr) : clone(other.root);
+        other.clear();
+
+        auto [lhs, rhs] = split(root, index);
+        root = merge(merge(lhs, inserted), rhs);
+    }
+
+    void append(Rope&& other) {
+        splice(size(), std::move(other));
+    }
+
+    // Lazy range updates over [first, last)
+    void reverse_range(size_t first, size_t last) {
+        update_range(first, last, [](Node* node) {
+            apply_reverse(node);
+        });
+    }
+
+    void add_to_range(size_t first, size_t last, const T& delta)
+            requires requires(T& lhs, const T& rhs) { lhs += rhs; } {
+        update_range(first, last, [&](Node* node) {
+            apply_add(node, delta);
+        });
+    }
+
+    void assign_range(size_t first, size_t last, const T& value) {
+        update_range(first, last, [&](Node* node) {
+            apply_assign(node, value);
+        });
+    }
+
+    // Replaces the contents with [first, last) in O(n)
+    template <std::input_iterator InputIt>
+    void assign(InputIt first, InputIt last) {
+        std::vector<Node*> nodes;
+        try {
+            for (; first != last; ++first) {
+                nodes.push_back(create_node(*first));
+            }
+        } catch (...) {
+            for (Node* node : nodes) {
+                destroy_node(node);
+            }
+            throw;
+        }
+
+        clear();
+        root = link_cartesian(nodes);
+    }
+
+    void clear() noexcept {
+        destroy_subtree(std::exchange(root, nullptr));
+    }
+
+    // Calls f on every element in order, settling pending tags on the way
+    template <typename F>
+    void for_each(F&& f) {
+        for_each_in(root, f);
+    }
+
+    std::vector<T> to_vector() {
+        std::vector<T> result;
+        result.reserve(size());
+        for_each([&](const T& value) { result.push_back(value); });
+        return result;
+    }
+
+private:
+    [[no_unique_address]] node_allocator alloc;
+    Node* root = nullptr;
+
+    static size_t size_of(const Node* node) noexcept {
+        return node != nullptr ? node->size : 0;
+    }
+
+    static void update_size(Node* node) noexcept {
+        node->size = 1 + size_of(node->left) + size_of(node->right);
+    }
+
+    static void apply_reverse(Node* node) noexcept {
+        if (node != nullptr) {
+            std::swap(node->left, node->right);
+            node->reversed = !node->reversed;
+        }
+    }
+
+    static void apply_add(Node* node, const T& delta) {
+        if (node == nullptr) {
+            return;
+        }
+
+        node->value += delta;
+        if (node->assigned) {
+            *node->assigned += delta;
+        } else if (node->added) {
+            *node->added += delta;
+        } else {
+            node->added = delta;
+        }
+    }
+
+    static void apply_assign(Node* node, const T& value) {
+        if (node != nullptr) {
+            node->value = value;
+            node->assigned = value;
+            node->added.reset();
+        }
+    }
+
+    // Hands node's pending tags to its children
+    static void push_down(Node* node) {
+        if (node->reversed) {
+            apply_reverse(node->left);
+            apply_reverse(node->right);
+            node->reversed = false;
+        }
+        if (node->assigned) {
+            apply_assign(node->left, *node->assigned);
+            apply_assign(node->right, *node->assigned);
+            node->assigned.reset();
+        }
+        if constexpr (requires(T& lhs, const T& rhs) { lhs += rhs; }) {
+            if (node->added) {
+                apply_add(node->left, *node->added);
+                apply_add(node->right, *node->added);
+                node->added.reset();
+            }
+        }
+    }
+
+    template <typename Update>
+    void update_range(size_t first, size_t last, Update&& update) {
+        if (first >= last) {
+            return;
+        }
+
+        auto [lhs, rest] = split(root, first);
+        auto [middle, rhs] = split(rest, last - first);
+        update(middle);
+        root = merge(merge(lhs, middle), rhs);
+    }
+
+    // Detaches [first, last) and returns its root
+    Node* cut_range(size_t first, size_t last) {
+        if (first >= last) {
+            return nullptr;
+        }
+
+        auto [lhs, rest] = split(root, first);
+        auto [middle, rhs] = split(rest, last - first);
+        root = merge(lhs, rhs);
+        return middle;
+    }
+
+    // Splits off the first count elements
+    std::pair<Node*, Node*> split(Node* node, size_t count) {
+        if (node == nullptr) {
+            return std::make_pair(nullptr, nullptr);
+        }
+
+        push_down(node);
+        size_t left_size = size_of(node->left);
+        if (left_size < count) {
+            auto [lhs, rhs] = split(node->right, count - left_size - 1);
+            node->right = lhs;
+            update_size(node);
+            return std::make_pair(node, rhs);
+        } else {
+            auto [lhs, rhs] = split(node->left, count);
+            node->left = rhs;
+            update_size(node);
+            return std::make_pair(lhs, node);
+        }
+    }
+
+    Node* merge(Node* lhs, Node* rhs) {
+        if (lhs == nullptr) {
+            return rhs;
+        } else if (rhs == nullptr) {
+            return lhs;
+        } else if (lhs->priority > rhs->priority) {
+            push_down(lhs);
+            lhs->right = merge(lhs->right, rhs);
+            update_size(lhs);
+            return lhs;
+        } else {
+            push_down(rhs);
+            rhs->left = merge(lhs, rhs->left);
+            update_size(rhs);
+            return rhs;
+        }
+    }
+
+    // Builds the Cartesian tree of the nodes' priorities in sequence order
+    // in O(n): the stack holds the right spine of the tree built so far, and
+    // a node's size is final once it leaves the spine
+    static Node* link_cartesian(const std::vector<Node*>& nodes) {
+        std::vector<Node*> spine;
+        for (Node* node : nodes) {
+            Node* last_popped = nullptr;
+            while (!spine.empty() && spine.back()->priority < node->priority) {
+                last_popped = spine.back();
+                update_size(last_popped);
+                spine.pop_back();
+            }
+
+            node->left = last_popped;
+            if (!spine.empty()) {
+                spine.back()->right = node;
+            }
+            spine.push_back(node);
+        }
+
+        for (auto it = spine.rbegin(); it != spine.rend(); ++it) {
+            update_size(*it);
+        }
+        return spine.empty() ? nullptr : spine.front();
+    }
+
+    template <typename F>
+    static void for_each_in(Node* node, F& f) {
+        while (node != nullptr) {
+            push_down(node);
+            for_each_in(node->left, f);
+            f(std::as_const(node->value));
+            node = node->right;
+        }
+    }
+
+    // Copies the tags along with the shape, so nothing is pushed down
+    Node* clone(const Node* node) {
+        if (node == nullptr) {
+            return nullptr;
+        }
+
+        Node* copy = create_node_copy(*node);
+        try {
+            copy->left = clone(node->left);
+            copy->right = clone(node->right);
+        } catch (...) {
+            destroy_subtree(copy);
+            throw;
+        }
+        return copy;
+    }
+
+    template <typename... Args>
+    Node* create_node(Args&&... args) {
+        Node* node = node_traits::allocate(alloc, 1);
+        try {
+            node_traits::construct(alloc, node, rng(),
+                                   std::forward<Args>(args)...);
+        } catch (...) {
+            node_traits::deallocate(alloc, node, 1);
+            throw;
+        }
+        return node;
+    }
+
+    Node* create_node_copy(const Node& other) {
+        Node* node = node_traits::allocate(alloc, 1);
+        try {
+            node_traits::construct(alloc, node, other);
+        } catch (...) {
+            node_traits::deallocate(alloc, node, 1);
+            throw;
+        }
+        node->left = node->right = nullptr;
+        return node;
+    }
+
+    void destroy_node(Node* node) noexcept {
+        node_traits::destroy(alloc, node);
+        node_traits::deallocate(alloc, node, 1);
+    }
+
+    // Recurses as deep as the tree, like split and merge
+    void destroy_subtree(Node* node) noexcept {
+        while (node != nullptr) {
+            destroy_subtree(node->left);
+            Node* right = node->right;
+            destroy_node(node);
+            node = right;
+        }
+    }
+};
@@ -0,0 +1,384 @@
+#pragma once
+
+#include "binary-tree.h"
+
+#include <compare>
+#include <functional>
+#include <iterator>
+#include <memory>
+
+template <
+    typename T,
+    typename Allocator = std::allocator<T>,
+    typename Augment = augments::none,
+    typename Instrument = instruments::none,
+    typename Compare = std::less<T>
+> class SplayTree : public BinaryTree<T, nodes::DefaultNode<T, Augment>,
+                                     Allocator, Instrument, Compare> {
+    using base_type = BinaryTree<T, nodes::DefaultNode<T, Augment>, Allocator,
+                                 Instrument, Compare>;
+    using base_type::base_type;
+
+    using base_type::comp;
+    using base_type::compare;
+    using base_type::lookup_key;
+
+    using base_type::sentinel_node;
+
+    using base_type::create_node;
+    using base_type::destroy_node;
+
+    using base_type::update_augment;
+    using base_type::leftmost;
+    using base_type::rightmost;
+
+    using typename base_type::Node;
+    using typename base_type::Slot;
+
+public:
+    SplayTree() = default;
+
+    template <std::input_iterator InputIt>
+    SplayTree(InputIt first, InputIt last) {
+        assign(first, last);
+    }
+
+    // Basic functions
+    using base_type::lower_bound;
+    using base_type::upper_bound;
+    using base_type::equal_range;
+    using base_type::find_many;
+    using base_type::find_from;
+    using base_type::key_comp;
+    using base_type::assign;
+    using base_type::clear;
+
+    // Order statistics, available with augments::subtree_size
+    using base_type::size;
+    using base_type::nth;
+    using base_type::rank;
+
+    // Range aggregates, available with any augment
+    using base_type::aggregate;
+
+    // Helpers
+    using base_type::print_by_layer;
+    using base_type::freeze;
+    using base_type::instrumentation;
+
+    // Iterators
+    using typename base_type::iterator;
+    using typename base_type::const_iterator;
+
+    // Node handles, see NodeHandle
+    using typename base_type::node_type;
+    using typename base_type::insert_return_type;
+
+    using base_type::begin;
+    using base_type::end;
+
+    // Fake node connects first, last and root
+    using BaseNode = nodes::BaseNode<nodes::DefaultNode<T, Augment>>;
+
+    // Modified functions, all of them splay the searched value to the root
+    template <LookupKey<T, Compare> Key = T>
+    iterator find(const Key& key) {
+        Slot slot = splay_to_root(key);
+        if (slot.node != &sentinel_node && slot.order == 0) {
+            return iterator(slot.node, *this);
+        }
+        return end();
+    }
+
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args) {
+        Node* new_node = create_node(
+            &sentinel_node, &sentinel_node, &sentinel_node,
+            std::forward<Args>(args)...
+        );
+
+        auto [ptr, is_inserted] = attach_node(new_node);
+        if (!is_inserted) {
+            destroy_node(new_node);
+        }
+        return std::make_pair(iterator(ptr, *this), is_inserted);
+    }
+
+    // The hint is not needed: the last element touched is at the root, so
+    // appending after it already costs O(1), and everything else splays
+    template <typename... Args>
+    iterator emplace_hint(const_iterator, Args&&... args) {
+        return emplace(std::forward<Args>(args)...).first;
+    }
+
+    // Searches first and builds the T only if key is missing, see
+    // BinaryTree::try_emplace
+    template <LookupKey<T, Compare> Key = T, typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args) {
+        Slot slot = splay_to_root(key);
+        if (slot.node != &sentinel_node && slot.order == 0) {
+            return std::make_pair(iterator(slot.node, *this), false);
+        }
+
+        Node* new_node;
+        if constexpr (sizeof...(Args) == 0) {
+            new_node = create_node(&sentinel_node, &sentinel_node,
+                                   &sentinel_node, key);
+        } else {
+            new_node = create_node(&sentinel_node, &sentinel_node,
+                                   &sentinel_node, std::forward<Args>(args)...);
+        }
+        link_above_root(slot, new_node);
+        return std::make_pair(iterator(new_node, *this), true);
+    }
+
+    std::pair<iterator, bool> insert(const T& value) {
+        return try_emplace(value);
+    }
+
+    std::pair<iterator, bool> insert(T&& value) {
+        return try_emplace(value, std::move(value));
+    }
+
+    template <LookupKey<T, Compare> Key = T>
+    bool erase(const Key& key) {
+        Slot slot = splay_to_root(key);
+        if (slot.node == &sentinel_node || slot.order != 0) {
+            return false;
+        }
+
+        remove_root();
+        destroy_node(slot.node->as_derived());
+        return true;
+    }
+
+    // Both splay the extracted element to the root first
+    template <LookupKey<T, Compare> Key = T>
+            requires (!base_type::template is_position<Key>)
+    node_type extract(const Key& key) {
+        iterator it = find(key);
+        return extract(it);
+    }
+
+    node_type extract(const_iterator position) {
+        return base_type::extract_handle(position, [this](BaseNode* node) {
+            splay_to_root(node->as_derived()->value);
+            remove_root();
+        });
+    }
+
+    insert_return_type insert(node_type&& handle) {
+        return base_type::insert_handle(std::move(handle), [this](Node* node) {
+            return attach_node(node);
+        });
+    }
+
+    void merge(SplayTree& other) {
+        base_type::merge_from(*this, other);
+    }
+
+private:
+    // Splays new_node's value to the root and makes new_node the root
+    // above it, unless the value is there already
+    std::pair<BaseNode*, bool> attach_node(Node* new_node) {
+        Slot slot = splay_to_root(new_node->value);
+        if (slot.node != &sentinel_node && slot.order == 0) {
+            return std::make_pair(slot.node, false);
+        }
+
+        link_above_root(slot, new_node);
+        return std::make_pair(new_node, true);
+    }
+
+    // Splays key, or the last node its search reaches, to the root and
+    // tells how key orders against it
+    template <typename Key>
+    Slot splay_to_root(const Key& key) {
+        if (sentinel_node.parent == &sentinel_node) {
+            return Slot{&sentinel_node, std::weak_ordering::less};
+        }
+
+        Slot slot = splay(sentinel_node.parent, lookup_key(key));
+        set_root(slot.node);
+        return slot;
+    }
+
+    // Makes new_node the root, the old root, which slot describes, and the
+    // side of it new_node's value falls on becoming its children
+    void link_above_root(const Slot& slot, Node* new_node) {
+        if (slot.node == &sentinel_node) {
+            update_augment(new_node);
+            sentinel_node.left = sentinel_node.right
+                = sentinel_node.parent = new_node;
+            return;
+        }
+
+        BaseNode* root = slot.node;
+        if (slot.order < 0) {
+            link(new_node, root->left, root);
+            root->left = &sentinel_node;
+        } else {
+            link(new_node, root, root->right);
+            root->right = &sentinel_node;
+        }
+        update_augment(root);
+        update_augment(new_node);
+        set_root(new_node);
+
+        if (new_node->left == &sentinel_node) {
+            sentinel_node.left = new_node;
+        }
+        if (new_node->right == &sentinel_node) {
+            sentinel_node.right = new_node;
+        }
+    }
+
+    // Unlinks the root, which the caller has just splayed there
+    void remove_root() {
+        BaseNode* root = sentinel_node.parent;
+        const T& value = root->as_derived()->value;
+
+        // Every key on the left is smaller, so splaying value there brings
+        // up its maximum, which has no right child to lose
+        BaseNode* new_root = root->right;
+        if (root->left != &sentinel_node) {
+            new_root = splay(root->left, value).node;
+            new_root->right = root->right;
+            if (root->right != &sentinel_node) {
+                root->right->parent = new_root;
+            }
+            update_augment(new_root);
+        }
+        set_root(new_root);
+
+        if (sentinel_node.left == root) {
+            sentinel_node.left = (new_root != &sentinel_node)
+                ? leftmost(new_root) : &sentinel_node;
+        }
+        if (sentinel_node.right == root) {
+            sentinel_node.right = (new_root != &sentinel_node)
+                ? rightmost(new_root) : &sentinel_node;
+        }
+    }
+
+    // Top-down splay: walks down from subtree root t, hanging the nodes it
+    // passes on the right spine of a left tree and the left spine of a right
+    // tree, then reassembles them under the last node reached. Returns the
+    // new subtree root, whose parent link is left for the caller to set,
+    // with the order of key against it. One three-way comparison per step
+    // picks the direction.
+    template <typename Key>
+    Slot splay(BaseNode* t, const Key& key) {
+        BaseNode header(&sentinel_node, &sentinel_node, &sentinel_node);
+        BaseNode* left_max = &header;
+        BaseNode* right_min = &header;
+
+        std::weak_ordering order = std::weak_ordering::equivalent;
+        while (true) {
+            order = compare(key, t->as_derived()->value);
+            if (order < 0) {
+                if (t->left == &sentinel_node) {
+                    break;
+                }
+                if (comp(key, t->left->as_derived()->value)) {
+                    t = rotate_right(t);
+                    if (t->left == &sentinel_node) {
+                        break;
+                    }
+                }
+                right_min->left = t;
+                t->parent = right_min;
+                right_min = t;
+                t = t->left;
+            } else if (order > 0) {
+                if (t->right == &sentinel_node) {
+                    break;
+                }
+                if (comp(t->right->as_derived()->value, key)) {
+                    t = rotate_left(t);
+                    if (t->right == &sentinel_node) {
+                        break;
+                    }
+                }
+                left_max->right = t;
+                t->parent = left_max;
+                left_max = t;
+                t = t->right;
+            } else {
+                break;
+            }
+        }
+
+        left_max->right = t->left;
+        if (t->left != &sentinel_node) {
+            t->left->parent = left_max;
+        }
+        right_min->left = t->right;
+        if (t->right != &sentinel_node) {
+            t->right->parent = right_min;
+        }
+
+        // The spines are the only nodes whose subtrees changed
+        update_spine(left_max, &header);
+        update_spine(right_min, &header);
+
+        link(t, header.right, header.left);
+        update_augment(t);
+        return Slot{t, order};
+    }
+
+    // Rotates t's left child up and returns it
+    BaseNode* rotate_right(BaseNode* t) {
+        this->instrument.on_rotation();
+        BaseNode* y = t->left;
+        t->left = y->right;
+        if (y->right != &sentinel_node) {
+            y->right->parent = t;
+        }
+        y->right = t;
+        t->parent = y;
+        update_augment(t);
+        return y;
+    }
+
+    // Rotates t's right child up and returns it
+    BaseNode* rotate_left(BaseNode* t) {
+        this->instrument.on_rotation();
+        BaseNode* y = t->right;
+        t->right = y->left;
+        if (y->left != &sentinel_node) {
+            y->left->parent = t;
+        }
+        y->left = t;
+        t->parent = y;
+        update_augment(t);
+        return y;
+    }
+
+    void update_spine(BaseNode* node, const BaseNode* header) {
+        if constexpr (base_type::is_augmented) {
+            while (node != header) {
+                update_augment(node);
+                node = node->parent;
+            }
+        }
+    }
+
+    void link(BaseNode* node, BaseNode* left, BaseNode* right) {
+        node->left = left;
+        node->right = right;
+        if (left != &sentinel_node) {
+            left->parent = node;
+        }
+        if (right != &sentinel_node) {
+            right->parent = node;
+        }
+    }
+
+    void set_root(BaseNode* root) {
+        sentinel_node.parent = root;
+        if (root != &sentinel_node) {
+            root->parent = &sentinel_node;
+        }
+    }
+};
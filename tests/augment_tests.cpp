@@ -0,0 +1,192 @@
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+
+#include "../avl-tree.h"
+#include "../binary-tree.h"
+#include "../rb-tree.h"
+#include "../splay-tree.h"
+#include "../treap.h"
+#include "check.h"
+
+// Usage: augment_tests [seed]
+//
+// Checks what the augmentations keep per subtree against a std::set after
+// random changes to the tree: size, nth, rank and iterator arithmetic, and
+// aggregate(lo, hi) against a fold over the std::set.
+
+template <template <typename, typename, typename, typename, typename> typename Tree,
+          typename Augment>
+using AugmentedTree = Tree<int, std::allocator<int>, Augment, instruments::none, std::less<int>>;
+
+template <typename Augment>
+using NaiveTree = BinaryTree<int, nodes::DefaultNode<int, Augment>, std::allocator<int>>;
+
+// One random insert, erase or node handle round trip, mirrored in model
+template <typename Tree>
+void mutate(Tree& tree, std::set<int>& model, std::mt19937& rng, const std::string& name) {
+    std::uniform_int_distribution<int> key(0, 1999);
+    int value = key(rng);
+    switch (rng() % 4) {
+    case 0:
+    case 1:
+        check(tree.insert(value).second == model.insert(value).second, name + ": insert");
+        break;
+    case 2:
+        check(tree.erase(value) == (model.erase(value) == 1), name + ": erase");
+        break;
+    case 3: {
+        auto handle = tree.extract(value);
+        if (!handle.empty()) {
+            model.erase(value);
+            handle.value() = key(rng);
+            int moved = handle.value();
+            check(tree.insert(std::move(handle)).inserted == model.insert(moved).second,
+                  name + ": insert(node)");
+        }
+        break;
+    }
+    }
+}
+
+// Polynomial hash of the values in order. It does not commute, so a range
+// combined out of order, or a summary left stale by a rotation, shows.
+struct sequence_hash {
+    // Hash and the multiplier to the power of the number of values
+    using value_type = std::pair<std::uint64_t, std::uint64_t>;
+    static constexpr std::uint64_t multiplier = 1000003;
+
+    static value_type lift(int value) noexcept {
+        return value_type(static_cast<std::uint64_t>(value) + 1, multiplier);
+    }
+
+    static value_type combine(const value_type& lhs, const value_type& rhs) noexcept {
+        return value_type(lhs.first * rhs.second + rhs.first, lhs.second * rhs.second);
+    }
+
+    static value_type identity() noexcept {
+        return value_type(0, 1);
+    }
+};
+
+// Every few steps aggregate(lo, hi) must equal the augment's own fold over
+// model's values in [lo, hi), for ranges inside, across and outside the keys
+template <typename Tree, typename Augment>
+void test_aggregate(const std::string& name, std::mt19937& rng) {
+    Tree tree;
+    std::set<int> model;
+    std::uniform_int_distribution<int> key(-10, 2010);
+
+    auto fold = [&](int lo, int hi) {
+        auto expected = Augment::identity();
+        for (auto it = model.lower_bound(lo); it != model.end() && *it < hi; ++it) {
+            expected = Augment::combine(expected, Augment::lift(*it));
+        }
+        return expected;
+    };
+
+    for (int step = 0; step < 6000; ++step) {
+        mutate(tree, model, rng, name);
+        // Splay trees also reshape on lookups
+        tree.find(key(rng));
+
+        if (step % 3 == 0) {
+            int lo = key(rng);
+            int hi = key(rng);
+            check(tree.aggregate(lo, hi) == fold(lo, hi), name + ": aggregate");
+            check(tree.aggregate(hi, lo) == fold(hi, lo), name + ": aggregate");
+            check(tree.aggregate(lo, lo) == Augment::identity(), name + ": empty aggregate");
+        }
+        if (step % 500 == 0) {
+            check(tree.aggregate(-10, 2010) == fold(-10, 2010), name + ": whole aggregate");
+        }
+    }
+
+    // Copies carry the summaries over
+    Tree copy = tree;
+    check(copy.aggregate(-10, 2010) == fold(-10, 2010), name + ": aggregate of a copy");
+    check(copy.aggregate(500, 1500) == fold(500, 1500), name + ": aggregate of a copy");
+}
+
+template <template <typename, typename, typename, typename, typename> typename Tree>
+void test_aggregates(const std::string& name, std::mt19937& rng) {
+    using augments::both;
+    using augments::subtree_size;
+    test_aggregate<AugmentedTree<Tree, augments::sum<long>>, augments::sum<long>>(
+        name + " sum", rng);
+    test_aggregate<AugmentedTree<Tree, augments::min<int>>, augments::min<int>>(
+        name + " min", rng);
+    test_aggregate<AugmentedTree<Tree, augments::max<int>>, augments::max<int>>(
+        name + " max", rng);
+    test_aggregate<AugmentedTree<Tree, both<subtree_size, sequence_hash>>,
+                   both<subtree_size, sequence_hash>>(name + " size and hash", rng);
+    test_aggregate<AugmentedTree<Tree, both<augments::min<int>, augments::max<int>>>,
+                   both<augments::min<int>, augments::max<int>>>(name + " min and max", rng);
+}
+
+template <typename Tree>
+void test_order_statistics(const std::string& name, std::mt19937& rng) {
+    Tree tree;
+    std::set<int> model;
+    std::uniform_int_distribution<int> key(-10, 2010);
+
+    for (int step = 0; step < 6000; ++step) {
+        mutate(tree, model, rng, name);
+        check(tree.size() == model.size(), name + ": size");
+
+        if (step % 10 == 0) {
+            size_t index = 0;
+            for (auto expected = model.begin(); expected != model.end(); ++expected, ++index) {
+                check(*tree.nth(index) == *expected, name + ": nth");
+            }
+            check(tree.nth(model.size()) == tree.end(), name + ": nth past the end");
+        }
+
+        int value = key(rng);
+        auto rank = static_cast<size_t>(
+            std::distance(model.begin(), model.lower_bound(value)));
+        check(tree.rank(value) == rank, name + ": rank");
+
+        // Forward and back from an element, and back from end()
+        if (!model.empty()) {
+            std::uniform_int_distribution<size_t> position(0, model.size() - 1);
+            size_t from = position(rng);
+            size_t to = position(rng);
+            auto it = tree.nth(from);
+            it += static_cast<std::ptrdiff_t>(to) - static_cast<std::ptrdiff_t>(from);
+            check(*it == *std::next(model.begin(), to), name + ": operator+=");
+            check(*(tree.nth(from) + 0) == *std::next(model.begin(), from),
+                  name + ": operator+ 0");
+            auto back = tree.end();
+            back += -static_cast<std::ptrdiff_t>(model.size() - to);
+            check(*back == *std::next(model.begin(), to), name + ": operator+= from end");
+            check(tree.nth(from) + static_cast<std::ptrdiff_t>(model.size() - from)
+                      == tree.end(),
+                  name + ": operator+ to end");
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::mt19937 rng(read_seed(argc, argv));
+
+    using augments::subtree_size;
+    test_order_statistics<NaiveTree<subtree_size>>("naive", rng);
+    test_order_statistics<AugmentedTree<AVLTree, subtree_size>>("avl", rng);
+    test_order_statistics<AugmentedTree<RBTree, subtree_size>>("rb", rng);
+    test_order_statistics<AugmentedTree<Treap, subtree_size>>("treap", rng);
+    test_order_statistics<AugmentedTree<SplayTree, subtree_size>>("splay", rng);
+    test_order_statistics<AugmentedTree<AVLTree,
+        augments::both<subtree_size, augments::sum<long>>>>("avl with sums", rng);
+
+    test_aggregates<AVLTree>("avl", rng);
+    test_aggregates<RBTree>("rb", rng);
+    test_aggregates<Treap>("treap", rng);
+    test_aggregates<SplayTree>("splay", rng);
+
+    std::cout << "OK" << std::endl;
+}
@@ -0,0 +1,321 @@
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../avl-tree.h"
+#include "../pool-allocator.h"
+#include "../rb-tree.h"
+#include "../splay-tree.h"
+#include "../treap.h"
+#include "check.h"
+
+// Usage: batch_tests [seed]
+//
+// Checks operations on many elements at once against std::set: Treap range
+// queries and cuts, Treap set algebra, the batch inserts and erases of
+// Treap and AVLTree, and find_many. Elements that survive an operation must keep their
+// node, so their addresses are checked as well.
+
+std::vector<int> random_keys(std::mt19937& rng, size_t count, int range) {
+    std::uniform_int_distribution<int> key(0, range - 1);
+    std::vector<int> keys(count);
+    for (int& value : keys) {
+        value = key(rng);
+    }
+    return keys;
+}
+
+template <typename Tree>
+std::map<int, const int*> addresses(const Tree& tree) {
+    std::map<int, const int*> result;
+    for (const int& value : tree) {
+        result.emplace(value, &value);
+    }
+    return result;
+}
+
+template <typename Tree>
+void check_kept(const Tree& tree, const std::map<int, const int*>& before,
+                const std::string& name) {
+    for (const int& value : tree) {
+        auto it = before.find(value);
+        check(it == before.end() || it->second == &value, name + ": node replaced");
+    }
+}
+
+template <typename Iterator, typename ModelIterator>
+void check_position(const Treap<int>& treap, Iterator it, const std::set<int>& model,
+                    ModelIterator expected, const std::string& name) {
+    check((it == treap.end()) == (expected == model.end()), name);
+    check(it == treap.end() || *it == *expected, name);
+}
+
+void test_ranges(std::mt19937& rng) {
+    std::uniform_int_distribution<int> key(-10, 5010);
+    for (int round = 0; round < 50; ++round) {
+        std::vector<int> keys = random_keys(rng, round < 2 ? round : 3000, 5000);
+        std::set<int> model(keys.begin(), keys.end());
+        Treap<int> treap(keys.begin(), keys.end());
+
+        for (int i = 0; i < 200; ++i) {
+            int value = key(rng);
+            check_position(treap, treap.lower_bound(value), model, model.lower_bound(value),
+                           "lower_bound");
+            check_position(treap, treap.upper_bound(value), model, model.upper_bound(value),
+                           "upper_bound");
+            auto [first, last] = treap.equal_range(value);
+            auto [expected_first, expected_last] = model.equal_range(value);
+            check_position(treap, first, model, expected_first, "equal_range");
+            check_position(treap, last, model, expected_last, "equal_range");
+        }
+
+        int lo = key(rng);
+        int hi = key(rng);
+        if (hi < lo) {
+            std::swap(lo, hi);
+        }
+        std::set<int> cut(model.lower_bound(lo), model.lower_bound(hi));
+        for (int value : cut) {
+            model.erase(value);
+        }
+
+        auto before = addresses(treap);
+        if (round % 2 == 0) {
+            check(treap.erase_range(lo, hi) == cut.size(), "erase_range count");
+        } else {
+            Treap<int> extracted = treap.extract_range(lo, hi);
+            check_same(extracted, cut, "extract_range result");
+            check_kept(extracted, before, "extract_range result");
+            // The cut-out part is a treap of its own
+            check(extracted.insert(hi).second, "insert into extracted range");
+            check(extracted.erase(hi), "erase from extracted range");
+        }
+        check_same(treap, model, "range remainder");
+        check_kept(treap, before, "range remainder");
+
+        // An empty range removes nothing
+        check(treap.erase_range(hi, hi) == 0, "empty erase_range");
+        check_same(treap, model, "empty erase_range");
+        for (int value : keys) {
+            check(treap.insert(value).second == model.insert(value).second,
+                  "insert after a cut");
+        }
+        check_same(treap, model, "insert after a cut");
+    }
+}
+
+template <typename Operation, typename ModelOperation>
+void check_set_operation(const std::vector<int>& left, const std::vector<int>& right,
+                         Operation operation, ModelOperation model_operation,
+                         const std::string& name) {
+    std::set<int> left_model(left.begin(), left.end());
+    std::set<int> right_model(right.begin(), right.end());
+    std::set<int> expected;
+    model_operation(left_model.begin(), left_model.end(),
+                    right_model.begin(), right_model.end(),
+                    std::inserter(expected, expected.end()));
+
+    // Consuming the other treap
+    Treap<int> treap(left.begin(), left.end());
+    auto before = addresses(treap);
+    operation(treap, Treap<int>(right.begin(), right.end()));
+    check_same(treap, expected, name);
+    check_kept(treap, before, name);
+
+    // Copying from a const one, which stays as it was
+    treap = Treap<int>(left.begin(), left.end());
+    before = addresses(treap);
+    const Treap<int> other(right.begin(), right.end());
+    operation(treap, other);
+    check_same(treap, expected, name + " const");
+    check_kept(treap, before, name + " const");
+    check_same(other, right_model, name + " const: argument");
+
+    // Still a working treap afterwards
+    for (int value : right) {
+        check(treap.insert(value).second == expected.insert(value).second,
+              name + ": insert afterwards");
+    }
+    check_same(treap, expected, name + ": insert afterwards");
+}
+
+void test_set_algebra(std::mt19937& rng, size_t size, int range) {
+    std::uniform_int_distribution<size_t> other_size(0, size);
+    for (int round = 0; round < 3; ++round) {
+        std::vector<int> left = random_keys(rng, size, range);
+        std::vector<int> right = random_keys(rng, other_size(rng), range);
+        if (round == 0) {
+            right.clear();
+        }
+
+        check_set_operation(left, right,
+            [](Treap<int>& lhs, auto&& rhs) { lhs.union_with(std::forward<decltype(rhs)>(rhs)); },
+            [](auto... args) { std::set_union(args...); }, "union_with");
+        check_set_operation(left, right,
+            [](Treap<int>& lhs, auto&& rhs) {
+                lhs.intersect_with(std::forward<decltype(rhs)>(rhs));
+            },
+            [](auto... args) { std::set_intersection(args...); }, "intersect_with");
+        check_set_operation(left, right,
+            [](Treap<int>& lhs, auto&& rhs) {
+                lhs.difference_with(std::forward<decltype(rhs)>(rhs));
+            },
+            [](auto... args) { std::set_difference(args...); }, "difference_with");
+        check_set_operation(right, left,
+            [](Treap<int>& lhs, auto&& rhs) { lhs.union_with(std::forward<decltype(rhs)>(rhs)); },
+            [](auto... args) { std::set_union(args...); }, "union_with, smaller side first");
+    }
+}
+
+// A treap sharing this one's pool hands its nodes over as they are
+void test_pooled_set_algebra(std::mt19937& rng) {
+    using PooledTreap = Treap<int, PoolAllocator<int>>;
+    std::vector<int> keys = random_keys(rng, 5000, 10000);
+    std::set<int> model(keys.begin(), keys.end());
+    PooledTreap treap(keys.begin(), keys.end());
+
+    PooledTreap part = treap.extract_range(2000, 6000);
+    auto before = addresses(treap);
+    auto part_before = addresses(part);
+    treap.union_with(std::move(part));
+    check_same(treap, model, "pooled union_with");
+    check_kept(treap, before, "pooled union_with");
+    check_kept(treap, part_before, "pooled union_with adopts the other pool's nodes");
+}
+
+template <typename Tree>
+void test_batches(const std::string& name, std::mt19937& rng) {
+    Tree tree;
+    std::set<int> model;
+    std::uniform_int_distribution<size_t> batch_size(0, 3000);
+
+    for (int round = 0; round < 80; ++round) {
+        // Small batches into a large tree take the one-by-one path, large
+        // ones the rebuild
+        std::vector<int> batch = random_keys(rng, round % 4 == 0 ? batch_size(rng)
+                                                                  : batch_size(rng) / 100,
+                                             20000);
+        auto before = addresses(tree);
+        if (rng() % 3 != 0) {
+            size_t inserted = 0;
+            for (int value : batch) {
+                inserted += model.insert(value).second;
+            }
+            check(tree.insert_batch(batch) == inserted, name + ": insert_batch count");
+        } else {
+            size_t erased = 0;
+            for (int value : batch) {
+                erased += model.erase(value);
+            }
+            check(tree.erase_batch(batch) == erased, name + ": erase_batch count");
+        }
+        check_same(tree, model, name + ": batch");
+        check_kept(tree, before, name + ": batch");
+    }
+}
+
+// Below the rebuild threshold each key of a sorted batch is searched from
+// the one before, so a run of neighbouring keys costs far less than one
+// search from the root per key
+void test_avl_batch_fingers() {
+    AVLTree<int, std::allocator<int>, augments::none, instruments::counters> tree;
+    std::vector<int> even;
+    for (int value = 0; value < 200000; value += 2) {
+        even.push_back(value);
+    }
+    tree.assign(even.begin(), even.end());
+
+    std::vector<int> odd;
+    for (int value = 100001; value < 100200; value += 2) {
+        odd.push_back(value);
+    }
+    tree.instrumentation().reset();
+    check(tree.insert_batch(odd) == odd.size(), "avl: finger insert_batch count");
+    size_t insert_comparisons = tree.instrumentation().comparisons;
+    tree.instrumentation().reset();
+    check(tree.erase_batch(odd) == odd.size(), "avl: finger erase_batch count");
+    size_t erase_comparisons = tree.instrumentation().comparisons;
+
+    // From the root, 100 searches in a tree 17 levels high take over 1700
+    check(insert_comparisons < 100 * 8, "avl: insert_batch searches from the root");
+    check(erase_comparisons < 100 * 8, "avl: erase_batch searches from the root");
+    check_same(tree, std::set<int>(even.begin(), even.end()), "avl: finger batches");
+}
+
+// Batches shorter than, as long as and longer than the 16 searches
+// find_many keeps in flight, with hits, misses and repeated keys
+template <typename Tree>
+void test_find_many(const std::string& name, std::mt19937& rng) {
+    std::vector<int> keys = random_keys(rng, 3000, 4000);
+    Tree tree;
+    for (int value : keys) {
+        tree.insert(value);
+    }
+    std::set<int> model(keys.begin(), keys.end());
+    Tree empty;
+
+    for (size_t size : {0, 1, 2, 15, 16, 17, 31, 32, 33, 100, 5000}) {
+        std::vector<int> batch = random_keys(rng, size, 4200);
+        if (size > 2) {
+            batch[size / 2] = batch[0];
+            batch[size - 1] = batch[0];
+        }
+        std::string sized = name + ": find_many of " + std::to_string(size);
+
+        // Slots past the batch are left alone
+        std::vector<typename Tree::iterator> out(size + 3, tree.begin());
+        tree.find_many(batch, out);
+        for (size_t i = 0; i < size; ++i) {
+            bool found = out[i] != tree.end();
+            check(found == model.contains(batch[i]), sized);
+            check(!found || *out[i] == batch[i], sized);
+        }
+        for (size_t i = size; i < out.size(); ++i) {
+            check(out[i] == tree.begin(), sized + ": past the batch");
+        }
+
+        std::vector<typename Tree::iterator> none(size);
+        empty.find_many(batch, none);
+        for (auto it : none) {
+            check(it == empty.end(), sized + ": in an empty tree");
+        }
+
+        if (size > 0) {
+            std::vector<typename Tree::iterator> short_out(size - 1);
+            bool thrown = false;
+            try {
+                tree.find_many(batch, short_out);
+            } catch (const std::invalid_argument&) {
+                thrown = true;
+            }
+            check(thrown, sized + ": out shorter than keys");
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::mt19937 rng(read_seed(argc, argv));
+
+    test_ranges(rng);
+
+    test_set_algebra(rng, 2000, 3000);
+    // Above Treap's parallel cutoff
+    test_set_algebra(rng, 100000, 150000);
+    test_pooled_set_algebra(rng);
+
+    test_batches<Treap<int>>("treap", rng);
+    test_batches<AVLTree<int>>("avl", rng);
+    test_avl_batch_fingers();
+
+    test_find_many<AVLTree<int>>("avl", rng);
+    test_find_many<RBTree<int>>("rb", rng);
+    test_find_many<Treap<int>>("treap", rng);
+    test_find_many<SplayTree<int>>("splay", rng);
+
+    std::cout << "OK" << std::endl;
+}
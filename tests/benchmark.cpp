@@ -0,0 +1,256 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../avl-tree.h"
+#include "../binary-tree.h"
+#include "../bplus-tree.h"
+#include "../compact-treap.h"
+#include "../persistent-treap.h"
+#include "../rb-tree.h"
+#include "../splay-tree.h"
+#include "../treap.h"
+#include "timer.h"
+
+// Usage: benchmark [size...]
+//
+// Runs every tree over every key distribution and prints one CSV row per
+// (tree, distribution, size, operation) to stdout, see plots.py.
+
+// Live and peak bytes requested through CountingAllocator
+struct MemoryCounter {
+    static inline size_t current = 0;
+    static inline size_t peak = 0;
+
+    static void reset() {
+        current = peak = 0;
+    }
+};
+
+template <typename T>
+class CountingAllocator {
+public:
+    using value_type = T;
+
+    CountingAllocator() = default;
+
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        MemoryCounter::current += n * sizeof(T);
+        MemoryCounter::peak = std::max(MemoryCounter::peak, MemoryCounter::current);
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* ptr, size_t n) noexcept {
+        MemoryCounter::current -= n * sizeof(T);
+        std::allocator<T>().deallocate(ptr, n);
+    }
+
+    template <typename U>
+    bool operator==(const CountingAllocator<U>&) const noexcept {
+        return true;
+    }
+};
+
+// Zipf over ranks [0, n) with exponent s, sampled by inverting the CDF
+class ZipfDistribution {
+    std::vector<double> cdf;
+
+public:
+    ZipfDistribution(size_t n, double s) : cdf(n) {
+        double sum = 0;
+        for (size_t i = 0; i < n; i++) {
+            sum += 1.0 / std::pow(static_cast<double>(i + 1), s);
+            cdf[i] = sum;
+        }
+        for (double& value : cdf) {
+            value /= sum;
+        }
+    }
+
+    template <typename Rng>
+    size_t operator()(Rng& rng) {
+        double u = std::uniform_real_distribution<double>(0, 1)(rng);
+        return std::min<size_t>(
+            std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin(),
+            cdf.size() - 1
+        );
+    }
+};
+
+// Keys for each phase: n inserts, n lookups, then erasing what was inserted
+struct Workload {
+    std::vector<int> inserts;
+    std::vector<int> lookups;
+    std::vector<int> erases;
+};
+
+const std::vector<std::string> distributions = {
+    "uniform", "sequential", "zipf", "sorted"
+};
+
+// uniform:    random keys, random lookups
+// sequential: 0, 1, ..., n - 1, random lookups
+// zipf:       keys and lookups drawn with Zipf(0.99) popularity over n
+//             shuffled keys, so hot keys are spread over the key space
+// sorted:     random keys inserted, looked up and erased in ascending order
+Workload make_workload(const std::string& distribution, size_t n,
+                       std::mt19937_64& rng) {
+    std::uniform_int_distribution<int> any_key(0, std::numeric_limits<int>::max());
+    Workload workload;
+    workload.inserts.resize(n);
+
+    if (distribution == "uniform" || distribution == "sorted") {
+        for (int& key : workload.inserts) {
+            key = any_key(rng);
+        }
+    } else if (distribution == "sequential") {
+        std::iota(workload.inserts.begin(), workload.inserts.end(), 0);
+    } else {
+        std::vector<int> keys(n);
+        for (int& key : keys) {
+            key = any_key(rng);
+        }
+        ZipfDistribution zipf(n, 0.99);
+        for (int& key : workload.inserts) {
+            key = keys[zipf(rng)];
+        }
+        workload.lookups.resize(n);
+        for (int& key : workload.lookups) {
+            key = keys[zipf(rng)];
+        }
+    }
+
+    if (distribution == "sorted") {
+        std::sort(workload.inserts.begin(), workload.inserts.end());
+        workload.lookups = workload.inserts;
+    } else if (workload.lookups.empty()) {
+        workload.lookups = workload.inserts;
+        std::shuffle(workload.lookups.begin(), workload.lookups.end(), rng);
+    }
+    workload.erases = workload.inserts;
+    return workload;
+}
+
+// Throughput comes from timing the whole phase, latencies from a second
+// run timing each operation, so the per-call timer does not skew the former
+template <typename Tree>
+void run(const std::string& tree_name, const std::string& distribution,
+         const Workload& workload) {
+    size_t n = workload.inserts.size();
+    size_t sink = 0;
+
+    std::vector<double> ops_per_second;
+    MemoryCounter::reset();
+    {
+        Tree tree;
+        auto measure = [&](const std::vector<int>& keys, auto&& operation) {
+            auto begin = std::chrono::steady_clock::now();
+            for (int key : keys) {
+                operation(key);
+            }
+            std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - begin;
+            ops_per_second.push_back(keys.size() / std::max(elapsed.count(), 1e-9));
+        };
+
+        measure(workload.inserts, [&](int key) { sink += tree.insert(key).second; });
+        measure(workload.lookups, [&](int key) { sink += tree.find(key) != tree.end(); });
+        measure(workload.erases, [&](int key) { sink += tree.erase(key); });
+    }
+    size_t peak_bytes = MemoryCounter::peak;
+
+    std::vector<std::vector<long long>> latencies;
+    {
+        Tree tree;
+        Timer timer;
+        auto measure = [&](const std::vector<int>& keys, auto&& operation) {
+            std::vector<long long> phase;
+            phase.reserve(keys.size());
+            for (int key : keys) {
+                timer.start();
+                operation(key);
+                phase.push_back(timer.get_elapsed<std::chrono::nanoseconds>());
+            }
+            std::sort(phase.begin(), phase.end());
+            latencies.push_back(std::move(phase));
+        };
+
+        measure(workload.inserts, [&](int key) { sink += tree.insert(key).second; });
+        measure(workload.lookups, [&](int key) { sink += tree.find(key) != tree.end(); });
+        measure(workload.erases, [&](int key) { sink += tree.erase(key); });
+    }
+
+    const char* operations[] = {"insert", "find", "erase"};
+    for (size_t i = 0; i < 3; i++) {
+        const std::vector<long long>& sorted = latencies[i];
+        auto percentile = [&](double p) {
+            return sorted.empty() ? 0 : sorted[static_cast<size_t>(p * (sorted.size() - 1))];
+        };
+
+        std::cout << tree_name << ',' << distribution << ',' << n << ','
+                  << operations[i] << ',' << static_cast<long long>(ops_per_second[i]) << ','
+                  << percentile(0.5) << ',' << percentile(0.9) << ','
+                  << percentile(0.99) << ',' << percentile(0.999) << ','
+                  << peak_bytes << '\n';
+    }
+
+    // Keeps the operations from being optimized away
+    if (sink == std::numeric_limits<size_t>::max()) {
+        std::cerr << sink;
+    }
+}
+
+// The naive tree degenerates into a list on ordered input, which makes
+// large ordered runs quadratic
+constexpr size_t naive_ordered_limit = 1 << 14;
+
+int main(int argc, char* argv[]) {
+    std::vector<size_t> sizes;
+    for (int i = 1; i < argc; i++) {
+        sizes.push_back(std::strtoull(argv[i], nullptr, 10));
+    }
+    if (sizes.empty()) {
+        sizes = {1 << 10, 1 << 14, 1 << 17};
+    }
+
+    using Allocator = CountingAllocator<int>;
+    std::mt19937_64 rng(std::chrono::steady_clock::now().time_since_epoch().count());
+
+    std::cout << "tree,distribution,size,operation,ops_per_second,"
+                 "p50_ns,p90_ns,p99_ns,p999_ns,peak_bytes\n";
+    for (const std::string& distribution : distributions) {
+        for (size_t n : sizes) {
+            Workload workload = make_workload(distribution, n, rng);
+
+            run<Treap<int, Allocator>>("treap", distribution, workload);
+            run<CompactTreap<int, Allocator>>("compact_treap", distribution, workload);
+            run<PersistentTreap<int, Allocator>>("persistent_treap", distribution, workload);
+            run<AVLTree<int, Allocator>>("avl", distribution, workload);
+            run<RBTree<int, Allocator>>("rb", distribution, workload);
+            run<SplayTree<int, Allocator>>("splay", distribution, workload);
+            run<BPlusTree<int, Allocator>>("bplus", distribution, workload);
+            run<std::set<int, std::less<int>, Allocator>>("std_set", distribution, workload);
+
+            bool is_ordered = distribution == "sequential" || distribution == "sorted";
+            if (is_ordered && n > naive_ordered_limit) {
+                std::cerr << "skipping naive on " << distribution
+                          << " with " << n << " keys\n";
+            } else {
+                run<BinaryTree<int, nodes::DefaultNode<int>, Allocator>>(
+                    "naive", distribution, workload
+                );
+            }
+        }
+    }
+}
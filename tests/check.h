@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+
+// Helpers shared by the *_tests.cpp programs, which exit with 1 at the
+// first failed check. Randomized ones take an optional seed as their first
+// argument.
+
+// The seed from the command line, or a random one; printed either way so a
+// failing run can be repeated
+inline unsigned read_seed(int argc, char* argv[]) {
+    unsigned seed = argc > 1 ? std::stoul(argv[1]) : std::random_device()();
+    std::cout << "seed " << seed << std::endl;
+    return seed;
+}
+
+inline void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << '\n';
+        std::exit(1);
+    }
+}
+
+// Same elements in the same order as the std::set kept alongside
+template <typename Tree, typename T, typename Compare>
+void check_same(const Tree& tree, const std::set<T, Compare>& model,
+                const std::string& name) {
+    auto expected = model.begin();
+    for (const auto& value : tree) {
+        check(expected != model.end() && value == *expected, name + ": contents");
+        ++expected;
+    }
+    check(expected == model.end(), name + ": contents");
+}
@@ -0,0 +1,263 @@
+#include <functional>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../avl-tree.h"
+#include "../compact-treap.h"
+#include "../rb-tree.h"
+#include "../splay-tree.h"
+#include "../treap.h"
+#include "check.h"
+
+// Usage: compare_tests [seed]
+//
+// Checks the Compare parameter: std::string trees under std::less<> searched
+// with std::string_view and const char* keys, a key type that counts its
+// constructions to show that transparent lookups and try_emplace on a hit
+// build no T, and std::greater trees next to a std::set ordered the same way.
+
+template <typename T, typename Compare>
+using AVL = AVLTree<T, std::allocator<T>, augments::none, instruments::none, Compare>;
+
+template <typename T, typename Compare>
+using RB = RBTree<T, std::allocator<T>, augments::none, instruments::none, Compare>;
+
+template <typename T, typename Compare>
+using TreapOf = Treap<T, std::allocator<T>, augments::none, instruments::none, Compare>;
+
+template <typename T, typename Compare>
+using Splay = SplayTree<T, std::allocator<T>, augments::none, instruments::none, Compare>;
+
+template <typename T, typename Compare>
+using Compact = CompactTreap<T, std::allocator<T>, Compare>;
+
+// Every constructor counts, so any T built along the way shows
+struct Counted {
+    static inline int constructed = 0;
+
+    int key;
+    std::string payload;
+
+    Counted(int key, std::string payload = "")
+            : key(key), payload(std::move(payload))
+    {
+        ++constructed;
+    }
+
+    Counted(const Counted& other)
+            : key(other.key), payload(other.payload)
+    {
+        ++constructed;
+    }
+
+    Counted(Counted&& other) noexcept
+            : key(other.key), payload(std::move(other.payload))
+    {
+        ++constructed;
+    }
+
+    Counted& operator=(const Counted&) = default;
+    Counted& operator=(Counted&&) noexcept = default;
+};
+
+// Orders Counted by key and lets int stand in for it
+struct ByKey {
+    using is_transparent = void;
+
+    bool operator()(const Counted& lhs, const Counted& rhs) const {
+        return lhs.key < rhs.key;
+    }
+
+    bool operator()(const Counted& lhs, int rhs) const {
+        return lhs.key < rhs;
+    }
+
+    bool operator()(int lhs, const Counted& rhs) const {
+        return lhs < rhs.key;
+    }
+};
+
+std::string random_word(std::mt19937& rng) {
+    std::string word(1 + rng() % 3, 'a');
+    for (char& letter : word) {
+        letter = static_cast<char>('a' + rng() % 4);
+    }
+    return word;
+}
+
+template <typename Iterator, typename ModelIterator, typename Model>
+void check_position(Iterator it, Iterator end, ModelIterator expected, const Model& model,
+                    const std::string& name) {
+    check((it == end) == (expected == model.end()), name);
+    check(it == end || *it == *expected, name);
+}
+
+// std::string keys looked up by std::string_view and const char*
+template <template <typename, typename> typename Tree>
+void test_string_keys(const std::string& name, std::mt19937& rng) {
+    Tree<std::string, std::less<>> tree;
+    std::set<std::string, std::less<>> model;
+
+    for (int step = 0; step < 20000; ++step) {
+        std::string word = random_word(rng);
+        std::string_view view = word;
+        const char* chars = word.c_str();
+        switch (rng() % 6) {
+        case 0: {
+            auto [it, inserted] = tree.try_emplace(view);
+            check(inserted == model.insert(word).second, name + ": try_emplace");
+            check(*it == word, name + ": try_emplace position");
+            break;
+        }
+        case 1:
+            check(tree.erase(view) == (model.erase(word) == 1), name + ": erase");
+            break;
+        case 2: {
+            auto it = tree.find(chars);
+            check((it != tree.end()) == model.contains(word), name + ": find");
+            check(it == tree.end() || *it == word, name + ": find");
+            break;
+        }
+        case 3:
+            check_position(tree.lower_bound(view), tree.end(), model.lower_bound(view),
+                           model, name + ": lower_bound");
+            check_position(tree.upper_bound(chars), tree.end(), model.upper_bound(chars),
+                           model, name + ": upper_bound");
+            break;
+        case 4: {
+            auto [first, last] = tree.equal_range(view);
+            auto [expected_first, expected_last] = model.equal_range(view);
+            check_position(first, tree.end(), expected_first, model, name + ": equal_range");
+            check_position(last, tree.end(), expected_last, model, name + ": equal_range");
+            break;
+        }
+        case 5: {
+            // On a hit the arguments are left alone
+            std::string spare = word;
+            auto [it, inserted] = tree.try_emplace(view, std::move(spare));
+            check(inserted == model.insert(word).second, name + ": try_emplace with args");
+            check(*it == word, name + ": try_emplace with args position");
+            check(inserted || spare == word, name + ": try_emplace moved from args on a hit");
+            break;
+        }
+        }
+        if (step % 1000 == 0) {
+            check_same(tree, model, name);
+        }
+    }
+    check_same(tree, model, name);
+}
+
+// Transparent lookups and try_emplace on a hit construct no Counted
+template <template <typename, typename> typename Tree>
+void test_no_construction(const std::string& name) {
+    Tree<Counted, ByKey> tree;
+    for (int key = 0; key < 100; key += 2) {
+        tree.try_emplace(key);
+    }
+    int before = Counted::constructed;
+
+    for (int key = -1; key <= 100; ++key) {
+        auto it = tree.find(key);
+        check((it != tree.end()) == (key >= 0 && key < 100 && key % 2 == 0), name + ": find");
+        check(it == tree.end() || it->key == key, name + ": find");
+        auto lower = tree.lower_bound(key);
+        check(lower == tree.end() || lower->key >= key, name + ": lower_bound");
+        auto upper = tree.upper_bound(key);
+        check(upper == tree.end() || upper->key > key, name + ": upper_bound");
+        tree.equal_range(key);
+    }
+    check(!tree.erase(101) && !tree.erase(-1), name + ": erase a missing key");
+    check(Counted::constructed == before, name + ": lookups built a key");
+
+    for (int key = 0; key < 100; key += 2) {
+        std::string payload = "cold";
+        auto [it, inserted] = tree.try_emplace(key, key, std::move(payload));
+        check(!inserted && it->key == key, name + ": try_emplace on a hit");
+        check(payload == "cold", name + ": try_emplace moved from args on a hit");
+    }
+    check(Counted::constructed == before, name + ": try_emplace built a T on a hit");
+
+    // A miss builds exactly the one element it inserts
+    auto [it, inserted] = tree.try_emplace(51, 51, "new");
+    check(inserted && it->key == 51 && it->payload == "new", name + ": try_emplace on a miss");
+    check(Counted::constructed == before + 1, name + ": try_emplace on a miss");
+    check(tree.erase(51), name + ": erase by key");
+}
+
+// A comparator other than < next to a std::set using it too
+template <template <typename, typename> typename Tree>
+void test_greater(const std::string& name, std::mt19937& rng) {
+    using Greater = std::greater<int>;
+    Tree<int, Greater> tree;
+    std::set<int, Greater> model;
+    std::uniform_int_distribution<int> key(0, 999);
+
+    for (int step = 0; step < 20000; ++step) {
+        int value = key(rng);
+        switch (rng() % 4) {
+        case 0:
+            check(tree.insert(value).second == model.insert(value).second, name + ": insert");
+            break;
+        case 1:
+            check(tree.erase(value) == (model.erase(value) == 1), name + ": erase");
+            break;
+        case 2:
+            check_position(tree.lower_bound(value), tree.end(), model.lower_bound(value),
+                           model, name + ": lower_bound");
+            check_position(tree.upper_bound(value), tree.end(), model.upper_bound(value),
+                           model, name + ": upper_bound");
+            break;
+        case 3: {
+            auto it = tree.find(value);
+            check((it != tree.end()) == model.contains(value), name + ": find");
+            break;
+        }
+        }
+        if (step % 1000 == 0) {
+            check_same(tree, model, name);
+        }
+    }
+    check_same(tree, model, name);
+
+    // assign sorts and deduplicates under the comparator too
+    std::vector<int> values;
+    for (int i = 0; i < 500; ++i) {
+        values.push_back(key(rng));
+    }
+    tree.assign(values.begin(), values.end());
+    check_same(tree, std::set<int, Greater>(values.begin(), values.end()), name + ": assign");
+
+    auto frozen = tree.freeze();
+    check_same(frozen, std::set<int, Greater>(values.begin(), values.end()),
+               name + ": freeze");
+    for (int value = -1; value <= 1000; ++value) {
+        auto it = tree.lower_bound(value);
+        auto frozen_it = frozen.lower_bound(value);
+        check((it == tree.end()) == (frozen_it == frozen.end()), name + ": frozen lower_bound");
+        check(it == tree.end() || *it == *frozen_it, name + ": frozen lower_bound");
+    }
+}
+
+template <template <typename, typename> typename Tree>
+void test_tree(const std::string& name, std::mt19937& rng) {
+    test_string_keys<Tree>(name, rng);
+    test_no_construction<Tree>(name);
+    test_greater<Tree>(name + " under std::greater", rng);
+}
+
+int main(int argc, char* argv[]) {
+    std::mt19937 rng(read_seed(argc, argv));
+
+    test_tree<AVL>("avl", rng);
+    test_tree<RB>("rb", rng);
+    test_tree<TreapOf>("treap", rng);
+    test_tree<Splay>("splay", rng);
+    test_tree<Compact>("compact_treap", rng);
+
+    std::cout << "OK" << std::endl;
+}
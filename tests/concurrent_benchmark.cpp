@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../avl-tree.h"
+#include "../concurrent-set.h"
+
+// Usage: concurrent_benchmark [max threads]
+//
+// Every thread runs a mix of lookups, inserts and erases over a shared set
+// of about 1M keys; prints one CSV row per (set, threads, read percent) with
+// the total throughput. The baselines put an AVLTree behind one lock.
+
+constexpr int key_range = 1 << 21;
+constexpr size_t operations_per_thread = 1 << 18;
+
+// Whole tree behind one mutex, so only one thread works at a time
+class LockedTree {
+public:
+    bool contains(int key) {
+        std::lock_guard lock(mutex);
+        return tree.find(key) != tree.end();
+    }
+
+    bool insert(int key) {
+        std::lock_guard lock(mutex);
+        return tree.insert(key).second;
+    }
+
+    bool erase(int key) {
+        std::lock_guard lock(mutex);
+        return tree.erase(key);
+    }
+
+private:
+    std::mutex mutex;
+    AVLTree<int> tree;
+};
+
+// Readers share the lock, writers hold it alone
+class ReadWriteLockedTree {
+public:
+    // find is not const and would need the unique lock, so readers use the
+    // const lower_bound, which is safe under a shared one
+    bool contains(int key) {
+        std::shared_lock lock(mutex);
+        const AVLTree<int>& view = tree;
+        auto it = view.lower_bound(key);
+        return it != view.end() && *it == key;
+    }
+
+    bool insert(int key) {
+        std::unique_lock lock(mutex);
+        return tree.insert(key).second;
+    }
+
+    bool erase(int key) {
+        std::unique_lock lock(mutex);
+        return tree.erase(key);
+    }
+
+private:
+    std::shared_mutex mutex;
+    AVLTree<int> tree;
+};
+
+// args are passed on to Set's constructor
+template <typename Set, typename... Args>
+double run(size_t threads, int read_percent, const Args&... args) {
+    Set set(args...);
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<int> any_key(0, key_range - 1);
+    for (int i = 0; i < key_range / 2; i++) {
+        set.insert(any_key(rng));
+    }
+
+    std::atomic<size_t> ready{0};
+    std::atomic<bool> go{false};
+    std::atomic<size_t> sink{0};
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            std::mt19937_64 rng(t + 1);
+            std::uniform_int_distribution<int> any_key(0, key_range - 1);
+            std::uniform_int_distribution<int> percent(0, 99);
+            size_t local = 0;
+
+            ready++;
+            while (!go) {
+                std::this_thread::yield();
+            }
+            for (size_t i = 0; i < operations_per_thread; i++) {
+                int key = any_key(rng);
+                int roll = percent(rng);
+                if (roll < read_percent) {
+                    local += set.contains(key);
+                } else if ((roll - read_percent) % 2 == 0) {
+                    local += set.insert(key);
+                } else {
+                    local += set.erase(key);
+                }
+            }
+            sink += local;
+        });
+    }
+
+    while (ready != threads) {
+        std::this_thread::yield();
+    }
+    auto begin = std::chrono::steady_clock::now();
+    go = true;
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+    // Keeps the operations from being optimized away
+    if (sink == std::numeric_limits<size_t>::max()) {
+        std::cerr << sink;
+    }
+    return threads * operations_per_thread / elapsed.count();
+}
+
+int main(int argc, char* argv[]) {
+    size_t max_threads = argc > 1
+        ? std::strtoull(argv[1], nullptr, 10)
+        : std::max(1u, std::thread::hardware_concurrency());
+
+    std::cout << "set,threads,read_percent,ops_per_second\n";
+    for (int read_percent : {50, 90, 99}) {
+        for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+            auto report = [&](const std::string& name, double ops_per_second) {
+                std::cout << name << ',' << threads << ',' << read_percent << ','
+                          << static_cast<long long>(ops_per_second) << '\n';
+            };
+            // Keys are uniform, so shards of equal width get equal traffic
+            report("concurrent_set",
+                   run<ConcurrentSet<int>>(threads, read_percent, 0, key_range - 1));
+            report("mutex_avl", run<LockedTree>(threads, read_percent));
+            report("shared_mutex_avl", run<ReadWriteLockedTree>(threads, read_percent));
+        }
+    }
+}
@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../concurrent-set.h"
+#include "check.h"
+
+// Usage: concurrent_tests [seed]
+//
+// Checks ConcurrentSet's ordered queries against std::set across shard
+// boundaries, then hammers it from several threads. Each writer owns the
+// keys congruent to its index, so its own std::set stays exact; readers
+// check keys nobody writes, and every thread races on one shared key range.
+
+constexpr int writer_count = 4;
+constexpr int reader_count = 2;
+constexpr int key_range = 20000;
+
+// Multiples of stable_step are inserted up front and never touched again
+constexpr int stable_step = 97;
+
+bool is_stable(int value) {
+    return value % stable_step == 0;
+}
+
+// Bounds that fall in an empty shard, or past the last key of one, go on
+// to the next shards
+template <typename T>
+void test_ordered(ConcurrentSet<T>& set, std::mt19937& rng, T lowest, T highest,
+                  const std::string& name) {
+    std::set<T> model;
+    std::uniform_int_distribution<int> operation(0, 3);
+    for (int step = 0; step < 20000; ++step) {
+        // One of 1001 evenly spaced keys, computed without overflowing T
+        T k = static_cast<T>(rng() % 1001);
+        T value = lowest / 1000 * (1000 - k) + highest / 1000 * k;
+        switch (operation(rng)) {
+        case 0:
+            check(set.insert(value) == model.insert(value).second, name + ": insert");
+            break;
+        case 1:
+            check(set.erase(value) == (model.erase(value) == 1), name + ": erase");
+            break;
+        default: {
+            auto lower = set.lower_bound(value);
+            auto expected = model.lower_bound(value);
+            check(lower.has_value() == (expected != model.end()), name + ": lower_bound");
+            check(!lower || *lower == *expected, name + ": lower_bound");
+            auto upper = set.upper_bound(value);
+            expected = model.upper_bound(value);
+            check(upper.has_value() == (expected != model.end()), name + ": upper_bound");
+            check(!upper || *upper == *expected, name + ": upper_bound");
+            check(set.contains(value) == model.contains(value), name + ": contains");
+            break;
+        }
+        }
+        if (step % 1000 == 0) {
+            std::vector<T> values = set.to_vector();
+            check(std::equal(values.begin(), values.end(), model.begin(), model.end()),
+                  name + ": to_vector");
+            check(set.size() == model.size(), name + ": size");
+        }
+    }
+    set.clear();
+    check(set.empty() && set.to_vector().empty() && !set.lower_bound(lowest),
+          name + ": clear");
+}
+
+void test_partitions(std::mt19937& rng) {
+    // Unsorted and repeated boundaries, and keys on both sides of them
+    ConcurrentSet<int> explicit_bounds(std::vector<int>{600, -200, 300, 600, 301});
+    check(explicit_bounds.shard_count() == 5, "repeated boundaries dropped");
+    test_ordered<int>(explicit_bounds, rng, -1000, 1000, "explicit boundaries");
+
+    // Keys mostly outside the range the shards split
+    ConcurrentSet<int> narrow(0, 10, 4);
+    test_ordered<int>(narrow, rng, -5000, 5000, "narrow range");
+
+    ConcurrentSet<int> single;
+    check(single.shard_count() == 1, "default is one shard");
+    test_ordered<int>(single, rng, -1000, 1000, "one shard");
+
+    // The width of the whole 64-bit range does not overflow
+    ConcurrentSet<std::int64_t> wide(std::numeric_limits<std::int64_t>::min(),
+                                     std::numeric_limits<std::int64_t>::max(), 16);
+    check(wide.shard_count() == 16, "64-bit range");
+    test_ordered<std::int64_t>(wide, rng, std::numeric_limits<std::int64_t>::min(),
+                               std::numeric_limits<std::int64_t>::max(), "64-bit range");
+
+    ConcurrentSet<double> reals(-1.0, 1.0, 8);
+    test_ordered<double>(reals, rng, -2.0, 2.0, "double keys");
+}
+
+void test_disjoint_writers(unsigned seed) {
+    ConcurrentSet<int> set(0, key_range - 1, 8);
+    std::set<int> stable;
+    for (int value = 0; value < key_range; value += stable_step) {
+        check(set.insert(value), "insert stable key");
+        stable.insert(value);
+    }
+
+    std::vector<std::set<int>> models(writer_count);
+    std::atomic<bool> writing = true;
+    std::vector<std::thread> threads;
+    for (int writer = 0; writer < writer_count; ++writer) {
+        threads.emplace_back([&, writer] {
+            std::mt19937 rng(seed + writer);
+            std::uniform_int_distribution<int> slot(0, key_range / writer_count - 1);
+            std::set<int>& model = models[writer];
+            for (int step = 0; step < 30000; ++step) {
+                int value = slot(rng) * writer_count + writer;
+                if (is_stable(value)) {
+                    continue;
+                }
+                if (rng() % 3 == 0) {
+                    check(set.erase(value) == (model.erase(value) == 1), "concurrent erase");
+                } else {
+                    check(set.insert(value) == model.insert(value).second, "concurrent insert");
+                }
+                check(set.contains(value) == model.contains(value), "concurrent contains");
+            }
+        });
+    }
+    for (int reader = 0; reader < reader_count; ++reader) {
+        threads.emplace_back([&, reader] {
+            std::mt19937 rng(seed + writer_count + reader);
+            std::uniform_int_distribution<int> key(0, key_range - 1);
+            while (writing) {
+                int value = key(rng) / stable_step * stable_step;
+                check(set.contains(value), "stable key lost");
+                // Stable keys are in place throughout, so bounds never go past them
+                auto lower = set.lower_bound(value);
+                check(lower && *lower == value, "lower_bound of stable key");
+                auto upper = set.upper_bound(value);
+                check(!upper || *upper > value, "upper_bound of stable key");
+                check(!upper || value + stable_step >= key_range
+                          || *upper <= value + stable_step,
+                      "upper_bound skips a stable key");
+
+                std::vector<int> snapshot = set.to_vector();
+                check(std::is_sorted(snapshot.begin(), snapshot.end()), "to_vector order");
+                check(std::adjacent_find(snapshot.begin(), snapshot.end()) == snapshot.end(),
+                      "to_vector duplicates");
+                check(std::includes(snapshot.begin(), snapshot.end(),
+                                    stable.begin(), stable.end()),
+                      "to_vector misses a stable key");
+            }
+        });
+    }
+    for (int writer = 0; writer < writer_count; ++writer) {
+        threads[writer].join();
+    }
+    writing = false;
+    for (size_t reader = writer_count; reader < threads.size(); ++reader) {
+        threads[reader].join();
+    }
+
+    std::set<int> expected = stable;
+    for (const auto& model : models) {
+        expected.insert(model.begin(), model.end());
+    }
+    std::vector<int> result = set.to_vector();
+    check(std::equal(result.begin(), result.end(), expected.begin(), expected.end()),
+          "contents after disjoint writers");
+}
+
+// Each key is inserted by exactly one of the racing threads and then
+// erased by exactly one; no erase starts before every insert is done
+void test_shared_keys() {
+    ConcurrentSet<int> set(0, key_range - 1);
+    std::barrier phase(writer_count);
+    std::atomic<size_t> inserted = 0;
+    std::atomic<size_t> erased = 0;
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < writer_count; ++thread) {
+        threads.emplace_back([&] {
+            for (int value = 0; value < key_range; ++value) {
+                inserted += set.insert(value);
+            }
+            phase.arrive_and_wait();
+            for (int value = 0; value < key_range; ++value) {
+                erased += set.erase(value);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    check(inserted == key_range, "racing inserts");
+    check(erased == key_range, "racing erases");
+    check(set.to_vector().empty(), "empty after racing erases");
+}
+
+int main(int argc, char* argv[]) {
+    unsigned seed = read_seed(argc, argv);
+    std::mt19937 rng(seed);
+
+    test_partitions(rng);
+    test_disjoint_writers(seed);
+    test_shared_keys();
+
+    std::cout << "OK" << std::endl;
+}
@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../avl-tree.h"
+#include "../bplus-tree.h"
+#include "../compact-treap.h"
+#include "../frozen-tree.h"
+#include "../persistent-treap.h"
+#include "check.h"
+
+// Usage: frozen_tests [seed]
+//
+// Checks FrozenTree lookups against the sorted set it was built from, at
+// sizes around powers of two where the Eytzinger layout ends a level. Key
+// types of four bytes fill the first cache line with 16 slots, so int32_t
+// and float trees of 15 or more keys go through the block compare.
+
+template <typename T>
+std::set<T> random_set(std::mt19937& rng, size_t count) {
+    std::uniform_int_distribution<int> key(-4 * static_cast<int>(count) - 10,
+                                           4 * static_cast<int>(count) + 10);
+    std::set<T> values;
+    while (values.size() < count) {
+        values.insert(static_cast<T>(key(rng)));
+    }
+    return values;
+}
+
+template <typename Iterator, typename ModelIterator, typename Model>
+void check_position(Iterator it, Iterator end, ModelIterator expected, const Model& model,
+                    const std::string& name) {
+    check((it == end) == (expected == model.end()), name);
+    check(it == end || *it == *expected, name);
+}
+
+// Every stored key, the gaps between them and both sides of the range
+template <typename Frozen, typename T, typename Compare>
+void check_lookups(const Frozen& frozen, const std::set<T, Compare>& model,
+                   const std::string& name) {
+    check(frozen.size() == model.size() && frozen.empty() == model.empty(), name + ": size");
+    auto expected = model.begin();
+    for (const T& value : frozen) {
+        check(expected != model.end() && value == *expected, name + ": contents");
+        ++expected;
+    }
+    check(expected == model.end(), name + ": contents");
+
+    std::vector<T> probes(model.begin(), model.end());
+    for (const T& value : model) {
+        probes.push_back(value - 1);
+        probes.push_back(value + 1);
+    }
+    probes.push_back(static_cast<T>(-1000000));
+    probes.push_back(static_cast<T>(1000000));
+    probes.push_back(T{});
+    if constexpr (std::is_floating_point_v<T>) {
+        for (const T& value : model) {
+            probes.push_back(value + static_cast<T>(0.5));
+        }
+    }
+
+    for (const T& value : probes) {
+        check_position(frozen.lower_bound(value), frozen.end(), model.lower_bound(value),
+                       model, name + ": lower_bound");
+        check_position(frozen.upper_bound(value), frozen.end(), model.upper_bound(value),
+                       model, name + ": upper_bound");
+        auto [first, last] = frozen.equal_range(value);
+        check_position(first, frozen.end(), model.lower_bound(value), model,
+                       name + ": equal_range");
+        check_position(last, frozen.end(), model.upper_bound(value), model,
+                       name + ": equal_range");
+        auto found = frozen.find(value);
+        check((found != frozen.end()) == model.contains(value), name + ": find");
+        check(found == frozen.end() || *found == value, name + ": find");
+    }
+}
+
+// 0, 1 and 2^k - 1, 2^k, 2^k + 1 up to a few thousand keys
+std::vector<size_t> test_sizes() {
+    std::vector<size_t> sizes = {0, 1};
+    for (size_t power = 2; power <= 4096; power *= 2) {
+        sizes.insert(sizes.end(), {power - 1, power, power + 1});
+    }
+    return sizes;
+}
+
+template <typename T>
+void test_frozen(const std::string& name, std::mt19937& rng) {
+    for (size_t size : test_sizes()) {
+        std::set<T> model = random_set<T>(rng, size);
+        std::string sized = name + " of " + std::to_string(size);
+
+        FrozenTree<T> frozen(model.begin(), model.end());
+        check_lookups(frozen, model, sized);
+
+        // A comparator other than < skips the block compare
+        std::set<T, std::greater<T>> reversed(model.begin(), model.end());
+        FrozenTree<T, std::greater<T>> descending(reversed.begin(), reversed.end());
+        check_lookups(descending, reversed, sized + " under std::greater");
+
+        FrozenTree<T> moved = std::move(frozen);
+        check_lookups(moved, model, sized + " moved");
+        check(frozen.empty() && frozen.begin() == frozen.end(), sized + ": moved-from");
+    }
+}
+
+// freeze() answers like the tree it was taken from
+template <template <typename> typename Tree, typename T>
+void test_freeze(const std::string& name, std::mt19937& rng) {
+    for (size_t size : test_sizes()) {
+        std::set<T> model = random_set<T>(rng, size);
+        std::vector<T> keys(model.begin(), model.end());
+        std::shuffle(keys.begin(), keys.end(), rng);
+        Tree<T> tree;
+        for (const T& value : keys) {
+            tree.insert(value);
+        }
+        std::string sized = name + " of " + std::to_string(size);
+
+        auto frozen = tree.freeze();
+        check_lookups(frozen, model, sized + " frozen");
+        for (const T& value : keys) {
+            auto it = tree.lower_bound(value + 1);
+            auto frozen_it = frozen.lower_bound(value + 1);
+            check((it == tree.end()) == (frozen_it == frozen.end()), sized + ": source");
+            check(it == tree.end() || *it == *frozen_it, sized + ": source");
+        }
+
+        // The snapshot does not follow later changes
+        for (size_t i = 0; i < keys.size(); i += 2) {
+            tree.erase(keys[i]);
+        }
+        check_lookups(frozen, model, sized + " frozen after erasing from the source");
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::mt19937 rng(read_seed(argc, argv));
+
+    test_frozen<std::int32_t>("int32", rng);
+    test_frozen<float>("float", rng);
+    test_frozen<std::int64_t>("int64", rng);
+    test_frozen<double>("double", rng);
+
+    test_freeze<AVLTree, std::int32_t>("avl", rng);
+    test_freeze<AVLTree, float>("avl of floats", rng);
+    test_freeze<BPlusTree, std::int32_t>("bplus", rng);
+    test_freeze<BPlusTree, float>("bplus of floats", rng);
+    test_freeze<CompactTreap, std::int32_t>("compact_treap", rng);
+    test_freeze<PersistentTreap, std::int32_t>("persistent_treap", rng);
+
+    std::cout << "OK" << std::endl;
+}
@@ -0,0 +1,164 @@
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../avl-tree.h"
+#include "../treap.h"
+#include "check.h"
+
+// Usage: image_tests [seed]
+//
+// Saves random trees, then checks that load_mmap answers lookups like the
+// std::set they were built from and that assign(image) rebuilds a tree
+// that keeps working under inserts and erases.
+
+std::string temporary_path(const std::string& name) {
+    return (std::filesystem::temp_directory_path() / ("image_tests_" + name)).string();
+}
+
+template <typename Tree>
+void test_round_trip(const std::string& name, std::mt19937& rng) {
+    const std::string path = temporary_path(name);
+    std::uniform_int_distribution<int> key(0, 99999);
+    std::uniform_int_distribution<size_t> size(0, 20000);
+
+    for (int round = 0; round < 8; ++round) {
+        // The empty and single-element images as well
+        size_t count = round < 2 ? round : size(rng);
+        std::set<int> model;
+        Tree tree;
+        for (size_t i = 0; i < count; ++i) {
+            int value = key(rng);
+            tree.insert(value);
+            model.insert(value);
+        }
+        for (size_t i = 0; i < count / 4; ++i) {
+            int value = key(rng);
+            tree.erase(value);
+            model.erase(value);
+        }
+        tree.save(path);
+
+        auto image = Tree::load_mmap(path);
+        check(image.size() == model.size(), name + ": image size");
+        check_same(image, model, name + ": image");
+        for (int i = 0; i < 2000; ++i) {
+            int value = key(rng);
+            check((image.find(value) != image.end()) == model.contains(value),
+                  name + ": image find");
+            auto lower = image.lower_bound(value);
+            auto expected = model.lower_bound(value);
+            check((lower == image.end()) == (expected == model.end()),
+                  name + ": image lower_bound");
+            check(lower == image.end() || *lower == *expected, name + ": image lower_bound");
+            auto upper = image.upper_bound(value);
+            expected = model.upper_bound(value);
+            check((upper == image.end()) == (expected == model.end()),
+                  name + ": image upper_bound");
+            check(upper == image.end() || *upper == *expected, name + ": image upper_bound");
+        }
+
+        Tree restored;
+        restored.insert(-1);
+        restored.assign(image);
+        check_same(restored, model, name + ": assign");
+        for (int i = 0; i < 5000; ++i) {
+            int value = key(rng);
+            if (i % 2 == 0) {
+                check(restored.insert(value).second == model.insert(value).second,
+                      name + ": insert after assign");
+            } else {
+                check(restored.erase(value) == (model.erase(value) == 1),
+                      name + ": erase after assign");
+            }
+        }
+        check_same(restored, model, name + ": after assign");
+    }
+    std::remove(path.c_str());
+}
+
+// assign(image) puts every node back where it was, so every key is found
+// at the depth it had in the saved tree
+template <typename Tree>
+void test_shape(const std::string& name, std::mt19937& rng) {
+    const std::string path = temporary_path(name + "_shape");
+    std::uniform_int_distribution<int> key(0, 99999);
+    std::vector<int> keys(20000);
+    Tree tree;
+    for (int& value : keys) {
+        value = key(rng);
+        tree.insert(value);
+    }
+    tree.save(path);
+
+    Tree restored;
+    restored.assign(Tree::load_mmap(path));
+    check(restored.instrumentation().comparisons == 0,
+          name + ": assign(image) compares nothing");
+    tree.instrumentation().reset();
+    for (int value : keys) {
+        tree.find(value);
+        restored.find(value);
+    }
+    check(tree.instrumentation().search_depths == restored.instrumentation().search_depths,
+          name + ": assign(image) keeps the shape");
+    std::remove(path.c_str());
+}
+
+template <typename Expected, typename Load>
+void check_throws(Load&& load, const std::string& name) {
+    bool thrown = false;
+    try {
+        load();
+    } catch (const Expected&) {
+        thrown = true;
+    }
+    check(thrown, name);
+}
+
+// Files that are missing, cut short or hold the other tree's image are
+// rejected instead of being read
+void test_bad_images() {
+    const std::string path = temporary_path("bad");
+    std::remove(path.c_str());
+    check_throws<std::runtime_error>([&] { AVLTree<int>::load_mmap(path); }, "missing image");
+
+    std::ofstream(path, std::ios::binary) << "abc";
+    check_throws<std::runtime_error>([&] { AVLTree<int>::load_mmap(path); },
+                                     "truncated image");
+
+    Treap<int> treap;
+    treap.insert(1);
+    treap.save(path);
+    check_throws<std::runtime_error>([&] { AVLTree<int>::load_mmap(path); },
+                                     "image of another tree");
+    // Values of another size
+    check_throws<std::runtime_error>([&] { Treap<long long>::load_mmap(path); },
+                                     "image of another type");
+
+    auto image = Treap<int>::load_mmap(path);
+    AVLTree<int> avl;
+    check_throws<std::invalid_argument>([&] { avl.assign(image); },
+                                        "assign from another tree's image");
+    std::remove(path.c_str());
+}
+
+int main(int argc, char* argv[]) {
+    std::mt19937 rng(read_seed(argc, argv));
+
+    test_round_trip<AVLTree<int>>("avl", rng);
+    test_round_trip<Treap<int>>("treap", rng);
+    test_shape<AVLTree<int, std::allocator<int>, augments::none, instruments::counters>>(
+        "avl", rng);
+    test_shape<Treap<int, std::allocator<int>, augments::none, instruments::counters>>(
+        "treap", rng);
+    test_bad_images();
+
+    std::cout << "OK" << std::endl;
+}
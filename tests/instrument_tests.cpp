@@ -0,0 +1,97 @@
+#include <iostream>
+#include <string>
+
+#include "../avl-tree.h"
+#include "../rb-tree.h"
+#include "check.h"
+
+// Usage: instrument_tests
+//
+// Exact counts from instruments::counters for small fixed inputs, worked
+// out by hand from the shapes the trees go through.
+
+template <typename Tree>
+void insert_one_to_seven(Tree& tree) {
+    for (int value = 1; value <= 7; ++value) {
+        tree.insert(value);
+    }
+}
+
+void test_avl_counts() {
+    AVLTree<int, std::allocator<int>, augments::none, instruments::counters> tree;
+    const auto& counts = tree.instrumentation();
+
+    // 2(1, 3) after one left rotation, 2(1, 4(3, 5)) after a second,
+    // 4(2(1, 3), 5(-, 6)) after a third at the root and 4(2(1, 3), 6(5, 7))
+    // after the last. Each insert costs one comparison per level passed:
+    // 0 + 1 + 2 + 2 + 3 + 3 + 3.
+    insert_one_to_seven(tree);
+    check(counts.comparisons == 14, "avl: comparisons while inserting 1..7");
+    check(counts.rotations == 4, "avl: rotations while inserting 1..7");
+    check(counts.allocations == 7, "avl: allocations");
+    check(counts.deallocations == 0, "avl: deallocations");
+
+    // The root, two nodes at depth 1 and four at depth 2
+    tree.instrumentation().reset();
+    for (int value = 1; value <= 7; ++value) {
+        check(tree.find(value) != tree.end(), "avl: find");
+    }
+    check(counts.comparisons == 1 + 2 * 2 + 4 * 3, "avl: comparisons while finding 1..7");
+    check(counts.search_depths[0] == 1 && counts.search_depths[1] == 2
+              && counts.search_depths[2] == 4 && counts.search_depths[3] == 0,
+          "avl: search depths");
+
+    // A miss below a leaf ends one level further down
+    tree.instrumentation().reset();
+    check(tree.find(8) == tree.end(), "avl: find a missing key");
+    check(counts.comparisons == 3, "avl: comparisons for a miss");
+
+    // The root is found at once and its successor 5 takes its place,
+    // leaving 5(2(1, 3), 6(-, 7)) balanced
+    tree.instrumentation().reset();
+    check(tree.erase(4), "avl: erase the root");
+    check(counts.comparisons == 1, "avl: comparisons erasing the root");
+    check(counts.rotations == 0, "avl: rotations erasing the root");
+    check(counts.deallocations == 1, "avl: deallocations erasing the root");
+
+    // Emptying the left side leaves 5(-, 6(-, 7)), which one left rotation
+    // turns into 6(5, 7)
+    tree.instrumentation().reset();
+    tree.erase(1);
+    tree.erase(3);
+    check(counts.rotations == 0, "avl: rotations while the left side shrinks");
+    tree.erase(2);
+    check(counts.rotations == 1, "avl: rotation after emptying the left side");
+    check(counts.deallocations == 3, "avl: deallocations");
+    tree.instrumentation().reset();
+    tree.find(6);
+    check(counts.comparisons == 1, "avl: new root after the rotation");
+}
+
+void test_rb_counts() {
+    RBTree<int, std::allocator<int>, augments::none, instruments::counters> tree;
+    const auto& counts = tree.instrumentation();
+
+    // Left rotations after 3, 5 and 7; 4 and 6 only recolour. The tree ends
+    // up as 2(1, 4(3, 6(5, 7))), so the inserts compare
+    // 0 + 1 + 2 + 2 + 3 + 3 + 4 times.
+    insert_one_to_seven(tree);
+    check(counts.comparisons == 15, "rb: comparisons while inserting 1..7");
+    check(counts.rotations == 3, "rb: rotations while inserting 1..7");
+    check(counts.allocations == 7, "rb: allocations");
+
+    tree.instrumentation().reset();
+    for (int value = 1; value <= 7; ++value) {
+        tree.find(value);
+    }
+    check(counts.search_depths[0] == 1 && counts.search_depths[1] == 2
+              && counts.search_depths[2] == 2 && counts.search_depths[3] == 2,
+          "rb: search depths");
+}
+
+int main() {
+    test_avl_counts();
+    test_rb_counts();
+
+    std::cout << "OK" << std::endl;
+}
@@ -0,0 +1,223 @@
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "../ordered-map.h"
+#include "../pool-allocator.h"
+#include "check.h"
+
+// Usage: map_tests [seed]
+//
+// Drives AVLMap and TreapMap, with values in the nodes and out of line,
+// next to a std::map. Values are strings, so a try_emplace that moved from
+// its arguments on a hit, or a copy that shared out-of-line values, shows
+// in the contents.
+
+template <typename Map, typename Model>
+void check_same_map(const Map& map, const Model& model, const std::string& name) {
+    check(map.size() == model.size() && map.empty() == model.empty(), name + ": size");
+    auto expected = model.begin();
+    for (auto [key, value] : map) {
+        check(expected != model.end() && key == expected->first
+                  && value == expected->second,
+              name + ": contents");
+        ++expected;
+    }
+    check(expected == model.end(), name + ": contents");
+}
+
+template <typename Iterator, typename ModelIterator, typename Model>
+void check_position(Iterator it, Iterator end, ModelIterator expected, const Model& model,
+                    const std::string& name) {
+    check((it == end) == (expected == model.end()), name);
+    check(it == end || (it->first == expected->first && it->second == expected->second),
+          name);
+}
+
+template <typename Map>
+void test_random_operations(const std::string& name, std::mt19937& rng) {
+    Map map;
+    std::map<int, std::string> model;
+    std::uniform_int_distribution<int> key(0, 499);
+    auto value = [&] { return std::string(1 + rng() % 20, static_cast<char>('a' + rng() % 26)); };
+
+    for (int step = 0; step < 30000; ++step) {
+        int k = key(rng);
+        switch (rng() % 9) {
+        case 0: {
+            // Value-initialized on a miss, then written through
+            std::string appended = value();
+            map[k] += appended;
+            model[k] += appended;
+            break;
+        }
+        case 1: {
+            std::string arg = value();
+            std::string copy = arg;
+            // Through both the const Key& and the Key&& overload
+            auto [it, inserted] = (rng() % 2 == 0) ? map.try_emplace(k, std::move(arg))
+                                                   : map.try_emplace(int(k), std::move(arg));
+            auto expected = model.try_emplace(k, copy);
+            check(inserted == expected.second, name + ": try_emplace");
+            check(it->first == k && it->second == expected.first->second,
+                  name + ": try_emplace position");
+            check(inserted || arg == copy, name + ": try_emplace moved from args on a hit");
+            break;
+        }
+        case 2: {
+            std::string assigned = value();
+            auto [it, inserted] = map.insert_or_assign(k, assigned);
+            check(inserted == model.insert_or_assign(k, assigned).second,
+                  name + ": insert_or_assign");
+            check(it->first == k && it->second == assigned, name + ": insert_or_assign position");
+            break;
+        }
+        case 3:
+            check(map.erase(k) == (model.erase(k) == 1), name + ": erase");
+            break;
+        case 4: {
+            auto it = model.find(k);
+            if (it != model.end()) {
+                check(map.at(k) == it->second, name + ": at");
+                const Map& const_map = map;
+                check(const_map.at(k) == it->second, name + ": const at");
+            } else {
+                bool thrown = false;
+                try {
+                    map.at(k);
+                } catch (const std::out_of_range& error) {
+                    thrown = error.what() == std::string("OrderedMap::at: no such key");
+                }
+                check(thrown, name + ": at on a missing key");
+            }
+            break;
+        }
+        case 5:
+            check_position(map.find(k), map.end(), model.find(k), model, name + ": find");
+            check(map.contains(k) == model.contains(k), name + ": contains");
+            break;
+        case 6: {
+            const Map& const_map = map;
+            check_position(const_map.find(k), const_map.end(), model.find(k), model,
+                           name + ": const find");
+            check_position(map.lower_bound(k), map.end(), model.lower_bound(k), model,
+                           name + ": lower_bound");
+            check_position(const_map.upper_bound(k), const_map.end(), model.upper_bound(k),
+                           model, name + ": upper_bound");
+            break;
+        }
+        case 7: {
+            auto [it, inserted] = map.insert({k, "inserted"});
+            check(inserted == model.insert({k, "inserted"}).second, name + ": insert");
+            check(it->first == k, name + ": insert position");
+            break;
+        }
+        case 8:
+            // Copies hold values of their own, also out of line
+            if (step % 100 == 0) {
+                Map copy = map;
+                check_same_map(copy, model, name + ": copy");
+                for (auto [copy_key, copy_value] : copy) {
+                    copy_value += "!";
+                }
+                copy[k] = "copy";
+                check_same_map(map, model, name + ": source after changing a copy");
+
+                Map assigned;
+                assigned[1000] = "old";
+                assigned = copy;
+                check(assigned.size() == copy.size() && !assigned.contains(1000),
+                      name + ": copy assignment");
+                assigned.clear();
+                check(assigned.empty() && copy.at(k) == "copy", name + ": clear of a copy");
+            }
+            break;
+        }
+
+        if (step % 1000 == 0) {
+            check_same_map(map, model, name);
+        }
+        if (step % 10000 == 4999) {
+            map.clear();
+            model.clear();
+            check(map.empty() && map.begin() == map.end(), name + ": clear");
+        }
+    }
+    check_same_map(map, model, name);
+
+    // Range and initializer list construction keep the first of equal keys
+    std::vector<std::pair<int, std::string>> values(model.begin(), model.end());
+    values.emplace_back(values.empty() ? 0 : values.front().first, "duplicate");
+    Map built(values.begin(), values.end());
+    check_same_map(built, model, name + ": range constructor");
+    Map listed = {{2, "b"}, {1, "a"}, {2, "c"}};
+    check_same_map(listed, std::map<int, std::string>{{1, "a"}, {2, "b"}},
+                   name + ": initializer list");
+}
+
+// std::string keys under std::less<> found by std::string_view and
+// const char*
+template <typename Map>
+void test_heterogeneous(const std::string& name) {
+    Map map;
+    map["alpha"] = 1;
+    map["beta"] = 2;
+    map.try_emplace("gamma", 3);
+
+    std::string_view beta = "beta";
+    check(map.find(beta) != map.end() && map.find(beta)->second == 2,
+          name + ": find by string_view");
+    const Map& const_map = map;
+    check(const_map.find("gamma")->second == 3, name + ": const find by const char*");
+    check(map.find(std::string_view("delta")) == map.end(), name + ": find a missing key");
+    check(map.contains("alpha") && !map.contains("alp"), name + ": contains");
+    check(map.at(beta) == 2, name + ": at by string_view");
+    check(map.lower_bound("b")->first == "beta"
+              && map.upper_bound(beta)->first == "gamma",
+          name + ": bounds");
+
+    bool thrown = false;
+    try {
+        map.at(std::string_view("delta"));
+    } catch (const std::out_of_range&) {
+        thrown = true;
+    }
+    check(thrown, name + ": at on a missing key");
+
+    check(map.erase(beta) && !map.erase("beta") && map.size() == 2,
+          name + ": erase by string_view");
+}
+
+template <template <typename, typename, typename, typename, typename, typename> typename Map>
+void test_map(const std::string& name, std::mt19937& rng) {
+    using Alloc = std::allocator<std::pair<const int, std::string>>;
+    using Pool = PoolAllocator<std::pair<const int, std::string>>;
+    using StringAlloc = std::allocator<std::pair<const std::string, int>>;
+
+    test_random_operations<Map<int, std::string, payloads::in_node, Alloc,
+                               instruments::none, std::less<int>>>(name, rng);
+    test_random_operations<Map<int, std::string, payloads::out_of_line, Alloc,
+                               instruments::none, std::less<int>>>(name + " out of line", rng);
+    test_random_operations<Map<int, std::string, payloads::out_of_line, Pool,
+                               instruments::none, std::less<int>>>(name + " pooled", rng);
+
+    test_heterogeneous<Map<std::string, int, payloads::in_node, StringAlloc,
+                           instruments::none, std::less<>>>(name);
+    test_heterogeneous<Map<std::string, int, payloads::out_of_line, StringAlloc,
+                           instruments::none, std::less<>>>(name + " out of line");
+}
+
+int main(int argc, char* argv[]) {
+    std::mt19937 rng(read_seed(argc, argv));
+
+    test_map<AVLMap>("avl_map", rng);
+    test_map<TreapMap>("treap_map", rng);
+
+    std::cout << "OK" << std::endl;
+}
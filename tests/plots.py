@@ -1,37 +1,52 @@
-import matplotlib.pyplot as plt
-
-n = int(input())
-
-with open("treap_data.txt", "r") as f:
-    treap_avg_insert_time = list(map(int, f.readline().strip().split()))
-    treap_avg_delete_time = list(map(int, f.readline().strip().split()))
-    treap_avg_find_time = list(map(int, f.readline().strip().split()))
-
-with open("splay_data.txt", "r") as f:
-    splay_avg_insert_time = list(map(int, f.readline().strip().split()))
-    splay_avg_delete_time = list(map(int, f.readline().strip().split()))
-    splay_avg_find_time = list(map(int, f.readline().strip().split()))
-
-with open("avl_data.txt", "r") as f:
-    avl_avg_insert_time = list(map(int, f.readline().strip().split()))
-    avl_avg_delete_time = list(map(int, f.readline().strip().split()))
-    avl_avg_find_time = list(map(int, f.readline().strip().split()))
+import csv
+import sys
+from collections import defaultdict
 
-with open("rb_data.txt", "r") as f:
-    rb_avg_insert_time = list(map(int, f.readline().strip().split()))
-    rb_avg_delete_time = list(map(int, f.readline().strip().split()))
-    rb_avg_find_time = list(map(int, f.readline().strip().split()))
-
-with open("naive_data.txt", "r") as f:
-    naive_avg_insert_time = list(map(int, f.readline().strip().split()))
-    naive_avg_delete_time = list(map(int, f.readline().strip().split()))
-    naive_avg_find_time = list(map(int, f.readline().strip().split()))
-
-x = [i for i in range(n)]
-
-plt.plot(x, treap_avg_insert_time)
-plt.plot(x, avl_avg_insert_time)
-plt.plot(x, rb_avg_insert_time)
-plt.plot(x, naive_avg_insert_time)
+import matplotlib.pyplot as plt
 
-plt.savefig("img.png")
+# Usage: ./benchmark > results.csv && python3 plots.py results.csv
+#
+# Saves one figure per key distribution; each has a row per operation with
+# throughput, p99 latency and peak memory plotted against tree size.
+
+path = sys.argv[1] if len(sys.argv) > 1 else "results.csv"
+
+# (distribution, operation, tree) -> list of rows
+series = defaultdict(list)
+with open(path, "r") as f:
+    for row in csv.DictReader(f):
+        series[(row["distribution"], row["operation"], row["tree"])].append(row)
+
+distributions = sorted({key[0] for key in series})
+operations = ["insert", "find", "erase"]
+trees = sorted({key[2] for key in series})
+metrics = [
+    ("ops_per_second", "ops/s"),
+    ("p99_ns", "p99 latency, ns"),
+    ("peak_bytes", "peak memory, bytes"),
+]
+
+for distribution in distributions:
+    fig, axes = plt.subplots(len(operations), len(metrics),
+                             figsize=(5 * len(metrics), 4 * len(operations)))
+    fig.suptitle(distribution)
+
+    for i, operation in enumerate(operations):
+        for j, (metric, label) in enumerate(metrics):
+            ax = axes[i][j]
+            for tree in trees:
+                rows = sorted(series[(distribution, operation, tree)],
+                              key=lambda row: int(row["size"]))
+                if not rows:
+                    continue
+                ax.plot([int(row["size"]) for row in rows],
+                        [float(row[metric]) for row in rows],
+                        marker="o", label=tree)
+            ax.set_xscale("log")
+            ax.set_title(operation)
+            ax.set_xlabel("size")
+            ax.set_ylabel(label)
+            ax.legend()
+
+    fig.tight_layout()
+    fig.savefig(f"{distribution}.png")
@@ -0,0 +1,138 @@
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../avl-tree.h"
+#include "../pool-allocator.h"
+#include "../treap.h"
+#include "check.h"
+
+// Usage: pool_tests [seed]
+//
+// Trees on PoolAllocator: freelist reuse under random inserts and erases,
+// clear() dropping whole pools, copies that must not share them, and
+// allocations of more than one object going to operator new.
+
+template <typename T>
+using Pool = PoolAllocator<T, 16>;
+
+template <typename Tree>
+void test_random_use(const std::string& name, std::mt19937& rng) {
+    Tree tree;
+    std::set<int> model;
+    std::uniform_int_distribution<int> key(0, 2999);
+    for (int round = 0; round < 4; ++round) {
+        for (int step = 0; step < 20000; ++step) {
+            int value = key(rng);
+            if (step % 3 == 0) {
+                check(tree.erase(value) == (model.erase(value) == 1), name + ": erase");
+            } else {
+                check(tree.insert(value).second == model.insert(value).second,
+                      name + ": insert");
+            }
+        }
+        check_same(tree, model, name);
+
+        // One bulk release, and the emptied pool is used again
+        tree.clear();
+        model.clear();
+        check(tree.empty() && tree.begin() == tree.end(), name + ": clear");
+    }
+}
+
+// Strings own heap memory, so a bulk release that skips destructors leaks
+void test_bulk_release() {
+    using Tree = AVLTree<std::string, Pool<std::string>, augments::none,
+                         instruments::counters>;
+    Tree tree;
+    for (int i = 0; i < 1000; ++i) {
+        tree.insert(std::string(40, 'a') + std::to_string(i));
+    }
+    tree.instrumentation().reset();
+    tree.clear();
+    check(tree.instrumentation().bulk_releases == 1, "clear releases the pool at once");
+    check(tree.instrumentation().deallocations == 0, "clear frees no node one by one");
+
+    // A node handle holds a copy of the allocator, so the pool is shared and
+    // clear() falls back to freeing node by node
+    for (int i = 0; i < 100; ++i) {
+        tree.insert(std::to_string(i));
+    }
+    auto handle = tree.extract(std::string("42"));
+    tree.instrumentation().reset();
+    tree.clear();
+    check(tree.instrumentation().bulk_releases == 0, "clear with a node handle out");
+    check(tree.instrumentation().deallocations == 99, "clear with a node handle out");
+    check(handle.value() == "42", "node handle survives clear");
+    check(tree.insert(std::move(handle)).inserted, "node handle goes back in");
+    check(*tree.begin() == "42", "node handle goes back in");
+}
+
+// Copies get a pool of their own: clearing either side leaves the other
+// intact, which the address sanitizer checks
+template <typename Tree>
+void test_copies(const std::string& name) {
+    Tree original;
+    std::set<int> model;
+    for (int i = 0; i < 500; ++i) {
+        original.insert(i * 7 % 500);
+        model.insert(i * 7 % 500);
+    }
+
+    Tree copy = original;
+    original.clear();
+    check_same(copy, model, name + ": copy after clearing the original");
+
+    original = copy;
+    copy.clear();
+    check_same(original, model, name + ": assigned after clearing the source");
+    for (int i = 500; i < 600; ++i) {
+        original.insert(i);
+        model.insert(i);
+    }
+    check_same(original, model, name + ": assigned tree keeps growing");
+
+    Tree moved = std::move(original);
+    check_same(moved, model, name + ": moved");
+    original.insert(1);
+    moved.clear();
+    check(original.find(1) != original.end(), name + ": moved-from tree reused");
+}
+
+// Only single nodes come from the pool
+void test_array_allocations() {
+    Pool<int> alloc;
+    int* single = alloc.allocate(1);
+    int* array = alloc.allocate(1000);
+    for (int i = 0; i < 1000; ++i) {
+        array[i] = i;
+    }
+    *single = 7;
+    alloc.deallocate(array, 1000);
+    alloc.deallocate(single, 1);
+
+    Pool<int> copy = alloc;
+    check(copy == alloc && !alloc.exclusive(), "copies share the pool");
+    check(!(Pool<int>() == alloc), "fresh allocators get their own pool");
+
+    std::vector<int, Pool<int>> values;
+    for (int i = 0; i < 10000; ++i) {
+        values.push_back(i);
+    }
+    check(values.size() == 10000 && values[9999] == 9999, "vector on a pool");
+}
+
+int main(int argc, char* argv[]) {
+    std::mt19937 rng(read_seed(argc, argv));
+
+    test_random_use<AVLTree<int, Pool<int>>>("avl", rng);
+    test_random_use<Treap<int, Pool<int>>>("treap", rng);
+    test_bulk_release();
+    test_copies<AVLTree<int, Pool<int>>>("avl");
+    test_copies<Treap<int, Pool<int>>>("treap");
+    test_array_allocations();
+
+    std::cout << "OK" << std::endl;
+}
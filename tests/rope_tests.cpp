@@ -0,0 +1,229 @@
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../rope.h"
+#include "check.h"
+
+// Usage: rope_tests [seed]
+//
+// Drives Rope with random edits and lazy range updates next to a
+// std::vector. Ranges overlap freely, so tags meet tags already pending
+// below them and have to be pushed down in the order they were applied;
+// with std::string values += appends, so that order shows in the result.
+
+template <typename T>
+void check_same(Rope<T>& rope, const std::vector<T>& model, const std::string& name) {
+    check(rope.size() == model.size() && rope.empty() == model.empty(), name + ": size");
+    check(rope.to_vector() == model, name + ": contents");
+}
+
+long random_value(std::mt19937& rng, long) {
+    return std::uniform_int_distribution<long>(-1000, 1000)(rng);
+}
+
+std::string random_value(std::mt19937& rng, const std::string&) {
+    return std::string(1, static_cast<char>('a' + rng() % 26));
+}
+
+template <typename T>
+void test_random_edits(const std::string& name, std::mt19937& rng) {
+    Rope<T> rope;
+    std::vector<T> model;
+    auto value = [&] { return random_value(rng, T{}); };
+    // A random [first, last) within the first size elements, possibly empty
+    auto range = [&](size_t size) {
+        std::uniform_int_distribution<size_t> position(0, size);
+        size_t first = position(rng);
+        size_t last = position(rng);
+        return std::make_pair(std::min(first, last), std::max(first, last));
+    };
+
+    for (int step = 0; step < 30000; ++step) {
+        std::uniform_int_distribution<size_t> position(0, model.size());
+        switch (rng() % 12) {
+        case 0:
+        case 1: {
+            size_t index = position(rng);
+            T inserted = value();
+            rope.insert(index, inserted);
+            model.insert(model.begin() + index, inserted);
+            break;
+        }
+        case 2: {
+            T pushed = value();
+            rope.push_back(pushed);
+            model.push_back(pushed);
+            break;
+        }
+        case 3:
+            if (!model.empty()) {
+                size_t index = position(rng) % model.size();
+                rope.erase(index);
+                model.erase(model.begin() + index);
+            }
+            break;
+        case 4: {
+            auto [first, last] = range(model.size());
+            if (rng() % 4 == 0) {
+                rope.erase_range(first, last);
+                model.erase(model.begin() + first, model.begin() + last);
+            }
+            break;
+        }
+        case 5: {
+            auto [first, last] = range(model.size());
+            rope.reverse_range(first, last);
+            std::reverse(model.begin() + first, model.begin() + last);
+            break;
+        }
+        case 6: {
+            auto [first, last] = range(model.size());
+            T delta = value();
+            rope.add_to_range(first, last, delta);
+            for (size_t i = first; i < last; ++i) {
+                model[i] += delta;
+            }
+            break;
+        }
+        case 7: {
+            auto [first, last] = range(model.size());
+            T assigned = value();
+            rope.assign_range(first, last, assigned);
+            std::fill(model.begin() + first, model.begin() + last, assigned);
+            break;
+        }
+        case 8:
+            // Reads and writes through operator[] push tags down the path
+            if (!model.empty()) {
+                size_t index = position(rng) % model.size();
+                check(rope[index] == model[index], name + ": operator[]");
+                T written = value();
+                rope[index] = written;
+                model[index] = written;
+            }
+            break;
+        case 9: {
+            // Cut a range out and splice it back in elsewhere, with its
+            // pending tags
+            auto [first, last] = range(model.size());
+            Rope<T> part = rope.extract_range(first, last);
+            std::vector<T> cut(model.begin() + first, model.begin() + last);
+            model.erase(model.begin() + first, model.begin() + last);
+            check(part.size() == cut.size() && rope.size() == model.size(),
+                  name + ": extract_range sizes");
+            if (rng() % 2 == 0) {
+                part.reverse_range(0, part.size());
+                std::reverse(cut.begin(), cut.end());
+            }
+            size_t index = std::uniform_int_distribution<size_t>(0, model.size())(rng);
+            rope.splice(index, std::move(part));
+            check(part.empty(), name + ": spliced rope is emptied");
+            model.insert(model.begin() + index, cut.begin(), cut.end());
+            break;
+        }
+        case 10: {
+            // A rope built in one go by link_cartesian
+            std::vector<T> values(rng() % 40);
+            for (T& item : values) {
+                item = value();
+            }
+            Rope<T> built(values.begin(), values.end());
+            check(built.size() == values.size(), name + ": range constructor size");
+            size_t index = position(rng);
+            if (rng() % 2 == 0) {
+                rope.splice(index, std::move(built));
+            } else {
+                index = model.size();
+                rope.append(std::move(built));
+            }
+            model.insert(model.begin() + index, values.begin(), values.end());
+            break;
+        }
+        case 11:
+            // Copies take the pending tags along and are independent
+            if (step % 50 == 0) {
+                Rope<T> copy = rope;
+                check_same(copy, model, name + ": copy");
+                copy.assign_range(0, copy.size(), value());
+                Rope<T> moved = std::move(copy);
+                check(copy.empty(), name + ": moved-from rope is empty");
+            }
+            break;
+        }
+        check(rope.size() == model.size(), name + ": size");
+
+        if (step % 500 == 0) {
+            check_same(rope, model, name);
+            for (size_t i = 0; i < model.size(); i += 7) {
+                check(rope[i] == model[i], name + ": operator[]");
+            }
+        }
+        if (step % 10000 == 9999) {
+            rope.clear();
+            model.clear();
+            check(rope.empty() && rope.size() == 0, name + ": clear");
+        }
+    }
+    check_same(rope, model, name);
+}
+
+// Sizes of ropes built by link_cartesian, and every index found through them
+void test_construction(std::mt19937& rng) {
+    for (size_t size : {0, 1, 2, 3, 100, 4097}) {
+        std::vector<long> values(size);
+        for (long& value : values) {
+            value = random_value(rng, 0L);
+        }
+        Rope<long> rope(values.begin(), values.end());
+        check_same(rope, values, "construction of " + std::to_string(size));
+        for (size_t i = 0; i < size; ++i) {
+            check(rope[i] == values[i], "construction: operator[]");
+        }
+
+        std::vector<long> other(size / 2 + 1, 7);
+        rope.assign(other.begin(), other.end());
+        check_same(rope, other, "assign");
+    }
+}
+
+// Tags pending on the same subtree settle in the order they came
+void test_tag_order() {
+    std::vector<std::string> letters = {"a", "b", "c", "d", "e", "f"};
+    Rope<std::string> rope(letters.begin(), letters.end());
+    rope.add_to_range(0, 6, "1");
+    rope.assign_range(1, 5, "x");
+    rope.add_to_range(2, 6, "2");
+    rope.reverse_range(0, 4);
+    rope.add_to_range(0, 3, "3");
+    check(rope.to_vector()
+              == std::vector<std::string>{"x23", "x23", "x3", "a1", "x2", "f12"},
+          "tag order");
+}
+
+// Without += a rope still reverses and assigns
+void test_without_add() {
+    using Pair = std::pair<int, int>;
+    std::vector<Pair> model = {{1, 2}, {3, 4}, {5, 6}, {7, 8}};
+    Rope<Pair> rope(model.begin(), model.end());
+    rope.reverse_range(1, 4);
+    rope.assign_range(0, 2, Pair{0, 0});
+    std::reverse(model.begin() + 1, model.end());
+    std::fill(model.begin(), model.begin() + 2, Pair{0, 0});
+    check_same(rope, model, "without +=");
+}
+
+int main(int argc, char* argv[]) {
+    std::mt19937 rng(read_seed(argc, argv));
+
+    test_random_edits<long>("long", rng);
+    test_random_edits<std::string>("string", rng);
+    test_construction(rng);
+    test_tag_order();
+    test_without_add();
+
+    std::cout << "OK" << std::endl;
+}
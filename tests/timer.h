@@ -2,6 +2,7 @@
 
 #include <chrono>
 #include <iostream>
+#include <stdexcept>
 #include <variant>
 
 class Timer {
@@ -20,12 +21,14 @@ public:
         state = std::chrono::steady_clock::now();
     }
 
+    // Microseconds unless another std::chrono duration is asked for
+    template <typename Duration = std::chrono::microseconds>
     auto get_elapsed() {
         if (std::holds_alternative<nothing>(state)) {
             throw std::runtime_error("Timer not running");
         }
 
-        auto elapsed_time = std::chrono::duration_cast<std::chrono::microseconds>(
+        auto elapsed_time = std::chrono::duration_cast<Duration>(
             std::chrono::steady_clock::now() - std::get<time_type>(state)
         ).count();
 
@@ -0,0 +1,632 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../avl-tree.h"
+#include "../binary-tree.h"
+#include "../bplus-tree.h"
+#include "../compact-treap.h"
+#include "../persistent-treap.h"
+#include "../pool-allocator.h"
+#include "../rb-tree.h"
+#include "../splay-tree.h"
+#include "../treap.h"
+#include "check.h"
+
+// Usage: tree_tests [seed]
+//
+// Drives every tree with random operations next to a std::set and stops at
+// the first difference.
+
+std::vector<int> random_keys(std::mt19937& rng, size_t count, int range) {
+    std::uniform_int_distribution<int> key(0, range - 1);
+    std::vector<int> keys(count);
+    for (int& value : keys) {
+        value = key(rng);
+    }
+    return keys;
+}
+
+// Range constructor and assign() from sorted, unsorted and duplicate keys
+template <typename Tree>
+void test_construction(const std::string& name, std::mt19937& rng) {
+    std::uniform_int_distribution<size_t> size(0, 3000);
+    for (int round = 0; round < 20; ++round) {
+        std::vector<int> keys = random_keys(rng, round < 2 ? round : size(rng), 2000);
+        if (round % 3 == 0) {
+            std::sort(keys.begin(), keys.end());
+        }
+        std::set<int> model(keys.begin(), keys.end());
+
+        Tree tree(keys.begin(), keys.end());
+        check_same(tree, model, name + ": range constructor");
+
+        // assign replaces whatever was there
+        std::vector<int> other = random_keys(rng, size(rng), 2000);
+        tree.assign(other.begin(), other.end());
+        check_same(tree, std::set<int>(other.begin(), other.end()), name + ": assign");
+        tree.assign(keys.begin(), keys.end());
+        check_same(tree, model, name + ": assign");
+
+        // and leaves a tree that keeps working
+        for (int value : other) {
+            check(tree.insert(value).second == model.insert(value).second,
+                  name + ": insert after assign");
+        }
+        for (int value : keys) {
+            check(tree.erase(value) == (model.erase(value) == 1),
+                  name + ": erase after assign");
+        }
+        check_same(tree, model, name + ": after assign");
+    }
+
+    // Single-pass input
+    std::stringstream stream("5 3 9 3 1 5");
+    Tree tree{std::istream_iterator<int>(stream), std::istream_iterator<int>()};
+    check_same(tree, std::set<int>{1, 3, 5, 9}, name + ": input iterators");
+}
+
+// Copies are independent of their source
+template <typename Tree>
+void test_copy(const Tree& tree, const std::set<int>& model, const std::string& name) {
+    Tree copy = tree;
+    check_same(copy, model, name + ": copy");
+
+    Tree assigned;
+    assigned.insert(-1);
+    assigned = tree;
+    check_same(assigned, model, name + ": copy assignment");
+    const Tree& alias = assigned;
+    assigned = alias;
+    check_same(assigned, model, name + ": self-assignment");
+
+    copy.insert(-1);
+    assigned.clear();
+    check_same(tree, model, name + ": source after changing the copies");
+    std::set<int> changed = model;
+    changed.insert(-1);
+    check_same(copy, changed, name + ": copy after changing it");
+}
+
+// Moves hand the nodes over, so addresses stay put
+template <typename Tree>
+void test_move(Tree& tree, const std::set<int>& model, const std::string& name) {
+    const int* first = tree.empty() ? nullptr : &*tree.begin();
+    Tree moved = std::move(tree);
+    check_same(moved, model, name + ": move construction");
+    check(tree.empty(), name + ": moved-from tree is empty");
+    check(moved.empty() || &*moved.begin() == first, name + ": move keeps the nodes");
+
+    tree.insert(-1);
+    tree = std::move(moved);
+    check_same(tree, model, name + ": move assignment");
+    check(tree.empty() || &*tree.begin() == first, name + ": move keeps the nodes");
+    moved.insert(-1);
+    check_same(moved, std::set<int>{-1}, name + ": moved-from tree reused");
+}
+
+// A structure-preserving copy finds every key at the same depth
+template <typename Tree>
+void test_copy_shape(const std::string& name, std::mt19937& rng) {
+    std::vector<int> keys = random_keys(rng, 5000, 20000);
+    Tree tree;
+    for (int value : keys) {
+        tree.insert(value);
+    }
+    for (size_t i = 0; i < keys.size(); i += 3) {
+        tree.erase(keys[i]);
+    }
+
+    Tree copy = tree;
+    tree.instrumentation().reset();
+    copy.instrumentation().reset();
+    for (int value : keys) {
+        tree.find(value);
+        copy.find(value);
+    }
+    check(tree.instrumentation().search_depths == copy.instrumentation().search_depths,
+          name + ": copy has the source's shape");
+}
+
+// Balance kept through random inserts and erases: finding every key never
+// goes deeper than max_depth(n) allows
+template <typename Tree, typename MaxDepth>
+void test_depth_bound(const std::string& name, std::mt19937& rng, MaxDepth max_depth) {
+    Tree tree;
+    std::set<int> model;
+    std::uniform_int_distribution<int> key(0, 49999);
+    for (int round = 0; round < 10; ++round) {
+        for (int step = 0; step < 20000; ++step) {
+            int value = key(rng);
+            if (round % 2 == 0 || step % 4 != 0) {
+                tree.insert(value);
+                model.insert(value);
+            } else {
+                tree.erase(value);
+                model.erase(value);
+            }
+        }
+        // Copies and moves must carry the balancing metadata along
+        if (round == 3) {
+            Tree copy = tree;
+            tree = std::move(copy);
+        }
+        // Also the skewed case of erasing every low key
+        if (round == 5) {
+            for (auto it = model.begin(); it != model.end() && *it < 25000;) {
+                tree.erase(*it);
+                it = model.erase(it);
+            }
+        }
+
+        tree.instrumentation().reset();
+        for (int value : model) {
+            tree.find(value);
+        }
+        const auto& depths = tree.instrumentation().search_depths;
+        size_t deepest = 0;
+        for (size_t depth = 0; depth < depths.size(); ++depth) {
+            if (depths[depth] != 0) {
+                deepest = depth;
+            }
+        }
+        check(deepest + 1 <= max_depth(model.size()), name + ": tree too deep");
+        check_same(tree, model, name + ": depth bound");
+    }
+}
+
+// Whatever find reaches is splayed to the root, so finding it again costs
+// a single comparison
+void test_splay_to_root(std::mt19937& rng) {
+    SplayTree<int, std::allocator<int>, augments::none, instruments::counters> tree;
+    std::vector<int> keys = random_keys(rng, 5000, 20000);
+    for (int value : keys) {
+        tree.insert(value);
+    }
+    for (size_t i = 0; i < keys.size(); i += 7) {
+        tree.find(keys[i]);
+        tree.instrumentation().reset();
+        check(*tree.find(keys[i]) == keys[i], "splay: find");
+        check(tree.instrumentation().comparisons == 1, "splay: found key is at the root");
+    }
+}
+
+// insert, emplace_hint, erase, lookups, finger search, node handles and
+// merge
+template <typename Tree>
+void test_node_tree(const std::string& name, std::mt19937& rng) {
+    Tree tree;
+    std::set<int> model;
+    std::uniform_int_distribution<int> key(0, 999);
+    std::uniform_int_distribution<int> operation(0, 9);
+
+    for (int step = 0; step < 20000; ++step) {
+        int value = key(rng);
+        switch (operation(rng)) {
+        case 0:
+        case 1:
+            check(tree.insert(value).second == model.insert(value).second,
+                  name + ": insert");
+            break;
+        case 2:
+            check(tree.erase(value) == (model.erase(value) == 1), name + ": erase");
+            break;
+        case 3: {
+            auto it = tree.lower_bound(value);
+            auto expected = model.lower_bound(value);
+            check((it == tree.end()) == (expected == model.end()), name + ": lower_bound");
+            check(it == tree.end() || *it == *expected, name + ": lower_bound");
+            check((tree.find(value) != tree.end()) == model.contains(value), name + ": find");
+            break;
+        }
+        case 4:
+            if (!model.empty()) {
+                int first = *tree.begin();
+                check(first == *model.begin() && tree.erase(first), name + ": erase first");
+                model.erase(model.begin());
+            }
+            break;
+        case 5: {
+            // Out and back in under another key, in the same node
+            auto found = tree.find(value);
+            const int* address = found == tree.end() ? nullptr : &*found;
+            auto handle = rng() % 2 == 0 || found == tree.end()
+                ? tree.extract(value) : tree.extract(found);
+            check(handle.empty() != (model.erase(value) == 1), name + ": extract");
+            if (!handle.empty()) {
+                check(&handle.value() == address, name + ": extract keeps the node");
+                handle.value() = key(rng);
+                int moved = handle.value();
+                auto result = tree.insert(std::move(handle));
+                check(result.inserted == model.insert(moved).second, name + ": insert(node)");
+                check(*result.position == moved, name + ": insert(node) position");
+                // A node whose key is taken comes back in the result
+                check(result.inserted ? result.node.empty() && &*result.position == address
+                                      : !result.node.empty() && result.node.value() == moved,
+                      name + ": insert(node) result");
+            } else {
+                auto result = tree.insert(std::move(handle));
+                check(!result.inserted && result.position == tree.end() && result.node.empty(),
+                      name + ": insert(empty node)");
+            }
+            break;
+        }
+        case 6: {
+            // merge moves the nodes over and leaves behind exactly the keys
+            // already present
+            Tree other;
+            std::set<int> other_model;
+            for (int i = 0; i < 20; ++i) {
+                int added = key(rng);
+                other.insert(added);
+                other_model.insert(added);
+            }
+            std::map<int, const int*> moved;
+            std::set<int> left_over;
+            for (const int& added : other) {
+                if (model.insert(added).second) {
+                    moved.emplace(added, &added);
+                } else {
+                    left_over.insert(added);
+                }
+            }
+            tree.merge(other);
+            check_same(other, left_over, name + ": merge source");
+            for (auto [added, address] : moved) {
+                check(&*tree.find(added) == address, name + ": merge keeps the nodes");
+            }
+            break;
+        }
+        case 7: {
+            // A node handed to another tree
+            Tree other;
+            auto handle = tree.extract(value);
+            if (!handle.empty()) {
+                model.erase(value);
+                check(other.insert(std::move(handle)).inserted, name + ": insert(node) elsewhere");
+                check_same(other, std::set<int>{value}, name + ": insert(node) elsewhere");
+                check(tree.insert(other.extract(value)).inserted == model.insert(value).second,
+                      name + ": insert(node) back");
+                check(other.empty(), name + ": extract the last node");
+            }
+            break;
+        }
+        case 8: {
+            // Hints at the key's place, near it, anywhere or at the end
+            auto hint = tree.end();
+            switch (rng() % 4) {
+            case 0:
+                hint = tree.lower_bound(value);
+                break;
+            case 1:
+                hint = tree.lower_bound(value + static_cast<int>(rng() % 21) - 10);
+                break;
+            case 2:
+                hint = tree.lower_bound(key(rng));
+                break;
+            }
+            auto found = tree.find(value);
+            const int* address = found == tree.end() ? nullptr : &*found;
+            auto it = tree.emplace_hint(hint, value);
+            check(*it == value, name + ": emplace_hint");
+            check(model.insert(value).second || &*it == address,
+                  name + ": emplace_hint returns the element already there");
+            break;
+        }
+        case 9: {
+            // Fingers anywhere, including end()
+            auto finger = rng() % 4 == 0 ? tree.end() : tree.lower_bound(key(rng));
+            auto it = tree.find_from(finger, value);
+            check((it != tree.end()) == model.contains(value), name + ": find_from");
+            check(it == tree.find(value), name + ": find_from position");
+            break;
+        }
+        }
+        if (step % 1000 == 0) {
+            check_same(tree, model, name);
+        }
+    }
+    check_same(tree, model, name);
+
+    // Even keys appended at end(), then odd keys downwards, each hinted at
+    // the one inserted before it
+    Tree sorted;
+    auto hint = sorted.end();
+    for (int value = 0; value < 1000; value += 2) {
+        hint = sorted.emplace_hint(sorted.end(), value);
+        check(*hint == value, name + ": emplace_hint at end()");
+    }
+    for (int value = 999; value > 0; value -= 2) {
+        hint = sorted.emplace_hint(hint, value);
+        check(*hint == value, name + ": emplace_hint before the last insert");
+    }
+    std::set<int> all;
+    for (int value = 0; value < 1000; ++value) {
+        all.insert(value);
+    }
+    check_same(sorted, all, name + ": hinted runs");
+
+    test_copy(tree, model, name);
+    test_move(tree, model, name);
+
+    tree.clear();
+    check(tree.empty() && tree.begin() == tree.end(), name + ": clear");
+}
+
+// Pools of different trees compare unequal, so handles and merge move the
+// values into nodes of the receiving tree's pool instead
+template <typename Tree>
+void test_node_handles_across_pools(const std::string& name, std::mt19937& rng) {
+    std::vector<int> keys = random_keys(rng, 500, 1000);
+    std::vector<int> other_keys = random_keys(rng, 500, 1000);
+    Tree tree(keys.begin(), keys.end());
+    Tree other(other_keys.begin(), other_keys.end());
+    std::set<int> model(keys.begin(), keys.end());
+    std::set<int> other_model(other_keys.begin(), other_keys.end());
+
+    for (int value : keys) {
+        auto handle = tree.extract(value);
+        if (handle.empty()) {
+            continue;
+        }
+        model.erase(value);
+        auto result = other.insert(std::move(handle));
+        check(result.inserted == other_model.insert(value).second,
+              name + ": insert(node) from another pool");
+        check(result.inserted == result.node.empty(), name + ": insert(node) from another pool");
+    }
+    check_same(tree, model, name + ": extracted across pools");
+    check_same(other, other_model, name + ": inserted across pools");
+
+    std::set<int> left_over;
+    for (int value : other_model) {
+        if (!model.insert(value).second) {
+            left_over.insert(value);
+        }
+    }
+    tree.insert(-1);
+    model.insert(-1);
+    tree.merge(other);
+    check_same(tree, model, name + ": merge across pools");
+    check_same(other, left_over, name + ": merge across pools leaves");
+}
+
+// Trees without node handles
+template <typename Tree>
+void test_flat_tree(const std::string& name, std::mt19937& rng) {
+    Tree tree;
+    std::set<int> model;
+    std::uniform_int_distribution<int> key(0, 4999);
+    std::uniform_int_distribution<int> operation(0, 3);
+
+    for (int step = 0; step < 50000; ++step) {
+        int value = key(rng);
+        switch (operation(rng)) {
+        case 0:
+        case 1:
+            check(tree.insert(value).second == model.insert(value).second,
+                  name + ": insert");
+            break;
+        case 2:
+            check(tree.erase(value) == (model.erase(value) == 1), name + ": erase");
+            break;
+        case 3: {
+            auto it = tree.lower_bound(value);
+            auto expected = model.lower_bound(value);
+            check((it == tree.end()) == (expected == model.end()), name + ": lower_bound");
+            check(it == tree.end() || *it == *expected, name + ": lower_bound");
+            auto upper = tree.upper_bound(value);
+            expected = model.upper_bound(value);
+            check((upper == tree.end()) == (expected == model.end()), name + ": upper_bound");
+            check(upper == tree.end() || *upper == *expected, name + ": upper_bound");
+            check((tree.find(value) != tree.end()) == model.contains(value), name + ": find");
+            break;
+        }
+        }
+        check(model.empty() ? tree.begin() == tree.end() : *tree.begin() == *model.begin(),
+              name + ": begin");
+        if (step % 5000 == 0) {
+            check_same(tree, model, name);
+        }
+        // Emptied now and then, so the tree has to start over
+        if (step % 20000 == 19999) {
+            for (int remaining : model) {
+                check(tree.erase(remaining), name + ": erase everything");
+            }
+            model.clear();
+            check(tree.empty() && tree.begin() == tree.end(), name + ": emptied");
+        }
+    }
+    check_same(tree, model, name);
+
+    test_copy(tree, model, name);
+    test_move(tree, model, name);
+}
+
+// Versions of a PersistentTreap branch off each other: changing any one,
+// old or new, leaves every other as it was
+void test_persistent_versions(std::mt19937& rng) {
+    std::vector<PersistentTreap<int>> versions(1);
+    std::vector<std::set<int>> models(1);
+    std::uniform_int_distribution<int> key(0, 1999);
+
+    for (int step = 0; step < 20000; ++step) {
+        std::uniform_int_distribution<size_t> pick(0, versions.size() - 1);
+        size_t index = step % 4 == 0 ? pick(rng) : versions.size() - 1;
+        int value = key(rng);
+        if (rng() % 3 != 0) {
+            check(versions[index].insert(value).second == models[index].insert(value).second,
+                  "persistent_treap: insert into a version");
+        } else {
+            check(versions[index].erase(value) == (models[index].erase(value) == 1),
+                  "persistent_treap: erase from a version");
+        }
+
+        if (step % 500 == 0) {
+            // A snapshot shares the nodes it was taken from
+            versions.push_back(versions[index]);
+            models.push_back(models[index]);
+            check(versions.back().size() == models.back().size()
+                      && (models.back().empty()
+                          || &*versions.back().begin() == &*versions[index].begin()),
+                  "persistent_treap: snapshot shares nodes");
+        }
+        if (step % 2000 == 1999) {
+            for (size_t i = 0; i < versions.size(); ++i) {
+                check_same(versions[i], models[i], "persistent_treap: version");
+            }
+        }
+    }
+
+    // Dropping versions in any order frees only what nothing else reaches
+    std::shuffle(versions.begin() + 1, versions.end(), rng);
+    while (versions.size() > 1) {
+        versions.pop_back();
+    }
+    check_same(versions.front(), models.front(), "persistent_treap: first version");
+}
+
+// Keys equal to, or beyond, the infinity that BPlusTree keeps in unused
+// slots, see BPlusTree::padding
+void test_bplus_float_keys(std::mt19937& rng) {
+    constexpr double inf = std::numeric_limits<double>::infinity();
+    constexpr double max = std::numeric_limits<double>::max();
+    const std::vector<double> edges = {inf, -inf, max, std::numeric_limits<double>::lowest(),
+                                       0.0, -0.0, std::nextafter(max, 0.0)};
+
+    BPlusTree<double> tree;
+    std::set<double> model;
+    std::uniform_real_distribution<double> uniform(-1e6, 1e6);
+    std::uniform_int_distribution<int> operation(0, 4);
+    std::uniform_int_distribution<size_t> edge(0, edges.size() - 1);
+
+    for (int step = 0; step < 50000; ++step) {
+        double value = operation(rng) == 0 ? edges[edge(rng)] : uniform(rng);
+        switch (operation(rng)) {
+        case 0:
+        case 1:
+            check(tree.insert(value).second == model.insert(value).second,
+                  "bplus<double>: insert");
+            break;
+        case 2:
+            check(tree.erase(value) == (model.erase(value) == 1), "bplus<double>: erase");
+            break;
+        default: {
+            auto lower = tree.lower_bound(value);
+            auto expected_lower = model.lower_bound(value);
+            check((lower == tree.end()) == (expected_lower == model.end()),
+                  "bplus<double>: lower_bound");
+            check(lower == tree.end() || *lower == *expected_lower, "bplus<double>: lower_bound");
+            auto upper = tree.upper_bound(value);
+            auto expected_upper = model.upper_bound(value);
+            check((upper == tree.end()) == (expected_upper == model.end()),
+                  "bplus<double>: upper_bound");
+            check(upper == tree.end() || *upper == *expected_upper, "bplus<double>: upper_bound");
+            check((tree.find(value) != tree.end()) == model.contains(value),
+                  "bplus<double>: find");
+            break;
+        }
+        }
+    }
+    check_same(tree, model, "bplus<double>");
+
+    // A tree of nothing but the padding value
+    BPlusTree<double> top;
+    check(top.insert(inf).second && !top.insert(inf).second, "bplus<double>: insert inf");
+    check(top.find(inf) != top.end() && top.size() == 1, "bplus<double>: find inf");
+    check(top.upper_bound(inf) == top.end(), "bplus<double>: upper_bound inf");
+    check(top.erase(inf) && top.empty(), "bplus<double>: erase inf");
+}
+
+// std::string nodes hold only 4 keys per leaf and 6 per inner node, so a
+// few thousand keys make a tree many levels high that splits and merges
+// inner nodes all the time
+void test_bplus_deep(std::mt19937& rng) {
+    BPlusTree<std::string> tree;
+    std::set<std::string> model;
+    std::uniform_int_distribution<int> key(0, 19999);
+
+    for (int round = 0; round < 4; ++round) {
+        for (int step = 0; step < 30000; ++step) {
+            std::string value = std::to_string(key(rng));
+            if (round % 2 == 0 || step % 3 == 0) {
+                check(tree.insert(value).second == model.insert(value).second,
+                      "bplus<string>: insert");
+            } else {
+                check(tree.erase(value) == (model.erase(value) == 1), "bplus<string>: erase");
+            }
+            check(tree.size() == model.size(), "bplus<string>: size");
+        }
+        check_same(tree, model, "bplus<string>");
+        for (int step = 0; step < 1000; ++step) {
+            std::string value = std::to_string(key(rng));
+            auto it = tree.lower_bound(value);
+            auto expected = model.lower_bound(value);
+            check((it == tree.end()) == (expected == model.end()), "bplus<string>: lower_bound");
+            check(it == tree.end() || *it == *expected, "bplus<string>: lower_bound");
+        }
+    }
+
+    // Emptied through erases from the deepest shape
+    for (const std::string& value : model) {
+        check(tree.erase(value), "bplus<string>: erase everything");
+    }
+    check(tree.empty() && tree.begin() == tree.end(), "bplus<string>: emptied");
+}
+
+int main(int argc, char* argv[]) {
+    std::mt19937 rng(read_seed(argc, argv));
+
+    test_node_tree<BinaryTree<int, nodes::DefaultNode<int>, std::allocator<int>>>("naive", rng);
+    test_node_tree<AVLTree<int>>("avl", rng);
+    test_node_tree<Treap<int>>("treap", rng);
+    test_node_tree<SplayTree<int>>("splay", rng);
+    test_node_tree<RBTree<int>>("rb", rng);
+
+    test_node_handles_across_pools<AVLTree<int, PoolAllocator<int>>>("pooled avl", rng);
+    test_node_handles_across_pools<Treap<int, PoolAllocator<int>>>("pooled treap", rng);
+
+    test_construction<BinaryTree<int, nodes::DefaultNode<int>, std::allocator<int>>>(
+        "naive", rng);
+    test_construction<AVLTree<int>>("avl", rng);
+    test_construction<Treap<int>>("treap", rng);
+    test_construction<SplayTree<int>>("splay", rng);
+    test_construction<RBTree<int>>("rb", rng);
+
+    test_flat_tree<CompactTreap<int>>("compact_treap", rng);
+    test_construction<CompactTreap<int>>("compact_treap", rng);
+    test_flat_tree<PersistentTreap<int>>("persistent_treap", rng);
+    test_construction<PersistentTreap<int>>("persistent_treap", rng);
+    test_persistent_versions(rng);
+    test_flat_tree<BPlusTree<int>>("bplus", rng);
+    test_construction<BPlusTree<int>>("bplus", rng);
+    test_bplus_float_keys(rng);
+    test_bplus_deep(rng);
+
+    test_copy_shape<BinaryTree<int, nodes::DefaultNode<int>, std::allocator<int>,
+                               instruments::counters>>("naive", rng);
+    test_copy_shape<AVLTree<int, std::allocator<int>, augments::none,
+                            instruments::counters>>("avl", rng);
+    test_copy_shape<Treap<int, std::allocator<int>, augments::none,
+                          instruments::counters>>("treap", rng);
+
+    test_copy_shape<RBTree<int, std::allocator<int>, augments::none,
+                           instruments::counters>>("rb", rng);
+
+    test_splay_to_root(rng);
+
+    test_depth_bound<RBTree<int, std::allocator<int>, augments::none, instruments::counters>>(
+        "rb", rng, [](size_t n) { return 2 * std::log2(n + 1); });
+    test_depth_bound<AVLTree<int, std::allocator<int>, augments::none, instruments::counters>>(
+        "avl", rng, [](size_t n) { return 1.4405 * std::log2(n + 2) - 0.3277; });
+
+    std::cout << "OK" << std::endl;
+}
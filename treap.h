@@ -2,15 +2,28 @@
 
 #include "binary-tree.h"
 
+#include <bit>
 #include <chrono>
+#include <functional>
+#include <future>
+#include <iterator>
 #include <random>
+#include <span>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <tuple>
+#include <vector>
 
 namespace nodes {
 
-template <typename T>
-class TreapNode : public BaseNode<TreapNode<T>> {
+template <typename T, typename Augment = augments::none>
+class TreapNode : public BaseNode<TreapNode<T, Augment>> {
 public:
-    inline static std::mt19937_64 rng{
+    using augment_type = Augment;
+
+    // Per thread, so trees on different threads share no state
+    inline static thread_local std::mt19937_64 rng{
         static_cast<unsigned>(
             std::chrono::steady_clock::now().time_since_epoch().count()
         )
@@ -18,13 +31,14 @@ public:
 
     T value;
     size_t priority;
+    [[no_unique_address]] typename Augment::value_type augment{};
 
-    using base_type = BaseNode<TreapNode<T>>;
+    using base_type = BaseNode<TreapNode<T, Augment>>;
     using base_type::base_type;
 
     template <typename... Args>
-    TreapNode(TreapNode<T>* left, TreapNode<T>* right, 
-              TreapNode<T>* parent, Args&&... args)
+    TreapNode(TreapNode* left, TreapNode* right, 
+              TreapNode* parent, Args&&... args)
             : base_type(left, right, parent)
             , value(std::forward<Args>(args)...)
             , priority(rng())
@@ -33,39 +47,83 @@ public:
 
 }
 
-template <typename T>
-class Treap : public BinaryTree<T, nodes::TreapNode<T>,
-                        std::allocator<T>> {
-    using base_type = BinaryTree<T, nodes::TreapNode<T>,
-                        std::allocator<T>>;
+template <
+    typename T,
+    typename Allocator = std::allocator<T>,
+    typename Augment = augments::none,
+    typename Instrument = instruments::none,
+    typename Compare = std::less<T>
+> class Treap : public BinaryTree<T, nodes::TreapNode<T, Augment>, Allocator,
+                                Instrument, Compare> {
+    using base_type = BinaryTree<T, nodes::TreapNode<T, Augment>, Allocator,
+                                 Instrument, Compare>;
     using base_type::base_type;
 
     using base_type::find_helper;
+    using base_type::find_slot;
+    using base_type::find_slot_from;
+    using base_type::link_at;
+    using base_type::comp;
 
     using base_type::sentinel_node;
     using base_type::reset_sentinel;
 
     using base_type::create_node;
     using base_type::destroy_node;
+    using base_type::create_nodes;
+    using base_type::sorted_unique;
+
+    using base_type::update_augment;
+    using base_type::update_augment_upward;
+    using base_type::update_augment_subtree;
 
     using typename base_type::Node;
+    using typename base_type::Slot;
 
 public:
+    Treap() = default;
+
+    template <std::input_iterator InputIt>
+    Treap(InputIt first, InputIt last) {
+        assign(first, last);
+    }
+
     // Basic functions
     using base_type::find;
+    using base_type::lower_bound;
+    using base_type::upper_bound;
+    using base_type::equal_range;
+    using base_type::find_many;
+    using base_type::find_from;
+    using base_type::key_comp;
+    using base_type::clear;
+
+    // Order statistics, available with augments::subtree_size
+    using base_type::size;
+    using base_type::nth;
+    using base_type::rank;
+
+    // Range aggregates, available with any augment
+    using base_type::aggregate;
 
     // Helpers
     using base_type::print_by_layer;
+    using base_type::freeze;
+    using base_type::instrumentation;
 
     // Iterators
     using typename base_type::iterator;
     using typename base_type::const_iterator;
 
+    // Node handles, see NodeHandle
+    using typename base_type::node_type;
+    using typename base_type::insert_return_type;
+
     using base_type::begin;
     using base_type::end;
 
     // Fake node connects first, last and parent
-    using BaseNode = nodes::BaseNode<nodes::TreapNode<T>>;
+    using BaseNode = nodes::BaseNode<nodes::TreapNode<T, Augment>>;
 
     // Modified functions implementation
     template <typename... Args>
@@ -75,49 +133,575 @@ public:
             std::forward<Args>(args)...
         );
         
-        if (find(new_node->value) != end()) {
+        if (!attach_node(new_node).second) {
             destroy_node(new_node);
             return std::make_pair(end(), false);
         }
+        return std::make_pair(iterator(new_node, *this), true);
+    }
 
-        auto [lhs, rhs] = split(sentinel_node.parent, new_node->value);
-        BaseNode* merged_rhs = merge(new_node, rhs);
-        sentinel_node.parent = merge(lhs, merged_rhs);
+    // Searches first and builds the T only if key is missing, see
+    // BinaryTree::try_emplace
+    template <LookupKey<T, Compare> Key = T, typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args) {
+        Slot slot = find_slot(key);
+        if (slot.node != &sentinel_node && slot.order == 0) {
+            return std::make_pair(iterator(slot.node, *this), false);
+        }
 
-        update_leftmost_pointer();
-        update_rightmost_pointer();
+        Node* new_node;
+        if constexpr (sizeof...(Args) == 0) {
+            new_node = create_node(&sentinel_node, &sentinel_node,
+                                   &sentinel_node, key);
+        } else {
+            new_node = create_node(&sentinel_node, &sentinel_node,
+                                   &sentinel_node, std::forward<Args>(args)...);
+        }
+        link_at_slot(slot, new_node);
+        return std::make_pair(iterator(new_node, *this), true);
+    }
 
-        return std::make_pair(iterator(new_node, &sentinel_node), true);
+    // Searches from hint, see BinaryTree::find_from. Appending with end()
+    // as hint takes one comparison and expected O(1) rotations.
+    template <typename... Args>
+    iterator emplace_hint(const_iterator hint, Args&&... args) {
+        Node* new_node = create_node(
+            &sentinel_node, &sentinel_node, &sentinel_node,
+            std::forward<Args>(args)...
+        );
+
+        Slot slot = find_slot_from(hint, new_node->value);
+        if (slot.node != &sentinel_node && slot.order == 0) {
+            destroy_node(new_node);
+            return iterator(slot.node, *this);
+        }
+        link_at_slot(slot, new_node);
+        return iterator(new_node, *this);
     }
 
     std::pair<iterator, bool> insert(const T& value) {
-        return emplace(value);
+        return try_emplace(value);
     }
 
     std::pair<iterator, bool> insert(T&& value) {
-        return emplace(std::forward<T>(value));
+        return try_emplace(value, std::move(value));
+    }
+
+    template <std::input_iterator InputIt>
+    void assign(InputIt first, InputIt last) {
+        std::vector<T> values = sorted_unique(first, last);
+        clear();
+        std::vector<Node*> nodes = create_nodes(std::move(values));
+        if (nodes.empty()) {
+            return;
+        }
+
+        set_root(link_cartesian(nodes));
+        sentinel_node.left = nodes.front();
+        sentinel_node.right = nodes.back();
+    }
+
+    // Rebuilds a treap saved with save() in O(n), priorities included
+    void assign(const MappedTree<T, Compare>& image) {
+        base_type::assign_image(image, images::Kind::treap,
+            [](BaseNode* node, std::uint64_t priority) {
+                node->as_derived()->priority = static_cast<size_t>(priority);
+            });
+    }
+
+    // Snapshots, see mapped-tree.h. load_mmap serves lookups from the
+    // mapped file as is; assign(image) turns it back into a mutable treap.
+    void save(const std::string& path) const
+            requires std::is_trivially_copyable_v<T> {
+        base_type::save_image(path, images::Kind::treap, [](const Node* node) {
+            return node->priority;
+        });
+    }
+
+    static MappedTree<T, Compare> load_mmap(const std::string& path) {
+        return MappedTree<T, Compare>(path, images::Kind::treap);
+    }
+
+    // Batches are sorted and turned into a treap of their own in O(k), which
+    // is then joined with this one like union_with and difference_with do.
+    // The min and max links are refreshed once per batch, and elements
+    // already present keep their node. Both return how many values were
+    // actually inserted or erased.
+    size_t insert_batch(std::span<const T> values) {
+        std::vector<Node*> nodes =
+            create_nodes(sorted_unique(values.begin(), values.end()));
+        if (nodes.empty()) {
+            return 0;
+        }
+
+        DropList duplicates;
+        set_root(unite(sentinel_node.parent, link_cartesian(nodes),
+                       nodes.size(), max_fork_depth(), duplicates));
+        update_leftmost_pointer();
+        update_rightmost_pointer();
+        return nodes.size() - destroy_dropped(duplicates);
     }
 
-    bool erase(const T& value) {
-        auto [ptr, is_self] = find_helper(value);
+    // Keys to erase need no nodes: the sorted batch is walked as an implicit
+    // balanced tree, its middle key splitting the treap at each step
+    size_t erase_batch(std::span<const T> values) {
+        std::vector<T> keys = sorted_unique(values.begin(), values.end());
+
+        DropList erased;
+        set_root(subtract_keys(sentinel_node.parent,
+                               keys.data(), keys.data() + keys.size(), erased));
+        update_leftmost_pointer();
+        update_rightmost_pointer();
+        return destroy_dropped(erased);
+    }
+
+    template <LookupKey<T, Compare> Key = T>
+    bool erase(const Key& key) {
+        auto [ptr, is_self] = find_helper(key);
         if (!is_self) {
             return false;
         } else {
-            erase_node(ptr);
+            detach_node(ptr);
+            destroy_node(ptr->as_derived());
             return true;
         }
     }
 
+    // Extracted nodes keep their priority, so a node put back into the
+    // same treap lands where it was
+    template <LookupKey<T, Compare> Key = T>
+            requires (!base_type::template is_position<Key>)
+    node_type extract(const Key& key) {
+        auto [ptr, is_self] = find_helper(key);
+        return extract(const_iterator(is_self ? ptr : &sentinel_node, *this));
+    }
+
+    node_type extract(const_iterator position) {
+        return base_type::extract_handle(position, [this](BaseNode* node) {
+            detach_node(node);
+        });
+    }
+
+    insert_return_type insert(node_type&& handle) {
+        return base_type::insert_handle(std::move(handle), [this](Node* node) {
+            return attach_node(node);
+        });
+    }
+
+    void merge(Treap& other) {
+        base_type::merge_from(*this, other);
+    }
+
+    // Removes every element in [lo, hi). Cutting the range out is
+    // O(log n); destroying the removed nodes is O(k) on top.
+    size_t erase_range(const T& lo, const T& hi) {
+        size_t erased = 0;
+        this->for_each_node(cut_range(lo, hi), [this, &erased](BaseNode* node) {
+            destroy_node(node->as_derived());
+            ++erased;
+        });
+        return erased;
+    }
+
+    // Moves [lo, hi) into a new treap that shares this one's allocator.
+    // Nodes are relinked rather than copied, though their leaf links still
+    // have to be pointed at the new treap's sentinel in O(k).
+    Treap extract_range(const T& lo, const T& hi) {
+        Treap result(comp);
+        result.alloc = this->alloc;
+        result.adopt_subtree(cut_range(lo, hi), &sentinel_node);
+        return result;
+    }
+
+    // Set algebra joins the two treaps through split and merge in
+    // O(m log(n/m + 1)) expected time, m being the smaller size. Independent
+    // subtrees are processed on separate threads above parallel_cutoff
+    // nodes. A treap passed as an rvalue gives up its nodes, which are taken
+    // over when the allocators compare equal and copied into this treap's
+    // allocator otherwise; a const one is cloned straight into this treap's
+    // allocator, once. Where both hold an equal element, this treap's node
+    // is kept and the other's destroyed, as with std::set::merge, so
+    // iterators and references into this treap stay valid for every element
+    // that remains.
+    void union_with(Treap&& other) {
+        apply_set_operation(other, &Treap::unite);
+    }
+
+    void union_with(const Treap& other) {
+        union_with(clone_here(other));
+    }
+
+    void intersect_with(Treap&& other) {
+        apply_set_operation(other, &Treap::intersect);
+    }
+
+    void intersect_with(const Treap& other) {
+        intersect_with(clone_here(other));
+    }
+
+    void difference_with(Treap&& other) {
+        apply_set_operation(other, &Treap::subtract);
+    }
+
+    void difference_with(const Treap& other) {
+        difference_with(clone_here(other));
+    }
+
 private:
+    static constexpr size_t parallel_cutoff = 1 << 15;
+
+    // Subtrees left over by set operations, chained through their roots'
+    // parent links until they are destroyed on the calling thread
+    struct DropList {
+        BaseNode* head = nullptr;
+        BaseNode* tail = nullptr;
+    };
+
+    using SetOperation =
+        BaseNode* (Treap::*)(BaseNode*, BaseNode*, size_t, int, DropList&);
+
+    // Copy of other whose nodes come from this treap's allocator, so set
+    // operations can adopt them
+    Treap clone_here(const Treap& other) const {
+        Treap copy(comp);
+        copy.alloc = this->alloc;
+        copy.clone_from(other);
+        return copy;
+    }
+
+    void apply_set_operation(Treap& other, SetOperation operation) {
+        if (!(this->alloc == other.alloc)) {
+            other = clone_here(other);
+        }
+
+        BaseNode* other_root = &sentinel_node;
+        size_t other_size = 0;
+        if (!other.empty()) {
+            other_root = other.sentinel_node.parent;
+            other_size = this->relink_subtree(other_root, &other.sentinel_node);
+            other.reset_sentinel();
+        }
+
+        DropList dropped;
+        set_root((this->*operation)(sentinel_node.parent, other_root,
+                                    other_size, max_fork_depth(), dropped));
+        update_leftmost_pointer();
+        update_rightmost_pointer();
+        destroy_dropped(dropped);
+    }
+
+    // Returns the number of nodes destroyed
+    size_t destroy_dropped(DropList& list) noexcept {
+        size_t destroyed = 0;
+        for (BaseNode* root = list.head; root != nullptr;) {
+            BaseNode* next = root->parent;
+            this->for_each_node(root, [this, &destroyed](BaseNode* node) {
+                destroy_node(node->as_derived());
+                ++destroyed;
+            });
+            root = next;
+        }
+        list = DropList{};
+        return destroyed;
+    }
+
+    BaseNode* subtract_keys(BaseNode* root, const T* first, const T* last,
+                            DropList& dropped) {
+        if (first == last || root == &sentinel_node) {
+            return root;
+        }
+
+        const T* middle = first + (last - first) / 2;
+        auto [less, equal, greater] = split_equal(root, *middle);
+        drop(dropped, equal);
+        return merge(subtract_keys(less, first, middle, dropped),
+                     subtract_keys(greater, middle + 1, last, dropped));
+    }
+
+    // In unite and intersect lhs is this treap's side. The higher priority
+    // root goes on top; where both sides hold an equal key, lhs's node is
+    // kept, taking over the other root's place and priority if need be, so
+    // iterators and references into this treap stay valid.
+    BaseNode* unite(BaseNode* lhs, BaseNode* rhs, size_t work,
+                    int forks, DropList& dropped) {
+        if (lhs == &sentinel_node) {
+            return rhs;
+        } else if (rhs == &sentinel_node) {
+            return lhs;
+        }
+
+        BaseNode* root;
+        BaseNode *lhs_less, *lhs_greater, *rhs_less, *rhs_greater;
+        if (!(lhs->as_derived()->priority < rhs->as_derived()->priority)) {
+            root = lhs;
+            lhs_less = lhs->left;
+            lhs_greater = lhs->right;
+            BaseNode* equal;
+            std::tie(rhs_less, equal, rhs_greater) =
+                split_equal(rhs, lhs->as_derived()->value);
+            drop(dropped, equal);
+        } else {
+            root = rhs;
+            rhs_less = rhs->left;
+            rhs_greater = rhs->right;
+            BaseNode* equal;
+            std::tie(lhs_less, equal, lhs_greater) =
+                split_equal(lhs, rhs->as_derived()->value);
+            if (equal != &sentinel_node) {
+                root = replace_root(rhs, equal, dropped);
+            }
+        }
+
+        BaseNode* left = &sentinel_node;
+        BaseNode* right = &sentinel_node;
+        DropList right_dropped;
+        fork_join(forks > 0 && work >= parallel_cutoff, [&] {
+            left = unite(lhs_less, rhs_less, work / 2, forks - 1, dropped);
+        }, [&] {
+            right = unite(lhs_greater, rhs_greater, work / 2, forks - 1,
+                          right_dropped);
+        });
+        splice(dropped, right_dropped);
+
+        attach(root, left, right);
+        return root;
+    }
+
+    BaseNode* intersect(BaseNode* lhs, BaseNode* rhs, size_t work,
+                        int forks, DropList& dropped) {
+        if (lhs == &sentinel_node || rhs == &sentinel_node) {
+            drop(dropped, lhs);
+            drop(dropped, rhs);
+            return &sentinel_node;
+        }
+
+        BaseNode* root;
+        BaseNode* equal;
+        BaseNode *lhs_less, *lhs_greater, *rhs_less, *rhs_greater;
+        if (!(lhs->as_derived()->priority < rhs->as_derived()->priority)) {
+            root = lhs;
+            lhs_less = lhs->left;
+            lhs_greater = lhs->right;
+            std::tie(rhs_less, equal, rhs_greater) =
+                split_equal(rhs, lhs->as_derived()->value);
+            drop(dropped, equal);
+        } else {
+            root = rhs;
+            rhs_less = rhs->left;
+            rhs_greater = rhs->right;
+            std::tie(lhs_less, equal, lhs_greater) =
+                split_equal(lhs, rhs->as_derived()->value);
+            if (equal != &sentinel_node) {
+                root = replace_root(rhs, equal, dropped);
+            }
+        }
+        attach(root, &sentinel_node, &sentinel_node);
+
+        BaseNode* left = &sentinel_node;
+        BaseNode* right = &sentinel_node;
+        DropList right_dropped;
+        fork_join(forks > 0 && work >= parallel_cutoff, [&] {
+            left = intersect(lhs_less, rhs_less, work / 2, forks - 1, dropped);
+        }, [&] {
+            right = intersect(lhs_greater, rhs_greater, work / 2, forks - 1,
+                              right_dropped);
+        });
+        splice(dropped, right_dropped);
+
+        if (equal != &sentinel_node) {
+            attach(root, left, right);
+            return root;
+        }
+        drop(dropped, root);
+        return merge(left, right);
+    }
+
+    // Puts this treap's detached node kept in place of the other treap's
+    // root, whose priority it takes, and drops that root alone
+    BaseNode* replace_root(BaseNode* root, BaseNode* kept,
+                           DropList& dropped) noexcept {
+        kept->as_derived()->priority = root->as_derived()->priority;
+        attach(root, &sentinel_node, &sentinel_node);
+        drop(dropped, root);
+        return kept;
+    }
+
+    // Unlike the other two, not symmetric: lhs keeps its root
+    BaseNode* subtract(BaseNode* lhs, BaseNode* rhs, size_t work,
+                       int forks, DropList& dropped) {
+        if (lhs == &sentinel_node) {
+            drop(dropped, rhs);
+            return &sentinel_node;
+        } else if (rhs == &sentinel_node) {
+            return lhs;
+        }
+
+        auto [less, equal, greater] = split_equal(rhs, lhs->as_derived()->value);
+
+        BaseNode* left = lhs->left;
+        BaseNode* right = lhs->right;
+        DropList right_dropped;
+        fork_join(forks > 0 && work >= parallel_cutoff, [&] {
+            left = subtract(left, less, work / 2, forks - 1, dropped);
+        }, [&] {
+            right = subtract(right, greater, work / 2, forks - 1, right_dropped);
+        });
+        splice(dropped, right_dropped);
+
+        if (equal != &sentinel_node) {
+            drop(dropped, equal);
+            attach(lhs, &sentinel_node, &sentinel_node);
+            drop(dropped, lhs);
+            return merge(left, right);
+        }
+        attach(lhs, left, right);
+        return lhs;
+    }
+
+    // Splits into keys less than, equal to and greater than key; the equal
+    // node, if any, comes back detached from its children
+    std::tuple<BaseNode*, BaseNode*, BaseNode*>
+    split_equal(BaseNode* ptr, const T& key) {
+        if (ptr == &sentinel_node) {
+            return std::make_tuple(&sentinel_node, &sentinel_node, &sentinel_node);
+        } else if (comp(ptr->as_derived()->value, key)) {
+            auto [less, equal, greater] = split_equal(ptr->right, key);
+            attach(ptr, ptr->left, less);
+            return std::make_tuple(ptr, equal, greater);
+        } else if (comp(key, ptr->as_derived()->value)) {
+            auto [less, equal, greater] = split_equal(ptr->left, key);
+            attach(ptr, greater, ptr->right);
+            return std::make_tuple(less, equal, ptr);
+        } else {
+            BaseNode* less = ptr->left;
+            BaseNode* greater = ptr->right;
+            attach(ptr, &sentinel_node, &sentinel_node);
+            return std::make_tuple(less, ptr, greater);
+        }
+    }
+
+    void attach(BaseNode* node, BaseNode* left, BaseNode* right) noexcept {
+        node->left = left;
+        node->right = right;
+        if (left != &sentinel_node) {
+            left->parent = node;
+        }
+        if (right != &sentinel_node) {
+            right->parent = node;
+        }
+        update_augment(node);
+    }
+
+    void drop(DropList& list, BaseNode* root) noexcept {
+        if (root == &sentinel_node) {
+            return;
+        }
+
+        root->parent = nullptr;
+        if (list.tail != nullptr) {
+            list.tail->parent = root;
+        } else {
+            list.head = root;
+        }
+        list.tail = root;
+    }
+
+    static void splice(DropList& list, DropList& other) noexcept {
+        if (other.head == nullptr) {
+            return;
+        } else if (list.tail != nullptr) {
+            list.tail->parent = other.head;
+        } else {
+            list.head = other.head;
+        }
+        list.tail = other.tail;
+    }
+
+    // Instrument hooks are not synchronized, so instrumented treaps run set
+    // operations on the calling thread only
+    static int max_fork_depth() noexcept {
+        if constexpr (!std::is_same_v<Instrument, instruments::none>) {
+            return 0;
+        }
+        return std::bit_width(std::thread::hardware_concurrency());
+    }
+
+    // Runs both calls, the first one on another thread when parallel is set
+    // and a thread can be started
+    template <typename Left, typename Right>
+    static void fork_join(bool parallel, Left&& left, Right&& right) {
+        std::future<void> forked;
+        if (parallel) {
+            try {
+                forked = std::async(std::launch::async, left);
+            } catch (const std::system_error&) {
+                parallel = false;
+            }
+        }
+
+        if (!parallel) {
+            left();
+        }
+        right();
+        if (parallel) {
+            forked.get();
+        }
+    }
+
+    // Builds the Cartesian tree of the nodes' priorities over their sorted
+    // keys in O(n): the stack holds the right spine of the tree built so far.
+    // The root's parent link is left for the caller to set.
+    BaseNode* link_cartesian(const std::vector<Node*>& nodes) {
+        std::vector<BaseNode*> spine;
+        for (Node* node : nodes) {
+            BaseNode* last_popped = &sentinel_node;
+            while (!spine.empty()
+                    && spine.back()->as_derived()->priority < node->priority) {
+                last_popped = spine.back();
+                spine.pop_back();
+            }
+
+            node->left = last_popped;
+            if (last_popped != &sentinel_node) {
+                last_popped->parent = node;
+            }
+            if (!spine.empty()) {
+                spine.back()->right = node;
+                node->parent = spine.back();
+            }
+            spine.push_back(node);
+        }
+
+        update_augment_subtree(spine.front());
+        return spine.front();
+    }
+
+    // Detaches [lo, hi) and returns its root, whose parent link is stale
+    BaseNode* cut_range(const T& lo, const T& hi) {
+        if (!comp(lo, hi)) {
+            return &sentinel_node;
+        }
+
+        auto [lhs, rest] = split(sentinel_node.parent, lo);
+        auto [middle, rhs] = split(rest, hi);
+        set_root(merge(lhs, rhs));
+
+        update_leftmost_pointer();
+        update_rightmost_pointer();
+        return middle;
+    }
+
     std::pair<BaseNode*, BaseNode*> split(BaseNode* ptr, const T& key) {
+        [[maybe_unused]] auto guard = this->instrument.enter_recursion();
         if (ptr == &sentinel_node) {
             return std::make_pair(&sentinel_node, &sentinel_node);
-        } else if (ptr->as_derived()->value < key) {
+        } else if (comp(ptr->as_derived()->value, key)) {
             auto [lhs, rhs] = split(ptr->right, key);
             ptr->right = lhs;
             if (lhs != &sentinel_node) {
                 lhs->parent = ptr;
             }
+            update_augment(ptr);
             return std::make_pair(ptr, rhs);
         } else {
             auto [lhs, rhs] = split(ptr->left, key);
@@ -125,11 +709,13 @@ private:
             if (rhs != &sentinel_node) {
                 rhs->parent = ptr;
             }
+            update_augment(ptr);
             return std::make_pair(lhs, ptr);
         }
     }
 
     BaseNode* merge(BaseNode* left_ptr, BaseNode* right_ptr) {
+        [[maybe_unused]] auto guard = this->instrument.enter_recursion();
         if (left_ptr == &sentinel_node) {
             return right_ptr;
         } else if (right_ptr == &sentinel_node) {
@@ -137,14 +723,24 @@ private:
         } else if (left_ptr->as_derived()->priority > right_ptr->as_derived()->priority) {
             left_ptr->right = merge(left_ptr->right, right_ptr);
             left_ptr->right->parent = left_ptr;
+            update_augment(left_ptr);
             return left_ptr;
         } else {
             right_ptr->left = merge(left_ptr, right_ptr->left);
             right_ptr->left->parent = right_ptr;
+            update_augment(right_ptr);
             return right_ptr;
         }
     }
 
+    // Roots returned by split and merge may keep a stale parent link
+    void set_root(BaseNode* root) noexcept {
+        sentinel_node.parent = root;
+        if (root != &sentinel_node) {
+            root->parent = &sentinel_node;
+        }
+    }
+
     void update_leftmost_pointer() {
         BaseNode* new_min = sentinel_node.parent;
         while (new_min != &sentinel_node && new_min->left != &sentinel_node) {
@@ -161,7 +757,64 @@ private:
         sentinel_node.right = new_max;
     }
 
-    void erase_node(BaseNode* node) {
+    std::pair<BaseNode*, bool> attach_node(Node* node) {
+        Slot slot = find_slot(node->value);
+        if (slot.node != &sentinel_node && slot.order == 0) {
+            return std::make_pair(slot.node, false);
+        }
+        link_at_slot(slot, node);
+        return std::make_pair(node, true);
+    }
+
+    // Hangs node, whose value the search that ended at slot did not find,
+    // as a leaf there, then rotates it up past parents of lower priority.
+    // Rotations keep the order, so the min and max links link_at set stay
+    // right and no spine is walked.
+    void link_at_slot(const Slot& slot, Node* node) {
+        link_at(slot, node);
+        update_augment(node);
+        while (node->parent != &sentinel_node
+                && node->parent->as_derived()->priority < node->priority) {
+            rotate_up(node);
+        }
+        update_augment_upward(node->parent);
+    }
+
+    // Swaps node with its parent, which becomes its child on the other side
+    void rotate_up(BaseNode* node) noexcept {
+        this->instrument.on_rotation();
+        BaseNode* parent = node->parent;
+        BaseNode* grandparent = parent->parent;
+
+        if (parent->left == node) {
+            parent->left = node->right;
+            if (node->right != &sentinel_node) {
+                node->right->parent = parent;
+            }
+            node->right = parent;
+        } else {
+            parent->right = node->left;
+            if (node->left != &sentinel_node) {
+                node->left->parent = parent;
+            }
+            node->left = parent;
+        }
+
+        parent->parent = node;
+        node->parent = grandparent;
+        if (grandparent == &sentinel_node) {
+            sentinel_node.parent = node;
+        } else if (grandparent->left == parent) {
+            grandparent->left = node;
+        } else {
+            grandparent->right = node;
+        }
+
+        update_augment(parent);
+        update_augment(node);
+    }
+
+    void detach_node(BaseNode* node) {
         BaseNode* new_subtree = merge(node->left, node->right);
 
         if (node->parent != &sentinel_node) {
@@ -174,6 +827,7 @@ private:
             if (new_subtree != &sentinel_node) {
                 new_subtree->parent = node->parent;
             }
+            update_augment_upward(node->parent);
         } else {
             sentinel_node.parent = new_subtree;
             if (new_subtree != &sentinel_node) {
@@ -187,7 +841,5 @@ private:
         if (sentinel_node.right == node) {
             update_rightmost_pointer();
         }
-
-        destroy_node(node->as_derived());
     }
 };